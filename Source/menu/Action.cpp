@@ -1,11 +1,16 @@
 #include "Action.h"
 
+const Action& HAction::data() const {
+  check(tables != nullptr);
+  return tables->actions[h];
+}
+
 HCharacter HAction::character() const {
-  return HCharacter(actions[h].character);
+  return tables->bind(HCharacter(data().character));
 }
 
 const Hitbox& HAction::collision() const {
-  const std::optional<Hitbox>& b = actions[h].collision;
+  const std::optional<Hitbox>& b = data().collision;
   if (b.has_value())
     return b.value();
   else
@@ -13,7 +18,7 @@ const Hitbox& HAction::collision() const {
 }
 
 const Box& HAction::collision(int frame) const {
-  const std::optional<Hitbox>& hb = actions[h].collision;
+  const std::optional<Hitbox>& hb = data().collision;
   const Box *b = nullptr;
   if (hb.has_value() && hb.value().at(frame))
     b = &(hb.value().at(frame)->at(0));
@@ -23,67 +28,72 @@ const Box& HAction::collision(int frame) const {
 }
 
 const Hitbox& HAction::hitbox() const {
-  return actions[h].hitbox;
+  return data().hitbox;
 }
 
 const Hitbox& HAction::hurtbox() const {
-  return actions[h].hurtbox;
+  return data().hurtbox;
 }
 
 int HAction::damage() const {
-  return actions[h].damage;
+  return data().damage;
 }
 
 int HAction::blockAdvantage() const {
-  return actions[h].blockAdvantage;
+  return data().blockAdvantage;
 }
 
 int HAction::hitAdvantage() const {
-  return actions[h].hitAdvantage;
+  return data().hitAdvantage;
 }
 
 int HAction::lockedFrames() const {
-  return actions[h].lockedFrames;
+  return data().lockedFrames;
 }
 
 int HAction::animationLength() const {
-  return actions[h].animationLength;
+  return data().animationLength;
 }
 
 FVector HAction::velocity() const {
-  return actions[h].velocity;
+  return data().velocity;
 }
 
 bool HAction::isWalkOrIdle() const {
-  return (actions[h].type == ActionType::Idle) || (actions[h].type == ActionType::Walk);
+  return (data().type == ActionType::Idle) || (data().type == ActionType::Walk);
 }
 
 enum ActionType HAction::type() const {
-  return actions[h].type;
+  return data().type;
 }
 
 enum EAnimation HAction::animation() const {
-  return actions[h].animation;
+  return data().animation;
 }
 
 int HAction::specialCancelFrames() const {
-  return actions[h].specialCancelFrames;
+  return data().specialCancelFrames;
 }
 
 const std::map<enum Button, HAction>& HAction::chains() const {
-  return actions[h].chains;
+  return data().chains;
 }
 
 float HAction::knockdownDistance() const {
-  return actions[h].knockdownDistance;
+  return data().knockdownDistance;
 }
 
 float HAction::pushbackDistance() const {
-  return actions[h].pushbackDistance;
+  return data().pushbackDistance;
 }
 
 bool HAction::hitsWalkingBack() const {
-  return actions[h].hitsWalkingBack;
+  return data().hitsWalkingBack;
+}
+
+const ActionTables& HAction::getTables() const {
+  check(tables != nullptr);
+  return *tables;
 }
 
 bool HAction::operator==(const HAction& b) const {
@@ -94,72 +104,84 @@ bool HAction::operator!=(const HAction& b) const {
   return !(*this == b);
 }
 
+FArchive& operator<<(FArchive& Ar, HAction& a) {
+  Ar << a.h;
+  if (Ar.IsLoading() && ((a.h < -1) || (a.h >= N_ACTIONS)))
+    Ar.SetError();
+  return Ar;
+}
+
+const Character& HCharacter::data() const {
+  check(tables != nullptr);
+  return tables->characters[h];
+}
+
 const char* HCharacter::name() const {
-  return characters[h].name;
+  return data().name;
 }
 
 const Hitbox& HCharacter::collision() const {
-  return characters[h].collision;
+  return data().collision;
 }
 
 HAction HCharacter::idle() const {
-  return characters[h].idle;
+  return data().idle;
 }
 
 HAction HCharacter::walkForward() const {
-  return characters[h].walkForward;
+  return data().walkForward;
 }
 
 HAction HCharacter::walkBackward() const {
-  return characters[h].walkBackward;
+  return data().walkBackward;
 }
 
 HAction HCharacter::fJump() const {
-  return characters[h].fJump;
+  return data().fJump;
 }
 
 HAction HCharacter::damaged() const {
-  return characters[h].damaged;
+  return data().damaged;
 }
 
 HAction HCharacter::block() const {
-  return characters[h].block;
+  return data().block;
 }
 
 HAction HCharacter::sthp() const {
-  return characters[h].sthp;
+  return data().sthp;
 }
 
 HAction HCharacter::stlp() const {
-  return characters[h].stlp;
+  return data().stlp;
 }
 
 HAction HCharacter::grab() const {
-  return characters[h].grab;
+  return data().grab;
 }
 
 HAction HCharacter::throw_() const {
-  return characters[h].throw_;
+  return data().throw_;
 }
 
 HAction HCharacter::thrown() const {
-  return characters[h].thrown;
+  return data().thrown;
 }
 
 HAction HCharacter::thrownGR() const {
-  return characters[h].thrownGR;
+  return data().thrownGR;
 }
 
 HAction HCharacter::kd() const {
-  return characters[h].kd;
+  return data().kd;
 }
 
 HAction HCharacter::defeat() const {
-  return characters[h].defeat;
+  return data().defeat;
 }
 
 const std::map<enum Button, HAction>& HCharacter::specials() const {
-  return characters[h].specials;
+  return data().specials;
 }
 
 bool HCharacter::operator==(const HCharacter& b) const {
@@ -169,3 +191,10 @@ bool HCharacter::operator==(const HCharacter& b) const {
 bool HCharacter::operator!=(const HCharacter& b) const {
   return !(*this == b);
 }
+
+FArchive& operator<<(FArchive& Ar, HCharacter& c) {
+  Ar << c.h;
+  if (Ar.IsLoading() && ((c.h < 0) || (c.h >= N_CHARACTERS)))
+    Ar.SetError();
+  return Ar;
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "CoreMinimal.h"
 #include "Button.h"
 #include "Hitbox.h"
+#include "FrameScale.h"
 #include <optional>
 #include <map>
+#include <vector>
 
 UENUM(BlueprintType)
 enum EAnimation {
@@ -96,18 +99,24 @@ public:
 };
 
 class HCharacter;
+class ActionTables;
 
-// handle to an action because references and pointers are bad
+// handle to an action because references and pointers are bad. The
+// same action has different frame data at every rate, so a handle is
+// only usable once ActionTables::bind() has tied it to the tables of
+// one rate. Handles made from an IAction aren't; the ones that the
+// tables and a FightSimulation give out are.
 class HAction {
 private:
   int h;
   #define N_ACTIONS 128
-  static Action actions[N_ACTIONS];
+  const ActionTables* tables;
+  const Action& data() const;
+  friend class ActionTables;
 
 public:
-  HAction(int h): h(h) {};
+  HAction(int h): h(h), tables(nullptr) {};
   HAction(): HAction(-1) {};
-  static void init();
 
   HCharacter character() const;
   enum EAnimation animation() const;
@@ -128,9 +137,16 @@ public:
   float pushbackDistance() const;
   bool hitsWalkingBack() const;
   const std::map<enum Button, HAction>& chains() const;
+  // the tables of the rate that this action runs at
+  const ActionTables& getTables() const;
 
+  // compare the actions, whatever tables they are bound to
   bool operator==(const HAction& b) const;
   bool operator!=(const HAction& b) const;
+
+  // For snapshots (see FightSimulation::serializeSnapshot()). Only the
+  // action is saved; a loaded handle keeps the tables it had.
+  friend FArchive& operator<<(FArchive& Ar, HAction& a);
 };
 
 // this is to assign integers to action names, needed for the next
@@ -230,16 +246,18 @@ public:
   Character(): Character("", Hitbox({Box(0, 0, 0, 0)}), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), HAction(), {}) {};
 };
 
+// handle to a character, bound like HAction
 class HCharacter {
 private:
   int h;
   #define N_CHARACTERS 8
-  static Character characters[N_CHARACTERS];
+  const ActionTables* tables;
+  const Character& data() const;
+  friend class ActionTables;
 
 public:
-  HCharacter(int h): h(h) {};
-  HCharacter(): h(0) {};
-  static void init();
+  HCharacter(int h): h(h), tables(nullptr) {};
+  HCharacter(): HCharacter(0) {};
   const char* name() const;
   const Hitbox& collision() const;
   HAction idle() const;
@@ -260,6 +278,8 @@ public:
 
   bool operator==(const HCharacter& b) const;
   bool operator!=(const HCharacter& b) const;
+
+  friend FArchive& operator<<(FArchive& Ar, HCharacter& c);
 };
 
 enum ICharacter {
@@ -270,18 +290,53 @@ enum ICharacter {
 #define HChar1 (HCharacter(IChar1))
 #define HCharGR (HCharacter(ICharGR))
 
-// This function needs to be called early in the game startup to
-// populate the actions and character arrays
-extern void init_actions();
-
 const int knockdownAirborneLength = 10;
-extern float knockdownAirborneHeights[knockdownAirborneLength];
+extern const float knockdownAirborneHeights[knockdownAirborneLength];
 
 #define JUMP_LENGTH 22
-extern float jumpHeights[JUMP_LENGTH];
+extern const float jumpHeights[JUMP_LENGTH];
 #define THROWN_BOXER_LENGTH 11
-extern FVector thrownBoxerPositions[THROWN_BOXER_LENGTH+1];
+extern const FVector thrownBoxerPositions[THROWN_BOXER_LENGTH+1];
 #define THROWN_GR_LENGTH 11
-extern FVector thrownGRPositions[THROWN_GR_LENGTH+1];
+extern const FVector thrownGRPositions[THROWN_GR_LENGTH+1];
+
+// The actions and characters at one framerate. The frame data is
+// written in frames of BASE_FRAMERATE and scaled to the rate when the
+// tables are built. They are built once for each rate and never
+// changed or freed afterwards, so that any number of simulations on
+// any threads, at any rates, can share them.
+class ActionTables {
+private:
+  std::vector<Action> actions;
+  std::vector<Character> characters;
+  friend class HAction;
+  friend class HCharacter;
+
+  ActionTables(int framerate);
+
+public:
+  const FrameScale scale;
+
+  // the tables of `framerate', built on first use
+  static const ActionTables& forRate(int framerate);
+
+  // `a' or `c' tied to these tables
+  HAction bind(HAction a) const;
+  HCharacter bind(HCharacter c) const;
+
+  // The tables above are indexed by base frames. These look them up
+  // at frame `frame' of our rate, interpolating between entries.
+  float jumpHeight(int frame) const;
+  float knockdownAirborneHeight(int frame) const;
+  // how long a knockdown is airborne, in frames of our rate
+  int knockdownAirborneFrames() const;
+  FVector thrownBoxerPosition(int frame) const;
+};
+
+// How often the lookups of ActionTables went past either end of their
+// table on this thread since the last call. They return the end of the
+// table then, but every one is a frame that the table doesn't cover,
+// so the fuzzer counts them as bugs.
+extern int takeOutOfRangeSamples();
 
-extern std::map<enum Button, std::vector<std::vector<enum Button>>> motionCommands;
+extern const std::map<enum Button, std::vector<std::vector<enum Button>>> motionCommands;
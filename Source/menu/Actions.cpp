@@ -1,14 +1,19 @@
 #include <utility>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <memory>
 #include "Action.h"
-
-Action HAction::actions[N_ACTIONS];
-Character HCharacter::characters[N_CHARACTERS];
+#include "HAL/CriticalSection.h"
+#include "Misc/ScopeLock.h"
 
 const float jumpXVel = 2.3;
 
 const float boxerPushback = 7.0;
 
-void HAction::init() {
+static std::vector<Action> makeActions() {
+  std::vector<Action> actions(N_ACTIONS);
+
   actions[IActionIdle]
     = Action(IChar1,
              EAnimation::Idle,
@@ -48,9 +53,9 @@ void HAction::init() {
              0,
              0,
              0,
-             HActionWalkForward.animationLength(),
+             actions[IActionWalkForward].animationLength,
              ActionType::Walk,
-             (-2.0/3.0)*HActionWalkForward.velocity());
+             (-2.0/3.0)*actions[IActionWalkForward].velocity);
 
   actions[IActionDamaged]
     = Action(IChar1,
@@ -277,13 +282,13 @@ void HAction::init() {
                                         Box(-13.0, 25.0, 0.0, 36.0)})}),
              10, // damage
              -10, // blockAdvantage
-             HActionStHP.hitAdvantage()+1, // hitAdvantage
+             actions[IActionStHP].hitAdvantage+1, // hitAdvantage
              11, // lockedFrames (number of frames before player can cancel)
              13, // animationLength
              ActionType::Other, // ActionType
              FVector(0, 0, 0), // velocity
              5,
-             HActionStHP.chains(), // chains
+             actions[IActionStHP].chains, // chains
              -1.0,
              boxerPushback,
              true
@@ -472,9 +477,44 @@ void HAction::init() {
              150, // animationLength
              ActionType::KD
              );
+  return actions;
+}
+
+// the window ends are inclusive, see Hitbox::at()
+static void scaleHitbox(Hitbox& h, const FrameScale& s) {
+  const Hitbox base = h;
+  for (auto& b : h.boxes) {
+    if (b.first != std::numeric_limits<int>::max())
+      b.first = s.lastFrame(b.first);
+  }
+  // at a multiple of the base rate every window lasts exactly that
+  // many times as long
+  if ((s.getFramerate() % BASE_FRAMERATE) == 0) {
+    const int k = s.getFramerate() / BASE_FRAMERATE;
+    for (size_t i = 0; (i < h.boxes.size()) && (h.boxes[i].first != std::numeric_limits<int>::max()); ++i) {
+      const int start = (i == 0) ? -1 : h.boxes[i-1].first;
+      const int baseStart = (i == 0) ? -1 : base.boxes[i-1].first;
+      check((h.boxes[i].first - start) == k * (base.boxes[i].first - baseStart));
+    }
+  }
 }
 
-void HCharacter::init() {
+static void scaleAction(Action& a, const FrameScale& s) {
+  if (a.collision.has_value())
+    scaleHitbox(a.collision.value(), s);
+  scaleHitbox(a.hitbox, s);
+  scaleHitbox(a.hurtbox, s);
+  a.blockAdvantage = s.frames(a.blockAdvantage);
+  a.hitAdvantage = s.frames(a.hitAdvantage);
+  a.lockedFrames = s.frames(a.lockedFrames);
+  a.animationLength = s.frames(a.animationLength);
+  a.specialCancelFrames = s.frames(a.specialCancelFrames);
+  a.velocity = s.perFrame(1.0) * a.velocity;
+}
+
+static std::vector<Character> makeCharacters() {
+  std::vector<Character> characters(N_CHARACTERS);
+
   characters[IChar1]
     = Character("Boxer",
                 Hitbox({Box::make_centeredx(22.0, 34.0)}),
@@ -512,6 +552,7 @@ void HCharacter::init() {
                 HActionGRKD,
                 HActionGRDefeat,
                 {});
+  return characters;
 }
 
 // set xrange [0:22]
@@ -542,7 +583,7 @@ void HCharacter::init() {
 // print f(21)
 // print f(22)
 
-float jumpHeights[JUMP_LENGTH] = {
+const float jumpHeights[JUMP_LENGTH] = {
   0.0,
   2.48685199098422,
   4.5229151014275,
@@ -567,7 +608,7 @@ float jumpHeights[JUMP_LENGTH] = {
   0.0
 };
 
-float knockdownAirborneHeights[knockdownAirborneLength] = {
+const float knockdownAirborneHeights[knockdownAirborneLength] = {
   22.0*0.8,
   22.0*0.8,
   22.0*0.8,
@@ -580,7 +621,7 @@ float knockdownAirborneHeights[knockdownAirborneLength] = {
   0.0
 };
 
-FVector thrownBoxerPositions[THROWN_BOXER_LENGTH+1] = {
+const FVector thrownBoxerPositions[THROWN_BOXER_LENGTH+1] = {
   FVector(0.0, 0.0, 0.0),
   FVector(0.0, 22.0, 0.0),
   FVector(0.0, 18.0, 0.0),
@@ -597,13 +638,82 @@ FVector thrownBoxerPositions[THROWN_BOXER_LENGTH+1] = {
 
 // FVector thrownGRPositions[THROWN_GR_LENGTH];
 
-std::map<enum Button, std::vector<std::vector<enum Button>>> motionCommands;
+const std::map<enum Button, std::vector<std::vector<enum Button>>> motionCommands = {
+  // two ways to input QCFP
+  {Button::QCFP, {{Button::DOWN, Button::DOWNFORWARD, Button::FORWARD, Button::HP},
+                  {Button::DOWN, Button::FORWARD, Button::HP}}}
+};
 
-void init_actions() {
-  HAction::init();
-  HCharacter::init();
+ActionTables::ActionTables(int framerate): actions(makeActions()), characters(makeCharacters()), scale(framerate) {
+  for (auto& a : actions) {
+    scaleAction(a, scale);
+    for (auto& chain : a.chains)
+      chain.second = bind(chain.second);
+  }
+  for (auto& c : characters) {
+    scaleHitbox(c.collision, scale);
+    for (HAction* a : {&c.idle, &c.walkForward, &c.walkBackward, &c.fJump, &c.damaged, &c.block, &c.sthp, &c.stlp, &c.grab, &c.throw_, &c.thrown, &c.thrownGR, &c.kd, &c.defeat})
+      *a = bind(*a);
+    for (auto& special : c.specials)
+      special.second = bind(special.second);
+  }
+}
 
-  // two ways to input QCFP
-  motionCommands[Button::QCFP] = {{Button::DOWN, Button::DOWNFORWARD, Button::FORWARD, Button::HP},
-                                  {Button::DOWN, Button::FORWARD, Button::HP}};
+const ActionTables& ActionTables::forRate(int framerate) {
+  static FCriticalSection lock;
+  static std::unique_ptr<const ActionTables> tables[MAX_FRAMERATE+1];
+  framerate = std::clamp(framerate, 1, MAX_FRAMERATE);
+  FScopeLock l(&lock);
+  if (!tables[framerate])
+    tables[framerate].reset(new ActionTables(framerate));
+  return *tables[framerate];
+}
+
+HAction ActionTables::bind(HAction a) const {
+  a.tables = this;
+  return a;
+}
+
+HCharacter ActionTables::bind(HCharacter c) const {
+  c.tables = this;
+  return c;
+}
+
+static thread_local int outOfRangeSamples = 0;
+
+// linear interpolation in a table indexed by base frames, at frame
+// `frame' of the rate of `s'
+template <class T>
+static T sampleTable(const T* table, int length, const FrameScale& s, int frame) {
+  const float base = s.toBase(frame);
+  // at higher rates the frames within the last base frame are fine
+  if ((base < 0.0f) || (base >= (float) length))
+    ++outOfRangeSamples;
+  const float t = std::clamp(base, 0.0f, (float) (length-1));
+  const int i = (int) t;
+  if (i+1 >= length)
+    return table[length-1];
+  return table[i] + (t - i) * (table[i+1] - table[i]);
+}
+
+float ActionTables::jumpHeight(int frame) const {
+  return sampleTable(jumpHeights, JUMP_LENGTH, scale, frame);
+}
+
+float ActionTables::knockdownAirborneHeight(int frame) const {
+  return sampleTable(knockdownAirborneHeights, knockdownAirborneLength, scale, frame);
+}
+
+int ActionTables::knockdownAirborneFrames() const {
+  return scale.frames(knockdownAirborneLength);
+}
+
+FVector ActionTables::thrownBoxerPosition(int frame) const {
+  return sampleTable(thrownBoxerPositions, THROWN_BOXER_LENGTH+1, scale, frame);
+}
+
+int takeOutOfRangeSamples() {
+  const int n = outOfRangeSamples;
+  outOfRangeSamples = 0;
+  return n;
 }
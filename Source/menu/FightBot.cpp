@@ -0,0 +1,201 @@
+#include "FightBot.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "InputPacket.h"
+#include "FightLog.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// score of winning or losing the round within a rollout, and of every
+// unit of distance to the opponent. Closing in only breaks ties
+// between tactics that don't hit.
+#define BOT_ROUND_SCORE 1000.0
+#define BOT_DISTANCE_WEIGHT 0.001
+
+// what the bot guesses the opponent might do, most likely first, so
+// that a small budget still covers the likely cases
+static const BotTactic opponentGuesses[] = {
+  BotTactic::Repeat,
+  BotTactic::Idle,
+  BotTactic::WalkBack,
+  BotTactic::StLP
+};
+static const int nOpponentGuesses = sizeof(opponentGuesses) / sizeof(opponentGuesses[0]);
+static const int nTactics = (int) BotTactic::Count;
+
+static uint8 bit(enum Button b) {
+  return 1 << (int) b;
+}
+
+FightBotRollout::FightBotRollout(const FightConfig& _config, int delay) {
+  FightConfig c = _config;
+  c.alwaysRollback = false;
+  p1Input.init(c.maxRollback, c.inputBuffer, delay, c.framerate);
+  p2Input.init(c.maxRollback, c.inputBuffer, delay, c.framerate);
+  init(c, &p1Input, &p2Input);
+}
+
+bool FightBotRollout::load(const TArray<uint8>& snapshot) {
+  FMemoryReader r(snapshot);
+  serializeSnapshot(r);
+  return !r.IsError();
+}
+
+float FightBotRollout::run(BotTactic botTactic, BotTactic opponentTactic, int botPlayer, int horizon) {
+  // these frames never happen, so keep them out of the log like
+  // resimulated ones
+  FightLog::ResimulationScope quiet(true);
+  InputHistory& botInput = (botPlayer == 0) ? p1Input : p2Input;
+  InputHistory& opponentInput = (botPlayer == 0) ? p2Input : p1Input;
+  const uint8 opponentLastInput = opponentInput.getPackedInput(opponentInput.getLastInputFrame());
+  const int botHealth = (botPlayer == 0) ? frames.last().p1.health : frames.last().p2.health;
+  const int opponentHealth = (botPlayer == 0) ? frames.last().p2.health : frames.last().p1.health;
+
+  // The snapshot has the real inputs of either side up to its last
+  // input frame, which may be past ours, so each side's tactic starts
+  // right after those
+  const int botStart = botInput.getLastInputFrame()+1;
+  const int opponentStart = opponentInput.getLastInputFrame()+1;
+  const int startFrame = frame+1;
+  while (((frame - startFrame + 1) < horizon) && (mode == LogicMode::Fight)) {
+    const int targetFrame = frame+1;
+    const Frame& f = frames.last();
+    const bool botOnLeft = (botPlayer == 0) ? IsPlayerOnLeft(f.p1, f.p2) : IsPlayerOnLeft(f.p2, f.p1);
+    if (targetFrame >= botStart)
+      botInput.packedButtons(FightBot::tacticInput(botTactic, targetFrame - botStart, botOnLeft, 0, scale), targetFrame);
+    if (targetFrame >= opponentStart)
+      opponentInput.packedButtons(FightBot::tacticInput(opponentTactic, targetFrame - opponentStart, !botOnLeft, opponentLastInput, scale), targetFrame);
+    if (!simulate(targetFrame))
+      break;
+  }
+
+  const Frame& f = frames.last();
+  const Player& b = (botPlayer == 0) ? f.p1 : f.p2;
+  const Player& o = (botPlayer == 0) ? f.p2 : f.p1;
+  float score = (opponentHealth - o.health) - (botHealth - b.health);
+  // endRound() or endFight() left Fight mode
+  if (mode != LogicMode::Fight) {
+    const int winner = roundWinner();
+    if (winner == botPlayer)
+      score += BOT_ROUND_SCORE;
+    else if (winner != 2)
+      score -= BOT_ROUND_SCORE;
+  }
+  score -= BOT_DISTANCE_WEIGHT * std::abs(b.pos.Y - o.pos.Y);
+  return score;
+}
+
+FightBot::FightBot(const FightConfig& _config, int delay, int _player, float budgetMs): player(_player), scale(_config.framerate), tactic(BotTactic::Idle), tacticStart(-1), lastRollouts(0) {
+  decisionFrames = scale.frames(BOT_DECISION_FRAMES);
+  horizonFrames = scale.frames(BOT_HORIZON_FRAMES);
+  setBudget(budgetMs);
+  for (int i = 0; i < nTactics*nOpponentGuesses; ++i)
+    rollouts.emplace_back(new FightBotRollout(_config, delay));
+}
+
+void FightBot::setBudget(float ms) {
+  budgetSeconds = std::max(ms, 0.0f) / 1000.0;
+}
+
+int FightBot::getLastRollouts() const {
+  return lastRollouts;
+}
+
+BotTactic FightBot::getTactic() const {
+  return tactic;
+}
+
+uint8 FightBot::nextInput(FightSimulation& live) {
+  const int targetFrame = live.getFrame()+1;
+  if (live.getMode() != LogicMode::Fight) {
+    tacticStart = -1;
+    return 0;
+  }
+  if ((tacticStart < 0) || ((targetFrame - tacticStart) >= decisionFrames))
+    decide(live, targetFrame);
+  const Frame& f = live.latestFrame();
+  const bool isOnLeft = (player == 0) ? (f.p1.pos.Y <= f.p2.pos.Y) : (f.p2.pos.Y <= f.p1.pos.Y);
+  return tacticInput(tactic, targetFrame - tacticStart, isOnLeft, 0, scale);
+}
+
+void FightBot::decide(FightSimulation& live, int targetFrame) {
+  const double deadline = FPlatformTime::Seconds() + budgetSeconds;
+  snapshot.Reset();
+  FMemoryWriter w(snapshot);
+  live.serializeSnapshot(w);
+
+  // one byte per rollout since std::vector<bool> can't be written
+  // from several threads
+  std::vector<float> scores(rollouts.size(), 0.0);
+  std::vector<uint8> done(rollouts.size(), 0);
+  ParallelFor((int32) rollouts.size(), [&](int32 i) {
+    if (FPlatformTime::Seconds() > deadline)
+      return;
+    FightBotRollout& r = *rollouts[i];
+    if (!r.load(snapshot))
+      return;
+    scores[i] = r.run((BotTactic) (i % nTactics), opponentGuesses[i / nTactics], player, horizonFrames);
+    done[i] = 1;
+  });
+
+  // the tactic with the best average over the guesses that made it,
+  // the first one on ties
+  lastRollouts = 0;
+  float best = -std::numeric_limits<float>::max();
+  tactic = BotTactic::Idle;
+  for (int t = 0; t < nTactics; ++t) {
+    float sum = 0.0;
+    int n = 0;
+    for (int g = 0; g < nOpponentGuesses; ++g) {
+      if (done[g*nTactics + t]) {
+        sum += scores[g*nTactics + t];
+        ++n;
+      }
+    }
+    lastRollouts += n;
+    if ((n > 0) && ((sum / n) > best)) {
+      best = sum / n;
+      tactic = (BotTactic) t;
+    }
+  }
+  tacticStart = targetFrame;
+}
+
+uint8 FightBot::tacticInput(BotTactic t, int step, bool isOnLeft, uint8 lastInput, const FrameScale& scale) {
+  const uint8 forward = bit(isOnLeft ? Button::RIGHT : Button::LEFT);
+  const uint8 back = bit(isOnLeft ? Button::LEFT : Button::RIGHT);
+  // motions are written in base frames like the rest of the frame data
+  const int base = (int) scale.toBase(step);
+  const bool firstOfBase = (step == 0) || (((int) scale.toBase(step-1)) != base);
+  switch (t) {
+  case BotTactic::Idle:
+    return 0;
+  case BotTactic::WalkForward:
+    return forward;
+  case BotTactic::WalkBack:
+    return back;
+  case BotTactic::Jump:
+    return bit(Button::UP) | forward;
+  // attack buttons are only set on the frame they are pressed
+  case BotTactic::StLP:
+    return (step == 0) ? bit(Button::LP) : 0;
+  case BotTactic::StHP:
+    return (step == 0) ? bit(Button::HP) : 0;
+  case BotTactic::Grab:
+    return (step == 0) ? bit(Button::LK) : 0;
+  case BotTactic::QCFP:
+    // down, down-forward, forward and punch
+    switch (base) {
+    case 0: return bit(Button::DOWN);
+    case 1: return bit(Button::DOWN) | forward;
+    case 2: return forward | (firstOfBase ? bit(Button::HP) : 0);
+    default: return 0;
+    }
+  case BotTactic::Repeat:
+    return lastInput & InputPacket::directionBits;
+  }
+  return 0;
+}
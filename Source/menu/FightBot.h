@@ -0,0 +1,96 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FightSimulation.h"
+#include "InputHistory.h"
+#include <memory>
+#include <vector>
+
+// frames between the bot's decisions, how far ahead each decision
+// looks, and the default time it may think per decision. The frames
+// are base frames (see FrameScale).
+#define BOT_DECISION_FRAMES 4
+#define BOT_HORIZON_FRAMES 20
+#define BOT_BUDGET_MS 4.0
+
+// What the bot, or the opponent in the bot's guess, does for the next
+// few frames. Directions are relative to the player's side.
+enum class BotTactic : uint8 {
+  Idle,
+  WalkForward,
+  WalkBack, // which also blocks
+  Jump,
+  StLP,
+  StHP,
+  Grab,
+  QCFP,
+  Count,
+  // only for the opponent: keep holding the directions of their last
+  // input
+  Repeat = Count
+};
+
+// A copy of the fight that plays one tactic for each player from a
+// forked state and scores the outcome for the bot.
+class FightBotRollout : public FightSimulation {
+public:
+  FightBotRollout(const FightConfig& _config, int delay);
+
+  // Start from a snapshot of the live fight, see serializeSnapshot().
+  // Returns false if it could not be loaded.
+  bool load(const TArray<uint8>& snapshot);
+  // Play `frames' frames and return how much better the bot's
+  // position got: the health it took minus the health it lost, a big
+  // bonus or penalty if the round ends, and a little for closing in.
+  // The inputs in the snapshot are kept; each player's tactic starts
+  // on the frame after their last one.
+  float run(BotTactic botTactic, BotTactic opponentTactic, int botPlayer, int frames);
+
+private:
+  InputHistory p1Input;
+  InputHistory p2Input;
+};
+
+// A CPU opponent for offline play. Every BOT_DECISION_FRAMES it forks
+// the live fight and plays every tactic against a few guesses of what
+// the opponent does, BOT_HORIZON_FRAMES ahead, and then sticks to the
+// tactic that did best on average until the next decision.
+//
+// The rollouts run with ParallelFor within a time budget. Whatever
+// doesn't start before the budget runs out is left out of the
+// decision, so the bot plays better on machines with more cores.
+class FightBot {
+private:
+  int player; // 0 or 1
+  FrameScale scale;
+  int decisionFrames;
+  int horizonFrames;
+  double budgetSeconds;
+
+  // one per tactic and opponent guess, guess major
+  std::vector<std::unique_ptr<FightBotRollout>> rollouts;
+  TArray<uint8> snapshot;
+
+  BotTactic tactic;
+  int tacticStart; // frame that the tactic started on, -1 for none
+
+  // rollouts that made it into the last decision
+  int lastRollouts;
+
+  void decide(FightSimulation& live, int targetFrame);
+
+public:
+  // `_config' and `delay' must be the ones of the live fight
+  FightBot(const FightConfig& _config, int delay, int _player, float budgetMs = BOT_BUDGET_MS);
+
+  // The packed input (see InputPacket) of the bot's player for the
+  // frame after live's current one. Call it once per frame.
+  uint8 nextInput(FightSimulation& live);
+
+  void setBudget(float ms);
+  int getLastRollouts() const;
+  BotTactic getTactic() const;
+
+  // the packed input of `step' frames into a tactic
+  static uint8 tacticInput(BotTactic t, int step, bool isOnLeft, uint8 lastInput, const FrameScale& scale);
+};
@@ -0,0 +1,164 @@
+#include "FightConcurrencyCommandlet.h"
+#include "FightFuzzer.h"
+#include "FightMatchPool.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Parse.h"
+#include "FightLog.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFight, category, TEXT("FightConcurrency " message), ##__VA_ARGS__)
+
+// rate of every other case, and of the pool
+#define CONCURRENCY_FRAMERATE 30
+#define CONCURRENCY_FAST_FRAMERATE 60
+
+static int caseFramerate(int i) {
+  return ((i % 2) == 0) ? CONCURRENCY_FRAMERATE : CONCURRENCY_FAST_FRAMERATE;
+}
+
+// Play `c' on a FightMatch of our own, one frame per tick with the time
+// made up and both inputs on time, until the last frame of the case is
+// confirmed or the fight is over
+static MatchStats play(int id, const FuzzCase& c, const FightConfig& config) {
+  FightLog::ResimulationScope quiet(true);
+  FightMatch m(id, config, HCharacter(c.p1Char), HCharacter(c.p2Char), c.delay, config.framerate);
+  const int n = c.frames();
+  const double frameTime = 1.0 / config.framerate;
+  int next = 1; // next frame of input to submit
+  for (int tick = 0; (tick < 4*n) && !m.isFinished() && (m.getStats(0).confirmedFrame < n); ++tick) {
+    for (; (next <= n) && (next <= m.getFrame()+1); ++next) {
+      m.submitInput({0, next, c.p1[next]});
+      m.submitInput({1, next, c.p2[next]});
+    }
+    m.tick(tick * frameTime);
+  }
+  return m.getStats(0);
+}
+
+static bool sameResult(const MatchStats& a, const MatchStats& b) {
+  return (a.confirmedFrame == b.confirmedFrame) && (a.confirmedChecksum == b.confirmedChecksum) &&
+    (a.p1Wins == b.p1Wins) && (a.p2Wins == b.p2Wins);
+}
+
+// Play `cases' on a pool and compare every match with `expected' once
+// it confirmed as far. Returns the number of matches that differed or
+// didn't get there.
+static int playOnPool(const std::vector<FuzzCase>& cases, const std::vector<MatchStats>& expected, const FightConfig& config, int threads) {
+  FightMatchPool pool(threads, config.framerate);
+  const int n = cases.size();
+  std::vector<int> ids(n);
+  std::vector<int> next(n, 1);
+  std::vector<uint8> done(n, 0);
+  for (int i = 0; i < n; ++i)
+    ids[i] = pool.createMatch(config, cases[i].p1Char, cases[i].p2Char, cases[i].delay);
+  MYLOG(Display, "%i matches on %i workers", n, pool.getWorkerCount());
+
+  int failures = 0;
+  int left = n;
+  int longest = 0;
+  for (auto& c : cases)
+    longest = std::max(longest, c.frames());
+  const double deadline = FPlatformTime::Seconds() + ((double) longest) / config.framerate + config.disconnectTimeout;
+  while ((left > 0) && (FPlatformTime::Seconds() < deadline)) {
+    std::unordered_map<int, MatchStats> stats;
+    for (auto& s : pool.getStats())
+      stats[s.id] = s;
+    for (int i = 0; i < n; ++i) {
+      if (done[i])
+        continue;
+      auto it = stats.find(ids[i]);
+      if (it == stats.end())
+        continue;
+      const FuzzCase& c = cases[i];
+      const MatchStats& s = it->second;
+      // no further ahead than the input history takes
+      for (; (next[i] <= c.frames()) && (next[i] <= s.frame + config.inputBuffer + 1); ++next[i]) {
+        pool.submitInput(ids[i], {0, next[i], c.p1[next[i]]});
+        pool.submitInput(ids[i], {1, next[i], c.p2[next[i]]});
+      }
+      if ((s.confirmedFrame >= expected[i].confirmedFrame) || s.finished) {
+        done[i] = 1;
+        --left;
+        if (!sameResult(s, expected[i])) {
+          ++failures;
+          MYLOG(Warning, "seed %llu on the pool: frame %i checksum %08x, alone: frame %i checksum %08x", (unsigned long long) c.seed, s.confirmedFrame, s.confirmedChecksum, expected[i].confirmedFrame, expected[i].confirmedChecksum);
+        }
+      }
+    }
+    FPlatformProcess::Sleep(0.001);
+  }
+  if (left > 0)
+    MYLOG(Warning, "%i matches on the pool didn't get as far as alone", left);
+  return failures + left;
+}
+
+UFightConcurrencyCommandlet::UFightConcurrencyCommandlet() {
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UFightConcurrencyCommandlet::Main(const FString& Params) {
+  int matches = 64;
+  uint64 seed = 1;
+  int frames = FUZZ_FRAMES;
+  int poolFrames = 300;
+  int threads = 0;
+  FParse::Value(*Params, TEXT("matches="), matches);
+  FParse::Value(*Params, TEXT("seed="), seed);
+  FParse::Value(*Params, TEXT("frames="), frames);
+  FParse::Value(*Params, TEXT("poolframes="), poolFrames);
+  FParse::Value(*Params, TEXT("threads="), threads);
+  matches = std::max(matches, 1);
+  seed = std::max(seed, (uint64) 1);
+  frames = std::max(frames, 1);
+  poolFrames = std::clamp(poolFrames, 1, frames);
+
+  std::vector<FuzzCase> cases;
+  for (int i = 0; i < matches; ++i)
+    cases.push_back(FuzzCase::random(seed + i, frames, FightFuzzer::config(caseFramerate(i))));
+
+  // every match alone, then all at once
+  double start = FPlatformTime::Seconds();
+  std::vector<MatchStats> sequential;
+  for (int i = 0; i < matches; ++i)
+    sequential.push_back(play(i, cases[i], FightFuzzer::config(caseFramerate(i))));
+  MYLOG(Display, "%i matches of %i frames one after the other in %.1f s", matches, frames, FPlatformTime::Seconds() - start);
+  start = FPlatformTime::Seconds();
+  std::vector<MatchStats> parallel(matches);
+  ParallelFor(matches, [&](int32 i) {
+    parallel[i] = play(i, cases[i], FightFuzzer::config(caseFramerate(i)));
+  });
+  MYLOG(Display, "%i matches of %i frames at once in %.1f s", matches, frames, FPlatformTime::Seconds() - start);
+
+  int failures = 0;
+  for (int i = 0; i < matches; ++i) {
+    if (!sameResult(sequential[i], parallel[i])) {
+      ++failures;
+      MYLOG(Warning, "seed %llu at %i frames per second: frame %i checksum %08x at once, frame %i checksum %08x alone", (unsigned long long) cases[i].seed, caseFramerate(i),
+            parallel[i].confirmedFrame, parallel[i].confirmedChecksum, sequential[i].confirmedFrame, sequential[i].confirmedChecksum);
+    }
+  }
+
+  // the start of the cases of the pool's rate on the pool
+  const FightConfig poolConfig = FightFuzzer::config(CONCURRENCY_FRAMERATE);
+  std::vector<FuzzCase> poolCases;
+  std::vector<MatchStats> poolExpected;
+  for (int i = 0; i < matches; ++i) {
+    if (caseFramerate(i) == CONCURRENCY_FRAMERATE) {
+      FuzzCase c = cases[i];
+      c.truncate(poolFrames);
+      poolExpected.push_back(play(i, c, poolConfig));
+      poolCases.push_back(c);
+    }
+  }
+  failures += playOnPool(poolCases, poolExpected, poolConfig, threads);
+
+  MYLOG(Display, "%i of %i matches differed", failures, matches + (int) poolCases.size());
+  return failures;
+}
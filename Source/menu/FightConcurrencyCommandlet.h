@@ -0,0 +1,32 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FightConcurrencyCommandlet.generated.h"
+
+// Checks that matches give the same results however many run at once
+// and on whichever threads:
+//
+//   UnrealEditor-Cmd <project> -run=FightConcurrency -matches=64
+//     -seed=1 -frames=3000 -poolframes=300 -threads=0
+//
+// plays the fuzz cases (see FuzzCase) of seeds seed..seed+matches-1,
+// at 30 and 60 frames per second in turn, one after the other and
+// then all at once with ParallelFor, and compares the checksums of
+// the last confirmed frames. Then it plays the first -poolframes
+// frames of the 30 frames per second cases again on a FightMatchPool
+// of -threads workers, feeding the inputs in with submitInput() as the
+// matches go, and compares them the same way. The pool runs in real
+// time, so that part takes up to -poolframes/30 seconds.
+//
+// Returns the number of matches that differed.
+UCLASS()
+class MENU_API UFightConcurrencyCommandlet : public UCommandlet
+{
+  GENERATED_BODY()
+
+public:
+  UFightConcurrencyCommandlet();
+
+  virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FightEvent.generated.h"
+
+UENUM(BlueprintType)
+enum class EFightEvent : uint8 {
+  Hit,
+  Block,
+  // a grab connected; the player is the one that is thrown
+  Throw,
+  Knockdown,
+  // a KO or a time out; the player is the winner, 2 for a draw
+  RoundEnd
+};
+
+// Something that happened on a frame that effects and sounds react
+// to. computeFrame() stores them in the Frame, so a rollback throws
+// them away with it and a resimulation adds them again. The owner
+// only hears about the difference, see FightSimulation::onFightEvent().
+USTRUCT(BlueprintType)
+struct FFightEvent {
+  GENERATED_BODY()
+
+  UPROPERTY(BlueprintReadOnly, Category="Fight Event")
+  EFightEvent type = EFightEvent::Hit;
+  // the player it happened to, 0 or 1
+  UPROPERTY(BlueprintReadOnly, Category="Fight Event")
+  int32 player = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Fight Event")
+  int32 frame = 0;
+  // position of the player on that frame
+  UPROPERTY(BlueprintReadOnly, Category="Fight Event")
+  FVector location = FVector(0, 0, 0);
+  UPROPERTY(BlueprintReadOnly, Category="Fight Event")
+  int32 damage = 0;
+
+  // Two events are the same if they are the same thing on the same
+  // frame, even if a resimulation moved the player a bit; we don't
+  // want to respawn an effect for that.
+  bool operator==(const FFightEvent& e) const {
+    return (type == e.type) && (player == e.player) && (frame == e.frame);
+  }
+};
+
+FArchive& operator<<(FArchive& Ar, FFightEvent& e);
@@ -0,0 +1,102 @@
+#include "FightFuzzCommandlet.h"
+#include "FightFuzzer.h"
+#include "Action.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "FightLog.h"
+#include <algorithm>
+#include <atomic>
+
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFight, category, TEXT("FightFuzz " message), ##__VA_ARGS__)
+
+// cases per ParallelFor, and so the most that can be in flight
+#define FUZZ_BATCH 4096
+
+// seed of the case running in every slot of the batch, 0 for none.
+// Seeds start at 1.
+static std::atomic<uint64> inFlight[FUZZ_BATCH];
+
+// called on a check() failure or a crash, right before the process
+// goes down
+static void writeInFlight() {
+  FString s;
+  for (int i = 0; i < FUZZ_BATCH; ++i) {
+    const uint64 seed = inFlight[i].load();
+    if (seed != 0)
+      s.Append(FString::Printf(TEXT("%llu\n"), (unsigned long long) seed));
+  }
+  FFileHelper::SaveStringToFile(s, *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Fuzz"), TEXT("in-flight.txt")));
+}
+
+static int replay(const FString& fileName, const FightConfig& config) {
+  FString s;
+  FuzzCase c;
+  if (!FFileHelper::LoadFileToString(s, *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Fuzz"), fileName)) || !c.fromCsv(s)) {
+    MYLOG(Error, "could not read Saved/Fuzz/%s", *fileName);
+    return 1;
+  }
+  const FuzzResult r = FightFuzzer::run(c, config);
+  MYLOG(Display, "%s: %s on frame %i", *fileName, FightFuzzer::failureName(r.failure), r.frame);
+  return (r.failure == FuzzFailure::None) ? 0 : 1;
+}
+
+UFightFuzzCommandlet::UFightFuzzCommandlet() {
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UFightFuzzCommandlet::Main(const FString& Params) {
+  int matches = 10000;
+  uint64 seed = 1;
+  int frames = FUZZ_FRAMES;
+  int framerate = BASE_FRAMERATE;
+  FString replayFile;
+  FParse::Value(*Params, TEXT("matches="), matches);
+  FParse::Value(*Params, TEXT("seed="), seed);
+  FParse::Value(*Params, TEXT("frames="), frames);
+  FParse::Value(*Params, TEXT("framerate="), framerate);
+  if ((framerate < 1) || (framerate > MAX_FRAMERATE)) {
+    MYLOG(Warning, "framerate %i is out of range, using %i", framerate, BASE_FRAMERATE);
+    framerate = BASE_FRAMERATE;
+  }
+  seed = std::max(seed, (uint64) 1);
+  frames = std::max(frames, 1);
+
+  const FightConfig config = FightFuzzer::config(framerate);
+  if (FParse::Value(*Params, TEXT("replay="), replayFile))
+    return replay(replayFile, config);
+
+  for (auto& s : inFlight)
+    s.store(0);
+  FDelegateHandle onError = FCoreDelegates::OnHandleSystemError.AddStatic(&writeInFlight);
+  MYLOG(Display, "%i matches of %i frames at %i frames per second from seed %llu", matches, frames, framerate, (unsigned long long) seed);
+
+  std::atomic<int> failures(0);
+  const double start = FPlatformTime::Seconds();
+  for (int first = 0; first < matches; first += FUZZ_BATCH) {
+    ParallelFor(std::min(FUZZ_BATCH, matches - first), [&](int32 i) {
+      const uint64 s = seed + first + i;
+      inFlight[i].store(s);
+      const FuzzCase c = FuzzCase::random(s, frames, config);
+      const FuzzResult r = FightFuzzer::run(c, config);
+      if (r.failure != FuzzFailure::None) {
+        ++failures;
+        const FuzzCase m = FightFuzzer::minimize(c, config, r.failure);
+        const FString fileName = FString::Printf(TEXT("seed-%llu.csv"), (unsigned long long) s);
+        FightFuzzer::save(m, FightFuzzer::run(m, config), fileName);
+        MYLOG(Warning, "seed %llu: %s on frame %i, wrote Saved/Fuzz/%s", (unsigned long long) s, FightFuzzer::failureName(r.failure), r.frame, *fileName);
+      }
+      inFlight[i].store(0);
+    });
+    MYLOG(Display, "%i of %i matches in %.1f s, %i failed", std::min(first + FUZZ_BATCH, matches), matches, FPlatformTime::Seconds() - start, failures.load());
+  }
+
+  FCoreDelegates::OnHandleSystemError.Remove(onError);
+  return failures.load();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FightFuzzCommandlet.generated.h"
+
+// Headless self-play fuzzing on every core, see FightFuzzer:
+//
+//   UnrealEditor-Cmd <project> -run=FightFuzz -matches=100000 -seed=1
+//     -frames=3000 -framerate=30
+//
+// runs the cases of seeds seed..seed+matches-1 and writes every
+// failure, minimized, to Saved/Fuzz/seed-<seed>.csv. -replay=<file>
+// runs one of those files again instead. A check() failure takes the
+// process down; the seeds that were running then are in
+// Saved/Fuzz/in-flight.txt, and -seed=<seed> -matches=1 reproduces
+// one of them under a debugger.
+//
+// Returns the number of failed cases.
+UCLASS()
+class MENU_API UFightFuzzCommandlet : public UCommandlet
+{
+  GENERATED_BODY()
+
+public:
+  UFightFuzzCommandlet();
+
+  virtual int32 Main(const FString& Params) override;
+};
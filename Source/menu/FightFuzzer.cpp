@@ -0,0 +1,255 @@
+#include "FightFuzzer.h"
+#include "FightBot.h"
+#include "InputHistory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "FightLog.h"
+#include <algorithm>
+#include <random>
+
+// A FightSimulation with inputs of its own that plays a FuzzCase and
+// keeps a checksum of every frame that it confirms
+class FuzzSimulation : public FightSimulation {
+public:
+  // by frame, -1 for frames that weren't confirmed
+  std::vector<int64> checksums;
+
+  FuzzSimulation(const FightConfig& _config, const FuzzCase& c) {
+    p1Input.init(_config.maxRollback, _config.inputBuffer, c.delay, _config.framerate);
+    p2Input.init(_config.maxRollback, _config.inputBuffer, c.delay, _config.framerate);
+    setCharacters(HCharacter(c.p1Char), HCharacter(c.p2Char));
+    init(_config, &p1Input, &p2Input);
+    checksums.assign(c.frames()+1, -1);
+    preRound();
+  }
+
+  // Play the case the way an owner would: one tick per frame, player
+  // 1's input sampled on time and player 2's either on time too or
+  // `lag' ticks late
+  FuzzResult run(const FuzzCase& c, bool withRollbacks) {
+    FuzzResult r;
+    const int n = c.frames();
+    const bool alwaysRollback = config.alwaysRollback;
+    int next2 = 1; // next frame of player 2's input to deliver
+    takeOutOfRangeSamples();
+    // while stalled the frame stands still but the ticks go on, so a
+    // case can take more ticks than frames
+    for (int tick = 1; (tick <= 4*n) && (confirmedFrame < n); ++tick) {
+      if (mode == LogicMode::Idle)
+        updateRoundSequence();
+      if (mode == LogicMode::Wait)
+        break;
+      const int targetFrame = frame+1;
+      if (!isStalled() && (targetFrame <= n) && (targetFrame > p1Input.getLastInputFrame()))
+        p1Input.packedButtons(c.p1[targetFrame], targetFrame);
+      for (; (next2 <= std::min(n, targetFrame)) && (!withRollbacks || ((next2 + c.lag[next2]) <= tick)); ++next2) {
+        if (next2 > p2Input.getLastInputFrame())
+          p2Input.packedButtons(c.p2[next2], next2);
+      }
+      config.alwaysRollback = withRollbacks && (tick <= n) && c.forceRollback[tick];
+      const bool simulated = simulate(n);
+      config.alwaysRollback = alwaysRollback;
+      if (!simulated) {
+        r.failure = FuzzFailure::MaxRollbackExceeded;
+        r.frame = frame;
+        return r;
+      }
+      if (takeOutOfRangeSamples() > 0) {
+        r.failure = FuzzFailure::OutOfRange;
+        r.frame = frame;
+        return r;
+      }
+    }
+    return r;
+  }
+
+protected:
+  virtual void onFrameConfirmed(int f) override {
+    const int i = frame - f;
+    if ((f < 0) || (f >= (int) checksums.size()) || (i < 0) || (i >= frames.size()))
+      return;
+    const Frame& confirmed = frames.fromLast(i);
+    if (confirmed.frameNumber == f)
+      checksums[f] = confirmed.checksum();
+  }
+
+private:
+  InputHistory p1Input;
+  InputHistory p2Input;
+};
+
+// FightBot tactics held for a while, with every fifth stretch random
+// bytes instead, which also press buttons that no tactic does
+static void randomInputs(std::mt19937_64& rng, std::vector<uint8>& v, const FrameScale& scale) {
+  const int longest = scale.frames(20);
+  int f = 1;
+  while (f < (int) v.size()) {
+    const int length = 1 + rng() % longest;
+    const bool anything = (rng() % 5) == 0;
+    const BotTactic t = (BotTactic) (rng() % (int) BotTactic::Count);
+    const bool isOnLeft = (rng() % 2) == 0;
+    for (int i = 0; (i < length) && (f < (int) v.size()); ++i, ++f)
+      v[f] = anything ? (uint8) (rng() & 0xFF) : FightBot::tacticInput(t, i, isOnLeft, 0, scale);
+  }
+}
+
+int FuzzCase::frames() const {
+  return std::max(0, ((int) p1.size()) - 1);
+}
+
+void FuzzCase::truncate(int frames) {
+  p1.resize(frames+1);
+  p2.resize(frames+1);
+  lag.resize(frames+1);
+  forceRollback.resize(frames+1);
+}
+
+FuzzCase FuzzCase::random(uint64 seed, int frames, const FightConfig& config) {
+  std::mt19937_64 rng(seed);
+  const FrameScale scale(config.framerate);
+  FuzzCase c;
+  c.seed = seed;
+  c.p1Char = rng() % (ICharGR+1);
+  c.p2Char = rng() % (ICharGR+1);
+  c.delay = rng() % (FUZZ_MAX_DELAY+1);
+  c.truncate(frames);
+  randomInputs(rng, c.p1, scale);
+  randomInputs(rng, c.p2, scale);
+  // a link that changes its latency every now and then, with jitter
+  // and the odd spike up to the most a rollback can take
+  const int maxLag = std::max(0, config.maxRollback-1);
+  int lag = 0;
+  for (int f = 1; f <= frames; ++f) {
+    if ((rng() % scale.frames(60)) == 0)
+      lag = rng() % (maxLag+1);
+    const int jitter = (int) (rng() % 3) - 1;
+    c.lag[f] = ((rng() % 100) == 0) ? maxLag : std::clamp(lag + jitter, 0, maxLag);
+    c.forceRollback[f] = (rng() % 50) == 0;
+  }
+  return c;
+}
+
+FString FuzzCase::toCsv() const {
+  FString s = FString::Printf(TEXT("# seed=%llu p1Char=%i p2Char=%i delay=%i\n"), (unsigned long long) seed, p1Char, p2Char, delay);
+  s.Append(TEXT("frame,p1,p2,lag,forceRollback\n"));
+  for (int f = 1; f <= frames(); ++f)
+    s.Append(FString::Printf(TEXT("%i,%i,%i,%i,%i\n"), f, p1[f], p2[f], lag[f], forceRollback[f]));
+  return s;
+}
+
+bool FuzzCase::fromCsv(const FString& s) {
+  *this = FuzzCase();
+  truncate(0);
+  TArray<FString> lines;
+  s.ParseIntoArrayLines(lines);
+  for (const FString& line : lines) {
+    if (line.StartsWith(TEXT("# seed="))) {
+      FParse::Value(*line, TEXT("seed="), seed);
+      FParse::Value(*line, TEXT("p1Char="), p1Char);
+      FParse::Value(*line, TEXT("p2Char="), p2Char);
+      FParse::Value(*line, TEXT("delay="), delay);
+      continue;
+    }
+    if (line.StartsWith(TEXT("#")) || line.StartsWith(TEXT("frame")))
+      continue;
+    TArray<FString> fields;
+    line.ParseIntoArray(fields, TEXT(","));
+    // frames come in order from 1
+    if ((fields.Num() != 5) || (FCString::Atoi(*fields[0]) != frames()+1))
+      return false;
+    p1.push_back(FCString::Atoi(*fields[1]));
+    p2.push_back(FCString::Atoi(*fields[2]));
+    lag.push_back(FCString::Atoi(*fields[3]));
+    forceRollback.push_back(FCString::Atoi(*fields[4]));
+  }
+  return (p1Char >= 0) && (p1Char <= ICharGR) && (p2Char >= 0) && (p2Char <= ICharGR) &&
+    (delay >= 0) && (delay <= MAX_INPUT_DELAY);
+}
+
+FightConfig FightFuzzer::config(int framerate) {
+  const FrameScale scale(framerate);
+  FightConfig c;
+  c.framerate = framerate;
+  c.maxRollback = scale.frames(20);
+  c.inputBuffer = scale.frames(2);
+  c.stageBoundLeft = -FUZZ_STAGE_BOUND;
+  c.stageBoundRight = FUZZ_STAGE_BOUND;
+  c.leftStart = FVector(0, -FUZZ_START, 0);
+  c.rightStart = FVector(0, FUZZ_START, 0);
+  return c;
+}
+
+FuzzResult FightFuzzer::run(const FuzzCase& c, const FightConfig& config) {
+  // none of these frames happen in a game, so keep them out of the log
+  // like resimulated ones
+  FightLog::ResimulationScope quiet(true);
+  FuzzSimulation straight(config, c);
+  FuzzResult r = straight.run(c, false);
+  if (r.failure != FuzzFailure::None)
+    return r;
+  FuzzSimulation rolledBack(config, c);
+  r = rolledBack.run(c, true);
+  if (r.failure != FuzzFailure::None)
+    return r;
+  for (int f = 0; f <= c.frames(); ++f) {
+    const int64 a = straight.checksums[f], b = rolledBack.checksums[f];
+    if ((a >= 0) && (b >= 0) && (a != b)) {
+      r.failure = FuzzFailure::Divergence;
+      r.frame = f;
+      return r;
+    }
+  }
+  return r;
+}
+
+FuzzCase FightFuzzer::minimize(const FuzzCase& c, const FightConfig& config, FuzzFailure failure) {
+  int runs = 0;
+  auto fails = [&](const FuzzCase& x) {
+    ++runs;
+    return run(x, config).failure == failure;
+  };
+  FuzzCase best = c;
+
+  // nothing after the failure matters, besides the frames it takes to
+  // confirm it
+  const FuzzResult r = run(c, config);
+  FuzzCase shorter = best;
+  shorter.truncate(std::min(c.frames(), r.frame + config.maxRollback + 1));
+  if ((shorter.frames() < best.frames()) && fails(shorter))
+    best = shorter;
+
+  // then make ever smaller stretches neutral: no buttons, no lag and
+  // no forced rollback
+  for (int size = std::max(1, best.frames()/2); runs < FUZZ_MAX_MINIMIZE_RUNS; size /= 2) {
+    for (int start = 1; (start <= best.frames()) && (runs < FUZZ_MAX_MINIMIZE_RUNS); start += size) {
+      FuzzCase x = best;
+      bool changed = false;
+      for (int f = start; (f < start+size) && (f <= x.frames()); ++f) {
+        changed = changed || x.p1[f] || x.p2[f] || x.lag[f] || x.forceRollback[f];
+        x.p1[f] = x.p2[f] = x.lag[f] = x.forceRollback[f] = 0;
+      }
+      if (changed && fails(x))
+        best = x;
+    }
+    if (size == 1)
+      break;
+  }
+  return best;
+}
+
+bool FightFuzzer::save(const FuzzCase& c, const FuzzResult& r, const FString& fileName) {
+  FString s = FString::Printf(TEXT("# %s on frame %i\n"), failureName(r.failure), r.frame);
+  s.Append(c.toCsv());
+  return FFileHelper::SaveStringToFile(s, *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Fuzz"), fileName));
+}
+
+const TCHAR* FightFuzzer::failureName(FuzzFailure f) {
+  switch (f) {
+  case FuzzFailure::None: return TEXT("None");
+  case FuzzFailure::Divergence: return TEXT("Divergence");
+  case FuzzFailure::OutOfRange: return TEXT("OutOfRange");
+  case FuzzFailure::MaxRollbackExceeded: return TEXT("MaxRollbackExceeded");
+  }
+  return TEXT("?");
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FightSimulation.h"
+#include <vector>
+
+// default number of frames per fuzz case and the most runs that
+// minimizing one failure may take
+#define FUZZ_FRAMES 3000
+#define FUZZ_MAX_MINIMIZE_RUNS 4000
+// highest input delay that a case uses
+#define FUZZ_MAX_DELAY 3
+// a stage like the ones of the maps
+#define FUZZ_STAGE_BOUND 500.0
+#define FUZZ_START 100.0
+
+// The inputs of one fuzzed match, everything needed to run it again.
+// The vectors are indexed by frame.
+class FuzzCase {
+public:
+  uint64 seed = 0;
+  int p1Char = 0;
+  int p2Char = 0;
+  int delay = 0;
+  std::vector<uint8> p1;
+  std::vector<uint8> p2;
+  // how many ticks after its frame player 2's input arrives in the
+  // rollback run
+  std::vector<uint8> lag;
+  // ticks on which the rollback run rolls back as far as it can, like
+  // FightConfig::alwaysRollback
+  std::vector<uint8> forceRollback;
+
+  int frames() const;
+  // drop everything after `frames'
+  void truncate(int frames);
+  // Random and biased inputs: FightBot tactics held for a while, mixed
+  // with random buttons. The lags stay below maxRollback.
+  static FuzzCase random(uint64 seed, int frames, const FightConfig& config);
+  // "frame,p1,p2,lag,forceRollback" lines after a header
+  FString toCsv() const;
+  // Returns false if `s' isn't something toCsv() wrote
+  bool fromCsv(const FString& s);
+};
+
+enum class FuzzFailure : uint8 {
+  None,
+  // the run with rollbacks got a different confirmed frame than the
+  // straight one
+  Divergence,
+  // see takeOutOfRangeSamples()
+  OutOfRange,
+  // simulate() gave up, which the stall should prevent
+  MaxRollbackExceeded
+};
+
+class FuzzResult {
+public:
+  FuzzFailure failure = FuzzFailure::None;
+  // the first frame that failed
+  int frame = 0;
+};
+
+// Self-play fuzzing of FightSimulation. Every case runs twice, once
+// with both inputs on time and once with player 2's inputs arriving
+// late and random forced rollbacks, and the checksums of the
+// confirmed frames of both runs must match. A check() failure takes
+// the process down instead; the caller has to keep track of the cases
+// in flight for that.
+class FightFuzzer {
+public:
+  // a stage like the ones of the maps and ALogic's rollback, at
+  // `framerate'
+  static FightConfig config(int framerate);
+  static FuzzResult run(const FuzzCase& c, const FightConfig& config);
+  // Delta debugging: a case that fails the same way with as few
+  // frames and as few non-neutral inputs as it could find within
+  // FUZZ_MAX_MINIMIZE_RUNS runs
+  static FuzzCase minimize(const FuzzCase& c, const FightConfig& config, FuzzFailure failure);
+  // Write `c' into the Fuzz directory of the project's Saved
+  // directory. Returns false if writing failed.
+  static bool save(const FuzzCase& c, const FuzzResult& r, const FString& fileName);
+
+  static const TCHAR* failureName(FuzzFailure f);
+};
@@ -4,8 +4,9 @@
 #include "Logic.h"
 #include "StreetBrallersGameInstance.h"
 #include "Net/UnrealNetwork.h"
+#include "FightLog.h"
 
-#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("FightGameState (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFightNet, category, TEXT("FightGameState (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
 
 void AFightGameState::PostInitializeComponents()
 {
@@ -34,6 +35,9 @@ void AFightGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutL
 
 void AFightGameState::ServerPlayerReady(int playerNumber) {
   MYLOG(Warning, "ServerPlayerReady");
+  // a player that rejoins may ready up before it gets its snapshot
+  if (FindLogic(GetWorld())->isMatchInProgress())
+    return;
   switch (playerNumber) {
   case 0: p0Ready = true; break;
   case 1: p1Ready = true; break;
@@ -1,510 +1,174 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "FightInput.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/PlatformTime.h"
+#include "FightLog.h"
 #include <algorithm>
-#include <limits>
 
-//#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("AFightInput (%s %s) " message), *GetActorLabel(false), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
-#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("AFightInput (%s %s) " message), TEXT("<actor label>"), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+//#define MYLOG(category, message, ...) FIGHT_LOG(LogFightInput, category, TEXT("AFightInput (%s %s) " message), *GetActorLabel(false), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFightInput, category, TEXT("AFightInput (%s %s) " message), TEXT("<actor label>"), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
 
-#define LATENCY_HISTORY_SIZE 5
-
-void ButtonRingBuffer::reserve(int size) {
-  n = size;
-  clear();
-}
-
-void ButtonRingBuffer::clear() {
-  v.clear();
-  v.resize(n, {});
-  end = 0;
-}
-
-void ButtonRingBuffer::push(const std::optional<enum Button>& x) {
-  end = end+1;
-  if (end == n) end = 0;
-  v.at(end) = x;
-}
-
-std::optional<enum Button>& ButtonRingBuffer::last() {
-  return v.at(end);
-}
-
-std::optional<enum Button>& ButtonRingBuffer::nthlast(int i) {
-  int j = end-i;
-  if (j < 0) j += n;
-  check(j >= 0);
-  check(j < n);
-  return v.at(j);
-}
-
-void intRingBuffer::reserve(int size) {
-  n = size;
-  clear();
-}
-
-void intRingBuffer::clear() {
-  v.clear();
-  v.resize(n, 0);
-  end = 0;
-}
-
-void intRingBuffer::push(int x) {
-  end = end+1;
-  if (end == n) end = 0;
-  v.at(end) = x;
-}
-
-int intRingBuffer::last() {
-  return v.at(end);
-}
-
-int intRingBuffer::first() {
-  return nthlast(n-1);
+AFightInput::AFightInput(): frameOffset(-32.0, 1.0, 64), rtt(0.0, 5.0, 100) {
+  bReplicates = true;
 }
 
-int intRingBuffer::nthlast(int i) {
-  int j = end-i;
-  if (j < 0) j += n;
-  check(j >= 0);
-  check(j < n);
-  return v.at(j);
+void AFightInput::init(int _maxRollback, int _buffer, int _delay, int _framerate) {
+  InputHistory::init(_maxRollback, _buffer, _delay, _framerate);
+  recievedPackets.Empty();
+  queuedFrame = 0;
+  peerAckFrame = 0;
+  localFrame = 0;
+  frameOffset.reset();
+  peerFrameAdvantage = 0.0;
+  rtt.reset();
+  hasPeerTimestamp = false;
 }
 
-AFightInput::AFightInput() {
-  bReplicates = true;
+void AFightInput::snapshotLoaded() {
+  queuedFrame = std::max((int) queuedFrame, getLastInputFrame());
+  localFrame = getCurrentFrame();
 }
 
-bool AFightInput::is_button(const enum Button& b) {
-  switch (b) {
-  case Button::LP:
-  case Button::HP:
-  case Button::LK:
-  case Button::HK:
-    return true;
-  default:
-    return false;
+void AFightInput::fillTimestamps(InputPacket& p) const {
+  p.timestamp = InputPacket::clockMs();
+  if (hasPeerTimestamp) {
+    p.echoTimestamp = peerTimestamp;
+    p.echoDelay = (uint16) (p.timestamp - peerTimestampRecievedAt);
   }
-}
-
-enum Button toSingleDirection(std::optional<enum Button> dx, std::optional<enum Button> dy) {
-  if (dx.has_value()) {
-    if (dx.value() == Button::FORWARD) {
-      if (dy.has_value() && (dy.value() == Button::DOWN))
-        return Button::DOWNFORWARD;
-      else if (dy.has_value() && (dy.value() == Button::UP))
-        return Button::UPFORWARD;
-      else
-        return Button::FORWARD;
-    }
-    else if (dx.value() == Button::BACK) {
-      if (dy.has_value() && (dy.value() == Button::DOWN))
-        return Button::DOWNBACK;
-      if (dy.has_value() && (dy.value() == Button::UP))
-        return Button::UPBACK;
-      else
-        return Button::BACK;
-    }
+  else {
+    p.echoDelay = -1;
   }
-
-  if (dy.has_value())
-    return dy.value();
-  else
-    return Button::NEUTRAL;
-}
-
-// bool AFightInput::is_none(const Button& b) {
-//   return b == Button::NONE;
-// }
-
-// amount of input we keep for looking back for command inputs
-#define LOOKBEHIND_SIZE 30
-// amount of input we keep to cope with inputs from the future
-#define FUTURE_SIZE maxRollback
-
-void AFightInput::init(int _maxRollback, int _buffer, int _delay) {
-  maxRollback = _maxRollback;
-  buffer = _buffer;
-  delay = _delay;
-  n = maxRollback+buffer+delay+LOOKBEHIND_SIZE+FUTURE_SIZE;
-  buttonHistory.reserve(n);
-  directionHistoryX.reserve(n);
-  directionHistoryY.reserve(n);
-  mode = LogicMode::Wait;
-  lastInputFrame = currentFrame = 0;
-  latencyHistory.reserve(LATENCY_HISTORY_SIZE);
-  avgLatency = avgLatencyOther = 0;
-  reset();
 }
 
-void AFightInput::reset() {
-  clearRollbackFlags();
-  buttonHistory.clear();
-  directionHistoryX.clear();
-  directionHistoryY.clear();
+void AFightInput::setNetworkConditions(const NetworkConditions& conditions, int salt) {
+  conditioner.configure(conditions, salt);
 }
 
-void AFightInput::setMode(enum LogicMode m) {
-  mode = m;
+const NetworkConditioner& AFightInput::getNetworkConditioner() const {
+  return conditioner;
 }
 
-void AFightInput::ensureFrame(int targetFrame) {
-  while (targetFrame > currentFrame) {
-    // assume nothing was pressed for frames we are skipping here. The
-    // last one we push is actually for the new frame and we will
-    // store the recieved inputs in that one.
-    buttonHistory.push({});
-    directionHistoryX.push(directionHistoryX.last());
-    directionHistoryY.push(directionHistoryY.last());
-    ++currentFrame;
-  }
+void AFightInput::ClientButtons_Implementation(const TArray<uint8>& packet) {
+  //MYLOG(Display, "ClientButtons");
+  if (conditioner.isEnabled())
+    conditioner.send(packet, FPlatformTime::Seconds());
+  else
+    recievePacket(packet);
 }
 
-auto buttonToString(enum Button b) {
-  switch (b) {
-  case Button::LP: return TEXT("LP"); break;
-  case Button::HP: return TEXT("HP"); break;
-  case Button::LK: return TEXT("LK"); break;
-  case Button::HK: return TEXT("HK"); break;
-  case Button::FORWARD: return TEXT("FORWARD"); break;
-  case Button::BACK: return TEXT("BACK"); break;
-  case Button::UP: return TEXT("UP"); break;
-  case Button::DOWN: return TEXT("DOWN"); break;
-  case Button::LEFT: return TEXT("LEFT"); break;
-  case Button::RIGHT: return TEXT("RIGHT"); break;
-  case Button::UPBACK: return TEXT("UPBACK"); break;
-  case Button::UPFORWARD: return TEXT("UPFORWARD"); break;
-  case Button::DOWNBACK: return TEXT("DOWNBACK"); break;
-  case Button::DOWNFORWARD: return TEXT("DOWNFORWARD"); break;
-  case Button::NEUTRAL: return TEXT("NEUTRAL"); break;
-  case Button::QCFP: return TEXT("QCFP"); break;
-  default: return TEXT("0");
+void AFightInput::recievePacket(const TArray<uint8>& packet) {
+  RecievedPacket r;
+  r.recievedAt = InputPacket::clockMs();
+  r.bytes = packet.Num();
+  if (!r.packet.decode(packet, queuedFrame)) {
+    MYLOG(Warning, "ClientButtons: dropping malformed packet");
+    return;
   }
+  if (r.packet.lastFrame() > queuedFrame)
+    queuedFrame = r.packet.lastFrame();
+  // late and repeated packets are queued too, for their ack and
+  // timestamps
+  recievedPackets.Enqueue(MoveTemp(r));
 }
 
-FString ButtonRingBuffer::toString() {
-  FString s;
-  for (int i = 0; i < n; ++i) {
-    std::optional<enum Button> o = nthlast(i);
-    if (o.has_value())
-      s.Append(buttonToString(o.value()));
-    else
-      s.Append(FString("None"));
-    s.Append(FString(" "));
-  }
-  return s;
-}
+void AFightInput::drainRecievedInputs() {
+  TArray<uint8> packet;
+  while (conditioner.recieve(FPlatformTime::Seconds(), packet))
+    recievePacket(packet);
 
-FString AFightInput::encodedButtonsToString(int8 e) {
-  FString r;
-  for (auto b : {Button::LP, Button::HP, Button::LK, Button::HK,
-                 Button::UP, Button::DOWN, Button::LEFT, Button::RIGHT}) {
-    if (decodeButton(b, e)) {
-      r.Append(buttonToString(b));
-      r.Append(FString(" "));
-    }
+  RecievedPacket r;
+  while (recievedPackets.Dequeue(r)) {
+    if ((getMode() == LogicMode::Fight) || (getMode() == LogicMode::Idle))
+      applyPacket(r);
   }
-  return r;
-}
-
-int8 AFightInput::encodeButton(enum Button b, int8 encoded) {
-  return encoded | (1 << (int) b);
-}
-
-int8 AFightInput::unsetButton(enum Button b, int8 encoded) {
-  return encoded & (~(1 << (int) b));
-}
-
-bool AFightInput::decodeButton(enum Button b, int8 encoded) {
-  return (encoded & (1 << (int) b)) != 0;
 }
 
-void AFightInput::buttons(int8 buttonsPressed, int8 buttonsReleased, int targetFrame) {
-  if ((mode != LogicMode::Fight) && (mode != LogicMode::Idle)) return;
-  // MYLOG(Display,
-  //       TEXT("buttons(): (current frame %i) (target frame %i) (buttonsPressed %s) (buttonsReleased %s)"),
-  //       currentFrame,
-  //       targetFrame,
-  //       *encodedButtonsToString(buttonsPressed),
-  //       *encodedButtonsToString(buttonsReleased));
+void AFightInput::applyPacket(const RecievedPacket& r) {
+  const InputPacket& p = r.packet;
+  recievedBytes.add(r.bytes);
+  peerAckFrame = std::max(peerAckFrame, p.ackFrame);
 
-  lastInputFrame = targetFrame; // assumes calls maintain order
-
-  // check if a rollback will be needed
-  if (targetFrame <= (currentFrame-delay)) {
-    needsRollbackToFrame = std::min(needsRollbackToFrame, targetFrame+delay);
-    if (needsRollback() && (currentFrame - needsRollbackToFrame) >= maxRollback) {
-      return; // there is nothing that this class can do in this
-              // situation. We don't have input data going back that
-              // far. Let ALogic decide how to reset or quit the
-              // match.
+  // only packets sent after the newest one we have seen give a fair
+  // round trip sample; older ones were held up somewhere
+  if (!hasPeerTimestamp || ((int16) (p.timestamp - peerTimestamp) > 0)) {
+    hasPeerTimestamp = true;
+    peerTimestamp = p.timestamp;
+    peerTimestampRecievedAt = r.recievedAt;
+    if (p.echoDelay >= 0) {
+      int16 sample = (int16) (r.recievedAt - p.echoTimestamp - p.echoDelay);
+      if (sample >= 0)
+        rtt.addSample(sample);
     }
   }
-  if ((targetFrame - currentFrame) > FUTURE_SIZE) {
-    needsRollbackToFrame = -1;
-    return;
-  }
 
-  ensureFrame(targetFrame);
+  if (p.lastFrame() <= getLastInputFrame())
+    return; // late or repeated packet; we have all of it already
 
-  // get the data for the frame we want to modify
-  int i = currentFrame - targetFrame;
-  std::optional<enum Button>& bh = buttonHistory.nthlast(i);
-  std::optional<enum Button>& dxh = directionHistoryX.nthlast(i);
-  std::optional<enum Button>& dyh = directionHistoryY.nthlast(i);
+  peerFrameAdvantage = p.frameAdvantage / 4.0;
+  frameOffset.addSample(localFrame - p.lastFrame());
 
-  // handle presses. this is a really simple implementation that just
-  // sets the button pressed to the last button/direction that happens
-  // to appear in buttonsPressed.
-  for (auto b: {Button::LP, Button::HP, Button::LK, Button::HK}) {
-    if (decodeButton(b, buttonsPressed))
-        bh = std::make_optional(b);
-  }
-  for (auto b: {Button::LEFT, Button::RIGHT}) {
-    if (decodeButton(b, buttonsPressed)) {
-      dxh = std::make_optional(b);
-      for (int j = 1; j <= i; ++j)
-        directionHistoryX.nthlast(i-j) = dxh;
-    }
-  }
-  for (auto b: {Button::UP, Button::DOWN}) {
-    if (decodeButton(b, buttonsPressed)) {
-      dyh = std::make_optional(b);
-      for (int j = 1; j <= i; ++j)
-        directionHistoryY.nthlast(i-j) = dyh;
-    }
-  }
-
-  // handle releases. this should probably just ignore everything
-  // except directional inputs. we don't have to care when a button is
-  // released, except when its a directional input. TODO: keep track
-  // of all directions held so that when one is released we can use
-  // one of the other currently held ones. _action() will have to pick
-  // between which directions to prioritize.
-  for (auto b: {Button::LEFT, Button::RIGHT}) {
-    if (decodeButton(b, buttonsReleased) && (directionHistoryX.last() == b)) {
-      dxh = {};
-      for (int j = 1; j <= i; ++j)
-        directionHistoryX.nthlast(i-j) = {};
-    }
-  }
-  for (auto b: {Button::UP, Button::DOWN}) {
-    if (decodeButton(b, buttonsReleased) && (directionHistoryY.last() == b)) {
-      dyh = {};
-      for (int j = 1; j <= i; ++j)
-        directionHistoryY.nthlast(i-j) = {};
-    }
+  for (int i = 0; i < p.states.Num(); ++i) {
+    int targetFrame = p.firstFrame + i;
+    if (targetFrame <= getLastInputFrame())
+      continue;
+    packedButtons(p.states[i], targetFrame);
   }
 }
 
-void AFightInput::ClientButtons_Implementation(int8 buttonsPressed, int8 buttonsReleased, int targetFrame, int avgLatencyOther_) {
-  //MYLOG(Display, "ClientButtons");
-  avgLatencyOther = avgLatencyOther_;
-  int latency = currentFrame - targetFrame;
-  avgLatency += latency - latencyHistory.first();
-  latencyHistory.push(latency);
-  buttons(buttonsPressed, buttonsReleased, targetFrame);
+int AFightInput::getPeerAck() const {
+  return peerAckFrame;
 }
 
-enum Button AFightInput::translateDirection(const enum Button& d, bool isOnLeft) {
-  if (((d == Button::RIGHT) && isOnLeft) ||
-      ((d == Button::LEFT) && !isOnLeft))
-    return Button::FORWARD;
-  else if (((d == Button::LEFT) && isOnLeft) ||
-           ((d == Button::RIGHT) && !isOnLeft))
-    return Button::BACK;
-  else
-    return d;
+float AFightInput::getRecievedBytesPerSecond() const {
+  return recievedBytes.bytesPerSecond();
 }
 
-std::optional<enum Button> AFightInput::translateDirection(std::optional<enum Button>& d, bool isOnLeft) {
-  if (d.has_value())
-    return std::make_optional(translateDirection(d.value(), isOnLeft));
-  else
-    return {};
+void AFightInput::setLocalFrame(int frame) {
+  localFrame = frame;
 }
 
-int AFightInput::computeIndex(int targetFrame) {
-  return (currentFrame - targetFrame)+delay;
+float AFightInput::getFrameOffset() const {
+  return frameOffset.mean();
 }
 
-HAction AFightInput::_action(HAction currentAction, int frame, bool isOnLeft, int actionFrame) {
-  const HCharacter& c = currentAction.character();
-  // MYLOG(Warning, "_action(): %s (frame %i) (button %s)", *GetActorLabel(false), frame, directionHistory.nthlast(frame).has_value() ? ((directionHistory.nthlast(frame).value() == Button::RIGHT) ? TEXT("right") : TEXT("not right")) : TEXT("none"));
-
-  // first we will determine the "button".
-  std::vector<enum Button> buttons;
-
-  // first try motion commands; they have the highest priority
-  enum Button newButton = Button::NEUTRAL;
-  if (buttonHistory.nthlast(frame).has_value()) {
-    for (auto i = motionCommands.begin(); i != motionCommands.end(); ++i) {
-      for (auto j = i->second.begin(); j != i->second.end(); ++j) {
-        if (j->back() == buttonHistory.nthlast(frame).value()) {
-          if (checkMotionCommand(*j, 1, frame, isOnLeft)) {
-            MYLOG(Display, "_action(): %s!", buttonToString(i->first));
-            newButton = i->first;
-          }
-        }
-      }
-    }
-  }
-  if (newButton != Button::NEUTRAL)
-    buttons.push_back(newButton);
-
-  // try a normal attack
-  if (buttonHistory.nthlast(frame).has_value()) {
-    buttons.push_back(buttonHistory.nthlast(frame).value());
-  }
-
-  // try directional input
-  buttons.push_back(toSingleDirection(translateDirection(directionHistoryX.nthlast(frame), isOnLeft), directionHistoryY.nthlast(frame)));
-
-  // now with our "button" we pick an action
-
-  // first try chains; these have highest priority
-  for (auto b : buttons) {
-    if (actionFrame >= currentAction.specialCancelFrames()) {
-      auto i = currentAction.chains().find(b);
-      if (i != currentAction.chains().end()) return i->second;
-    }
-  }
-
-  if (actionFrame < currentAction.lockedFrames())
-    return currentAction.character().idle(); // idle doesn't interrupt
-                                             // any actions so this is
-                                             // safe as a "do nothing"
-                                             // return value
-
-  for (auto b : buttons) {
-    // try specials
-    for (auto i : currentAction.character().specials()) {
-      if (i.first == b) return i.second;
-    }
-
-    // try normals and motion
-    switch (b) {
-    case Button::NEUTRAL:
-    case Button::DOWNFORWARD:
-    case Button::DOWNBACK:
-      return c.idle();
-    case Button::FORWARD:
-      return c.walkForward();
-    case Button::BACK:
-    case Button::UPBACK:
-      return c.walkBackward();
-    case Button::UPFORWARD:
-      return c.fJump();
-    case Button::HP:
-      return c.sthp();
-    case Button::LP:
-      return c.stlp();
-    case Button::LK:
-      return c.grab();
-    }
-  }
-
-  // just idle if no other action was chosen
-  return c.idle();
+const LatencyEstimator& AFightInput::getFrameOffsetEstimator() const {
+  return frameOffset;
 }
 
-bool AFightInput::checkMotionCommand(std::vector<enum Button>& motion, int m, int frame, bool isOnLeft) {
-  if (m == motion.size())
-    return true;
-  if (frame >= n-3)
-    return false;
-
-  check(frame >= 0);
-  check((motion.size() - m - 1) < motion.size());
-  // MYLOG(Display,
-  //       "checkMotionCommand() %i %i %s %s %s",
-  //       m,
-  //       frame,
-  //       buttonToString(toSingleDirection(translateDirection(directionHistoryX.nthlast(frame), isOnLeft), directionHistoryY.nthlast(frame))),
-  //       directionHistoryX.nthlast(frame).has_value() ? buttonToString(translateDirection(directionHistoryX.nthlast(frame).value(), isOnLeft)) : TEXT("None"),
-  //       directionHistoryY.nthlast(frame).has_value() ? buttonToString(directionHistoryY.nthlast(frame).value()) : TEXT("None"));
-  for (int i = 0; i < 4; ++i) { // this 4 is the number of frames we allow between inputs
-    if (toSingleDirection(translateDirection(directionHistoryX.nthlast(frame+i), isOnLeft), directionHistoryY.nthlast(frame+i)) == motion[motion.size() - m - 1]) {
-      if (checkMotionCommand(motion, m+1, frame+i+1, isOnLeft))
-        return true;
-    }
-  }
-
-  return false;
+float AFightInput::getPeerFrameAdvantage() const {
+  return peerFrameAdvantage;
 }
 
-HAction AFightInput::action(HAction currentAction, bool isOnLeft, int targetFrame, int actionStart) {
-  if (mode == LogicMode::Idle)
-    return currentAction.character().idle();
-
-  int frameBefore = currentFrame;
-  int actionFrame = targetFrame - actionStart;
-  ensureFrame(targetFrame);
-  //MYLOG(Warning, "action(): %s (current frame %i) (target frame %i)", *GetActorLabel(false), currentFrame, targetFrame);
-
-  int frame = computeIndex(targetFrame);
-  // Try decoding an action based on the inputs at `frame'. If the
-  // action we decode is walking or idling, then try using the inputs
-  // one frame earlier. Repeat until we find an action that isn't
-  // idling or walking, or we have tried all of the `input
-  // buffer' frames.
-  HAction mostRecentAction = _action(currentAction, frame, isOnLeft, actionFrame);
-  // MYLOG(Warning, "action(): %s (current frame %i) (target frame %i) (action: %s)", *GetActorLabel(false), currentFrame, targetFrame, (mostRecentAction == HActionIdle) ? TEXT("idle") : TEXT("not idle"));
-  HAction action = mostRecentAction;
-
-  for (int i = 1; (i < buffer) && action.isWalkOrIdle(); ++i) {
-    action = _action(currentAction, frame+i, isOnLeft, actionFrame);
-  }
-  // MYLOG(Display,
-  //       "action() (action %i) (current frame %i) (target frame %i) (actionFrame %i) (new action %i)",
-  //       currentAction.animation(),
-  //       currentFrame,
-  //       targetFrame,
-  //       actionFrame,
-  //       (action.isWalkOrIdle() ? mostRecentAction : action).animation());
-  // MYLOG(Display, "buttonHistory: %s", *(buttonHistory.toString()));
-  return action.isWalkOrIdle() ? mostRecentAction : action;
-}
-
-enum GuardLevel AFightInput::isGuarding(bool isOnLeft, int targetFrame) {
-  ensureFrame(targetFrame);
-  int frame = computeIndex(targetFrame);
-  if (directionHistoryX.nthlast(frame).has_value() &&
-      (translateDirection(directionHistoryX.nthlast(frame).value(), isOnLeft) == Button::BACK)) {
-    if (directionHistoryX.nthlast(frame).has_value() &&
-        directionHistoryX.nthlast(frame).value() == Button::DOWN)
-      return GuardLevel::Low;
-    else
-      return GuardLevel::High;
-  }
-  else
-    return GuardLevel::None;
+const LatencyEstimator& AFightInput::getRttEstimator() const {
+  return rtt;
 }
 
-int AFightInput::getCurrentFrame() {
-  return currentFrame;
+float AFightInput::getRoundTripTime() const {
+  return rtt.mean();
 }
 
-bool AFightInput::needsRollback() {
-  return needsRollbackToFrame != std::numeric_limits<int>::max();
+float AFightInput::getRoundTripJitter() const {
+  return rtt.jitter();
 }
 
-int AFightInput::getNeedsRollbackToFrame() {
-  return needsRollbackToFrame;
+float AFightInput::getRoundTripTimePercentile(float p) const {
+  return rtt.percentile(p);
 }
 
-void AFightInput::clearRollbackFlags() {
-  needsRollbackToFrame = std::numeric_limits<int>::max();
-}
-
-int AFightInput::getAvgLatency() const {
-  return avgLatency;
-}
-
-float AFightInput::getDesync() const {
-  return (avgLatencyOther - avgLatency) / ((float) LATENCY_HISTORY_SIZE);
+TArray<int32> AFightInput::getRoundTripHistogram() const {
+  TArray<int32> r;
+  for (int count : rtt.getHistogram())
+    r.Add(count);
+  return r;
 }
 
-bool AFightInput::hasRecievedInputForFrame(int frame) const {
-  return frame <= (lastInputFrame+delay);
+bool AFightInput::exportLatencyHistograms(const FString& fileName) const {
+  FString s = FString::Printf(TEXT("# round trip time (ms): mean %f jitter %f p50 %f p90 %f p99 %f\n"),
+                              rtt.mean(), rtt.jitter(), rtt.percentile(0.5), rtt.percentile(0.9), rtt.percentile(0.99));
+  s.Append(rtt.histogramToCsv());
+  s.Append(FString::Printf(TEXT("# frame offset (frames): mean %f jitter %f\n"), frameOffset.mean(), frameOffset.jitter()));
+  s.Append(frameOffset.histogramToCsv());
+  return FFileHelper::SaveStringToFile(s, *FPaths::Combine(FPaths::ProjectSavedDir(), fileName));
 }
@@ -4,161 +4,128 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Info.h"
-#include "Action.h"
-#include "LogicMode.h"
-#include "Button.h"
-#include <optional>
-#include <vector>
+#include "Containers/Queue.h"
+#include "InputHistory.h"
+#include "InputPacket.h"
+#include "LatencyEstimator.h"
+#include "NetworkConditioner.h"
+#include <atomic>
 #include "FightInput.generated.h"
 
-// UE doesn't support type aliases
-#define int8 char
-
-class intRingBuffer;
-
-// ideally we'd only have one RingBuffer<T> class but unreal doesn't
-// like templates and I don't want to figure out how to build it as an
-// external library that can still be distributed to many platforms
-// just yet.
-class ButtonRingBuffer {
-private:
-  int n;
-  int end;
-
-public:
-  std::vector<std::optional<enum Button>> v;
-  void reserve(int size);
-  void clear();
-
-  void push(const std::optional<enum Button>& x);
-
-  std::optional<enum Button>& last();
-
-  std::optional<enum Button>& nthlast(int i);
-
-  FString toString();
-};
-
-class intRingBuffer {
-private:
-  int n;
-  int end;
-
+// An input packet on its way from the network handler to the
+// simulation
+class RecievedPacket {
 public:
-  std::vector<int> v;
-  void reserve(int size);
-  void clear();
-
-  void push(int x);
-
-  int last();
-
-  int first();
-
-  int nthlast(int i);
-
-  FString toString();
+  InputPacket packet;
+  uint16 recievedAt; // InputPacket::clockMs() when it arrived
+  int bytes;
 };
 
-enum class GuardLevel { High, Low, None };
-
-// This class will decode input sequences and support replaying input
-// in case of rollback. In the case that each move is triggered by a
-// single button press, this is simply mapping the most recent button
-// to a move. In the case of chorded moves or motion commands, we have
-// to keep track of all buttons pressed over time.
+// The inputs of one player in a game: the decoding and rollback
+// bookkeeping of InputHistory plus the network state of the inputs
+// that come from the remote player.
 UCLASS()
-class MENU_API AFightInput : public AInfo {
+class MENU_API AFightInput : public AInfo, public InputHistory {
   GENERATED_BODY()
 private:
-  int maxRollback;
-  int n;
-
-  // number of frames to "buffer" inputs. if there are no actions in
-  // the latest frame to decode besides walking, then use inputs from
-  // the latest frame within `buffer` frames away that results in an
-  // action.
-  int buffer;
-
-  // artificial input delay. action() should decode an action based on
-  // the inputs `delay` frames ago.
-  int delay;
-
-  int currentFrame;
-  int needsRollbackToFrame;
-
-  // for now, just allow one button at a time
-  ButtonRingBuffer buttonHistory;
-  // this assumes that the player cannot press opposite directions at
-  // the same time
-  ButtonRingBuffer directionHistoryX;
-  ButtonRingBuffer directionHistoryY;
-
-  enum LogicMode mode;
-
-  int lastInputFrame;
-  intRingBuffer latencyHistory;
-  int avgLatency;
-  int avgLatencyOther;
-
-  bool is_button(const enum Button& b);
-  // bool is_none(const Button& b);
-  enum Button translateDirection(const enum Button& d, bool isOnLeft);
-  std::optional<enum Button> translateDirection(std::optional<enum Button>& d, bool isOnLeft);
-  // compute how far back in our history we have to look for the input
-  // data for targetFrame
-  int computeIndex(int targetFrame);
-
-  // Make sure that AFightInput has some data for the new frame. We
-  // will either do nothing or "predict" the input (assume nothing was
-  // pressed or released).
-  void ensureFrame(int targetFrame);
-
-  // returns true if a sequence of `motion` inputs ends on `frame`
-  bool checkMotionCommand(std::vector<enum Button>& motion, int n, int frame, bool isOnLeft);
-  // return action using input `frame` frames ago as latest input
-  HAction _action(HAction currentAction, int frame, bool isOnLeft, int actionFrame);
+  // Packets recieved by ClientButtons() and not yet applied. The
+  // network handler is the only producer and drainRecievedInputs() on
+  // the game thread the only consumer, so nothing that the handler
+  // touches besides the queue and queuedFrame is shared with the
+  // simulation.
+  TQueue<RecievedPacket, EQueueMode::Spsc> recievedPackets;
+  // newest frame of any packet put in the queue, used to unwrap the
+  // frame numbers of the next packets
+  std::atomic<int> queuedFrame;
+
+  // newest frame of the local player's inputs that the peer has
+  // acknowledged recieving (only meaningful for the remote input)
+  int peerAckFrame;
+  ByteRateCounter recievedBytes;
+
+  // ALogic's newest frame, which remote inputs are measured against
+  int localFrame;
+  // how many frames late the remote inputs arrive (our frame minus
+  // the frame of the input)
+  LatencyEstimator frameOffset;
+  // the frame advantage the peer last reported
+  float peerFrameAdvantage;
+  // round trip time in ms, measured by echoing timestamps in the input
+  // packets
+  LatencyEstimator rtt;
+  bool hasPeerTimestamp;
+  uint16 peerTimestamp; // newest timestamp recieved from the peer
+  uint16 peerTimestampRecievedAt; // our clockMs() when it arrived
+
+  // Packets that ClientButtons() recieved are held here first when
+  // simulating a bad link
+  NetworkConditioner conditioner;
+
+  // decode and queue a packet that made it through the conditioner
+  void recievePacket(const TArray<uint8>& packet);
+  // ack, round trip and frame offset bookkeeping plus the new frames
+  // of one recieved packet
+  void applyPacket(const RecievedPacket& r);
 
 public:
   AFightInput();
 
-  // initialize all member variables
-  void init(int _maxRollback, int _buffer, int _delay);
-  // clear all inputs and rollback state
-  void reset();
-
-  void setMode(enum LogicMode);
-
-  // Returns the encoding given in `encoded' plus the button `b'
-  // encoded into it
-  static FString encodedButtonsToString(int8 e);
-  static int8 encodeButton(enum Button b, int8 encoded=0);
-  static int8 unsetButton(enum Button b, int8 encoded=0);
-  static bool decodeButton(enum Button b, int8 encoded);
-
-  // The player controller will call this function to say which
-  // buttons were pressed and released on the given frame. frame is
-  // the frame that the inputs should first appear. It is 1+ the frame
-  // number stored in ALogic at the time that this function is called
-  // by the player controller.
-  void buttons(int8 buttonsPressed, int8 buttonsReleased, int targetFrame);
-
-  UFUNCTION (Client, Reliable)
-  void ClientButtons(int8 buttonsPressed, int8 buttonsReleased, int targetFrame, int avgLatencyOther_);
-
-  // Returns the decoded action for the given targetFrame.
-  HAction action(HAction currentAction, bool isOnLeft, int targetFrame, int actionStart);
-
-  // guarding might not depend on the action but rather the inputs
-  // (holding back or down-back), so we use a new method here. We
-  // could also add a `guard' flag to some actions.
-  enum GuardLevel isGuarding(bool isOnLeft, int targetFrame);
-
-  int getCurrentFrame();
-  bool needsRollback();
-  int getNeedsRollbackToFrame();
-  void clearRollbackFlags();
-  int getAvgLatency() const;
-  float getDesync() const;
-  bool hasRecievedInputForFrame(int frame) const;
+  // initialize all member variables, including the network state
+  void init(int _maxRollback, int _buffer, int _delay, int _framerate = BASE_FRAMERATE);
+  // Call after loading a snapshot into the InputHistory, so that the
+  // next packets are read relative to the inputs it brought
+  void snapshotLoaded();
+  // Simulate these conditions on the packets ClientButtons() recieves
+  // from now on. See NetworkConditioner for `salt'.
+  void setNetworkConditions(const NetworkConditions& conditions, int salt);
+  const NetworkConditioner& getNetworkConditioner() const;
+
+  // Fill in the ping/pong fields of a packet we are about to send to
+  // the player whose inputs these are.
+  void fillTimestamps(InputPacket& p) const;
+
+  // Recieve an encoded InputPacket with the recent inputs of the
+  // remote player. Frames that we already have are skipped, so packets
+  // may be lost, repeated or reordered. The packet is only decoded and
+  // queued here; the inputs change on the next drainRecievedInputs().
+  // With simulated network conditions the packet may be held back,
+  // dropped or duplicated first.
+  UFUNCTION (Client, Unreliable)
+  void ClientButtons(const TArray<uint8>& packet);
+
+  // Apply every queued packet, in order, after letting through the
+  // packets that the conditioner was holding. ALogic calls this at the
+  // start of each step, so after draining both inputs a single
+  // needsRollback() check covers everything that arrived since the
+  // last step. Outside of Fight and Idle the packets are dropped.
+  void drainRecievedInputs();
+
+  int getPeerAck() const;
+  // bytes per second of input packets recieved for this input
+  float getRecievedBytesPerSecond() const;
+  // ALogic tells us its frame after each logic frame
+  void setLocalFrame(int frame);
+  // Smoothed number of frames that the remote inputs arrive late by
+  float getFrameOffset() const;
+  const LatencyEstimator& getFrameOffsetEstimator() const;
+  // How many frames the peer thinks it is ahead of us
+  float getPeerFrameAdvantage() const;
+
+  // Round trip time statistics for the remote player, in ms. Only the
+  // input of the remote player gets samples.
+  const LatencyEstimator& getRttEstimator() const;
+  UFUNCTION (BlueprintCallable, Category="Network")
+  float getRoundTripTime() const;
+  UFUNCTION (BlueprintCallable, Category="Network")
+  float getRoundTripJitter() const;
+  // p in [0,1]
+  UFUNCTION (BlueprintCallable, Category="Network")
+  float getRoundTripTimePercentile(float p) const;
+  // counts of round trip samples in 5 ms buckets starting at 0 ms
+  UFUNCTION (BlueprintCallable, Category="Network")
+  TArray<int32> getRoundTripHistogram() const;
+  // Write the round trip and frame offset histograms as CSV into the
+  // project's Saved directory. Returns false if writing failed.
+  UFUNCTION (BlueprintCallable, Category="Network")
+  bool exportLatencyHistograms(const FString& fileName) const;
 };
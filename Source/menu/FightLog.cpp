@@ -0,0 +1,14 @@
+#include "FightLog.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogFight);
+DEFINE_LOG_CATEGORY(LogFightInput);
+DEFINE_LOG_CATEGORY(LogFightNet);
+
+thread_local bool FightLog::resimulating = false;
+bool FightLog::logResimulation = false;
+
+static FAutoConsoleVariableRef CVarLogResimulation(
+  TEXT("fight.LogResimulation"),
+  FightLog::logResimulation,
+  TEXT("Also log the frames that are resimulated after a rollback."));
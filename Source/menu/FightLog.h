@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Logging/LogMacros.h"
+
+// Log categories of the fight.
+//
+// Messages more verbose than FIGHT_LOG_COMPILE_VERBOSITY are compiled
+// out together with their arguments. Per-frame messages (button
+// presses, decoded motions, hits, rollbacks) use Verbose, so they cost
+// nothing unless they are compiled in, and even then they don't print
+// unless turned on with e.g. `log LogFight Verbose'.
+#ifndef FIGHT_LOG_COMPILE_VERBOSITY
+#if UE_BUILD_SHIPPING || UE_BUILD_TEST
+#define FIGHT_LOG_COMPILE_VERBOSITY Warning
+#else
+#define FIGHT_LOG_COMPILE_VERBOSITY All
+#endif
+#endif
+
+// ALogic, FightSimulation and FightMatchPool: rounds, hits, rollbacks
+// and matches
+DECLARE_LOG_CATEGORY_EXTERN(LogFight, Log, FIGHT_LOG_COMPILE_VERBOSITY);
+// InputHistory, AFightInput and ALogicPlayerController: buttons,
+// decoding, packets
+DECLARE_LOG_CATEGORY_EXTERN(LogFightInput, Log, FIGHT_LOG_COMPILE_VERBOSITY);
+// game mode and game state: logins, readying up, travel
+DECLARE_LOG_CATEGORY_EXTERN(LogFightNet, Log, FIGHT_LOG_COMPILE_VERBOSITY);
+
+// While ALogic resimulates frames after a rollback it would print the
+// same messages again for frames that were already logged once. Those
+// messages are dropped unless fight.LogResimulation is set.
+class FightLog {
+public:
+  static thread_local bool resimulating;
+  static bool logResimulation;
+
+  static bool isSuppressed() {
+    return resimulating && !logResimulation;
+  }
+
+  // Marks the current thread as resimulating for its lifetime
+  class ResimulationScope {
+  private:
+    bool previous;
+  public:
+    explicit ResimulationScope(bool resimulating_): previous(resimulating) {
+      resimulating = resimulating_;
+    }
+    ~ResimulationScope() {
+      resimulating = previous;
+    }
+  };
+};
+
+// Like UE_LOG, but also dropped while resimulating. The compile time
+// check comes first so that compiled out messages don't even look at
+// the flag.
+#if NO_LOGGING
+#define FIGHT_LOG(CategoryName, Verbosity, Format, ...) do {} while (0)
+#else
+#define FIGHT_LOG(CategoryName, Verbosity, Format, ...)                 \
+  do {                                                                  \
+    if constexpr ((ELogVerbosity::Verbosity & ELogVerbosity::VerbosityMask) <= FLogCategory##CategoryName::CompileTimeVerbosity) { \
+      if (!FightLog::isSuppressed())                                    \
+        UE_LOG(CategoryName, Verbosity, Format, ##__VA_ARGS__);         \
+    }                                                                   \
+  } while (0)
+#endif
@@ -0,0 +1,261 @@
+#include "FightMatchPool.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformAffinity.h"
+#include "HAL/PlatformMisc.h"
+#include "Misc/ScopeLock.h"
+#include "FightLog.h"
+#include <algorithm>
+
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFight, category, TEXT("FightMatchPool " message), ##__VA_ARGS__)
+
+FightMatch::FightMatch(int _id, const FightConfig& _config, HCharacter _p1Char, HCharacter _p2Char, int delay, int _framerate): id(_id), framerate(_framerate), frameTime(1.0/_framerate), nextFrameTime(-1.0), stallStart(-1.0), cycles(0), publishedFrame(0), finished(false), publishedConfirmedFrame(-1), publishedChecksum(0), publishedP1Wins(0), publishedP2Wins(0), load(0.0), windowCycles(0), windowStart(-1.0) {
+  FightConfig c = _config;
+  c.framerate = _framerate;
+  p1Input.init(c.maxRollback, c.inputBuffer, delay, c.framerate);
+  p2Input.init(c.maxRollback, c.inputBuffer, delay, c.framerate);
+  setCharacters(_p1Char, _p2Char);
+  init(c, &p1Input, &p2Input);
+  preRound();
+}
+
+void FightMatch::submitInput(const MatchInput& input) {
+  inputs.Enqueue(input);
+}
+
+void FightMatch::applyInputs() {
+  MatchInput input;
+  while (inputs.Dequeue(input)) {
+    InputHistory& h = (input.player == 0) ? p1Input : p2Input;
+    // the network layer may hand us the same frame more than once
+    if (input.frame > h.getLastInputFrame())
+      h.packedButtons(input.state, input.frame);
+  }
+}
+
+void FightMatch::step() {
+  if (mode == LogicMode::Idle)
+    updateRoundSequence();
+  if (mode == LogicMode::Wait)
+    return;
+  if (!simulate()) {
+    MYLOG(Warning, "match %i: maximum rollback exceeded, ending it", id);
+    finished = true;
+    saveRollbackStats();
+  }
+}
+
+void FightMatch::updateStall(double now) {
+  if (!isStalled()) {
+    stallStart = -1.0;
+    return;
+  }
+  if (stallStart < 0.0)
+    stallStart = now;
+  else if ((now - stallStart) > config.disconnectTimeout) {
+    MYLOG(Warning, "match %i: no inputs for %.1f s, ending it", id, now - stallStart);
+    finished = true;
+    saveRollbackStats();
+  }
+}
+
+double FightMatch::tick(double now) {
+  const uint64 start = FPlatformTime::Cycles64();
+  if (nextFrameTime < 0.0)
+    nextFrameTime = now;
+  applyInputs();
+  int steps = 0;
+  while (!finished && (now >= nextFrameTime) && (steps < MATCH_MAX_CATCHUP_STEPS)) {
+    step();
+    nextFrameTime += frameTime;
+    ++steps;
+  }
+  if (now >= nextFrameTime)
+    nextFrameTime = now + frameTime; // too far behind; drop the rest
+  if (!finished)
+    updateStall(now);
+  publishedFrame = frame;
+  publishResult();
+
+  const uint64 used = FPlatformTime::Cycles64() - start;
+  cycles += used;
+  windowCycles += used;
+  if (windowStart < 0.0)
+    windowStart = now;
+  if ((now - windowStart) >= 1.0) {
+    load = FPlatformTime::ToSeconds64(windowCycles) / (now - windowStart);
+    windowCycles = 0;
+    windowStart = now;
+  }
+  return nextFrameTime;
+}
+
+void FightMatch::publishResult() {
+  const int i = frame - confirmedFrame;
+  if ((confirmedFrame == publishedConfirmedFrame) || (i < 0) || (i >= frames.size()))
+    return;
+  const Frame& f = frames.fromLast(i);
+  if (f.frameNumber != confirmedFrame)
+    return; // thrown away by a round start, keep the last one
+  const uint32 checksum = f.checksum();
+  FScopeLock l(&resultLock);
+  publishedConfirmedFrame = confirmedFrame;
+  publishedChecksum = checksum;
+  publishedP1Wins = p1Wins;
+  publishedP2Wins = p2Wins;
+}
+
+void FightMatch::onEndFight() {
+  finished = true;
+  saveRollbackStats();
+}
+
+void FightMatch::saveRollbackStats() {
+  FRollbackStats s = getRollbackStats();
+  s.computeRates(framerate);
+  FString fileName = FString::Printf(TEXT("match-%i-%s.csv"), id, *FDateTime::Now().ToString());
+  if (!s.save(fileName))
+    MYLOG(Warning, "match %i: could not write %s", id, *fileName);
+}
+
+int FightMatch::getId() const {
+  return id;
+}
+
+bool FightMatch::isFinished() const {
+  return finished;
+}
+
+MatchStats FightMatch::getStats(int worker) const {
+  MatchStats s;
+  s.id = id;
+  s.worker = worker;
+  s.frame = publishedFrame;
+  {
+    FScopeLock l(&resultLock);
+    s.confirmedFrame = publishedConfirmedFrame;
+    s.confirmedChecksum = publishedChecksum;
+    s.p1Wins = publishedP1Wins;
+    s.p2Wins = publishedP2Wins;
+  }
+  s.finished = finished;
+  s.cpuSeconds = FPlatformTime::ToSeconds64(cycles);
+  s.load = load;
+  return s;
+}
+
+FightMatchWorker::FightMatchWorker(int _index): index(_index), running(true) {
+}
+
+void FightMatchWorker::add(std::shared_ptr<FightMatch> match) {
+  FScopeLock l(&lock);
+  matches.push_back(match);
+}
+
+void FightMatchWorker::remove(int id) {
+  FScopeLock l(&lock);
+  matches.erase(std::remove_if(matches.begin(), matches.end(),
+                               [id](const std::shared_ptr<FightMatch>& m) { return m->getId() == id; }),
+                matches.end());
+}
+
+int FightMatchWorker::getMatchCount() {
+  FScopeLock l(&lock);
+  return matches.size();
+}
+
+uint32 FightMatchWorker::Run() {
+  while (running) {
+    double now = FPlatformTime::Seconds();
+    double nextDue = now + 0.005; // check for new matches at least this often
+    {
+      FScopeLock l(&lock);
+      for (auto& m : matches) {
+        if (!m->isFinished())
+          nextDue = std::min(nextDue, m->tick(now));
+      }
+    }
+    double wait = nextDue - FPlatformTime::Seconds();
+    if (wait > 0.0)
+      FPlatformProcess::Sleep(wait);
+  }
+  return 0;
+}
+
+void FightMatchWorker::Stop() {
+  running = false;
+}
+
+FightMatchPool::FightMatchPool(int threads_, int _framerate): framerate(_framerate), nextId(0) {
+  // affinity masks have a bit per logical CPU, not per core
+  const int cpus = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+  int n = (threads_ > 0) ? threads_ : std::max(1, cpus - 1);
+  for (int i = 0; i < n; ++i) {
+    FightMatchWorker* w = new FightMatchWorker(i);
+    workers.push_back(w);
+    // keep each worker, and so its matches, on one core
+    threads.push_back(FRunnableThread::Create(w, *FString::Printf(TEXT("FightMatchWorker%i"), i), 0, TPri_Normal,
+                                              ((uint64) 1) << (i % std::min(cpus, 64))));
+  }
+  MYLOG(Display, "started %i workers at %i frames per second", n, framerate);
+}
+
+FightMatchPool::~FightMatchPool() {
+  for (auto t : threads) {
+    t->Kill(true); // calls Stop() and waits for Run() to return
+    delete t;
+  }
+  for (auto w : workers)
+    delete w;
+}
+
+int FightMatchPool::createMatch(const FightConfig& config, int p1Char, int p2Char, int delay) {
+  FScopeLock l(&lock);
+  int id = nextId++;
+  auto match = std::make_shared<FightMatch>(id, config, HCharacter(p1Char), HCharacter(p2Char), delay, framerate);
+  int worker = 0;
+  for (int i = 1; i < (int) workers.size(); ++i) {
+    if (workers[i]->getMatchCount() < workers[worker]->getMatchCount())
+      worker = i;
+  }
+  matches[id] = {match, worker};
+  workers[worker]->add(match);
+  MYLOG(Display, "match %i on worker %i", id, worker);
+  return id;
+}
+
+bool FightMatchPool::submitInput(int id, const MatchInput& input) {
+  FScopeLock l(&lock);
+  auto i = matches.find(id);
+  if (i == matches.end())
+    return false;
+  i->second.first->submitInput(input);
+  return true;
+}
+
+void FightMatchPool::removeMatch(int id) {
+  FScopeLock l(&lock);
+  auto i = matches.find(id);
+  if (i == matches.end())
+    return;
+  workers[i->second.second]->remove(id);
+  matches.erase(i);
+}
+
+int FightMatchPool::getWorkerCount() const {
+  return workers.size();
+}
+
+int FightMatchPool::getMatchCount() {
+  FScopeLock l(&lock);
+  return matches.size();
+}
+
+std::vector<MatchStats> FightMatchPool::getStats() {
+  FScopeLock l(&lock);
+  std::vector<MatchStats> r;
+  r.reserve(matches.size());
+  for (auto& i : matches)
+    r.push_back(i.second.first->getStats(i.second.second));
+  return r;
+}
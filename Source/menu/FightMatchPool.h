@@ -0,0 +1,158 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/CriticalSection.h"
+#include "Containers/Queue.h"
+#include "FightSimulation.h"
+#include "InputHistory.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// most logic frames a match runs in one go after its worker fell
+// behind. Frames beyond that are skipped instead of making the worker
+// fall further behind on its other matches.
+#define MATCH_MAX_CATCHUP_STEPS 4
+
+// Packed input (see InputPacket) of one frame of one player of a
+// match, as recieved by the server's network layer
+class MatchInput {
+public:
+  int player; // 0 or 1
+  int frame;
+  uint8 state;
+};
+
+// What a match costs, so that a server can tell how many more it
+// fits, and where it stands
+class MatchStats {
+public:
+  int id;
+  int worker;
+  int frame;
+  // see FightSimulation::getConfirmedFrame(). The checksum and the
+  // wins are of this frame.
+  int confirmedFrame;
+  uint32 confirmedChecksum;
+  int p1Wins;
+  int p2Wins;
+  bool finished;
+  // CPU time spent ticking the match, in seconds
+  double cpuSeconds;
+  // CPU seconds per second over the last second
+  float load;
+};
+
+// A fight on a headless server. It owns its input histories and
+// frames, so matches share no state and need no locking besides the
+// input queue. Only the worker that the match belongs to ticks it.
+class FightMatch : public FightSimulation {
+public:
+  FightMatch(int _id, const FightConfig& _config, HCharacter _p1Char, HCharacter _p2Char, int delay, int _framerate);
+
+  // Queue an input for the next tick. Safe to call from any thread.
+  void submitInput(const MatchInput& input);
+
+  // Apply the queued inputs and run the logic frames that are due at
+  // `now' (FPlatformTime::Seconds()). Returns when the next frame is
+  // due.
+  double tick(double now);
+
+  int getId() const;
+  bool isFinished() const;
+  // Safe to call from any thread
+  MatchStats getStats(int worker) const;
+
+protected:
+  virtual void onEndFight() override;
+
+private:
+  int id;
+  InputHistory p1Input;
+  InputHistory p2Input;
+  TQueue<MatchInput, EQueueMode::Mpsc> inputs;
+
+  int framerate;
+  double frameTime;
+  double nextFrameTime; // < 0 until the first tick
+  double stallStart; // < 0 unless the match is stalled
+
+  // written by the worker, read by getStats()
+  std::atomic<uint64> cycles;
+  std::atomic<int> publishedFrame;
+  std::atomic<bool> finished;
+  // the confirmed frame and what goes with it, which have to be read
+  // together
+  mutable FCriticalSection resultLock;
+  int publishedConfirmedFrame;
+  uint32 publishedChecksum;
+  int publishedP1Wins;
+  int publishedP2Wins;
+  std::atomic<float> load;
+  uint64 windowCycles;
+  double windowStart;
+
+  void applyInputs();
+  void step();
+  void publishResult();
+  // end the match once it stalled for longer than the timeout
+  void updateStall(double now);
+  // write the rollback stats to a file named after the match
+  void saveRollbackStats();
+};
+
+// One thread of a FightMatchPool and the matches it ticks
+class FightMatchWorker : public FRunnable {
+public:
+  FightMatchWorker(int _index);
+
+  void add(std::shared_ptr<FightMatch> match);
+  void remove(int id);
+  int getMatchCount();
+
+  virtual uint32 Run() override;
+  virtual void Stop() override;
+
+private:
+  int index;
+  std::atomic<bool> running;
+  FCriticalSection lock;
+  std::vector<std::shared_ptr<FightMatch>> matches;
+};
+
+// Runs many FightMatches on a fixed set of threads, for a dedicated
+// server that hosts matches itself. Each match stays on the worker it
+// was given, the least busy one when it was created, so its frames and
+// inputs stay in that core's cache. The network layer feeds inputs in
+// with submitInput() and reads where the matches stand with
+// getStats().
+class FightMatchPool {
+public:
+  // threads <= 0 means one per logical CPU but one
+  FightMatchPool(int threads, int _framerate = 30);
+  ~FightMatchPool();
+
+  // Returns the id of the new match, which starts its first preround
+  // right away
+  int createMatch(const FightConfig& config, int p1Char, int p2Char, int delay);
+  // false if there is no such match
+  bool submitInput(int id, const MatchInput& input);
+  void removeMatch(int id);
+
+  int getWorkerCount() const;
+  int getMatchCount();
+  std::vector<MatchStats> getStats();
+
+private:
+  int framerate;
+  int nextId;
+  std::vector<FightMatchWorker*> workers;
+  std::vector<FRunnableThread*> threads;
+
+  FCriticalSection lock;
+  // match id -> the match and the index of its worker
+  std::unordered_map<int, std::pair<std::shared_ptr<FightMatch>, int>> matches;
+};
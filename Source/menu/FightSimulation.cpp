@@ -0,0 +1,1131 @@
+#include "FightSimulation.h"
+#include "Hitbox.h"
+#include "Box.h"
+#include "FightLog.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Crc.h"
+#include "Serialization/MemoryWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFight, category, TEXT("FightSimulation " message), ##__VA_ARGS__)
+
+void RingBuffer::reserve(int size) {
+  n = size;
+  clear();
+}
+
+void RingBuffer::clear() {
+  v.clear();
+  v.resize(n);
+  end = 0;
+  count = 0;
+}
+
+void RingBuffer::push(const Frame& x) {
+  end = end+1;
+  if (end == n) end = 0;
+  v.at(end) = x;
+  count = std::min(count+1, n);
+}
+
+const Frame& RingBuffer::last() {
+  return v.at(end);
+}
+
+const Frame& RingBuffer::fromLast(int i) const {
+  int j = end - i;
+  if (j < 0) j += n;
+  return v.at(j);
+}
+
+int RingBuffer::size() const {
+  return count;
+}
+
+void RingBuffer::popn(int m) {
+  // assumes that we don't pop off more elements than we have
+  end = end - m;
+  if (end < 0) end += n;
+  count = std::max(count - m, 0);
+}
+
+void RingBuffer::serialize(FArchive& Ar) {
+  int32 size = v.size();
+  Ar << size << end << count;
+  if (Ar.IsLoading() && ((size != n) || (end < 0) || (end >= n) || (count < 0) || (count > n))) {
+    Ar.SetError();
+    return;
+  }
+  for (auto& f : v)
+    Ar << f;
+}
+
+void RingBuffer::bind(const ActionTables& tables) {
+  for (auto& f : v) {
+    f.p1.action = tables.bind(f.p1.action);
+    f.p2.action = tables.bind(f.p2.action);
+  }
+}
+
+FArchive& operator<<(FArchive& Ar, Player& p) {
+  Ar << p.pos << p.action << p.isFacingRight << p.actionStart << p.health;
+  Ar << p.hitstun << p.knockdownVelocity << p.actionNumber;
+  return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FFightEvent& e) {
+  uint8 type = (uint8) e.type;
+  Ar << type << e.player << e.frame << e.location << e.damage;
+  if (Ar.IsLoading()) {
+    if (type > (uint8) EFightEvent::RoundEnd)
+      Ar.SetError();
+    e.type = (EFightEvent) type;
+  }
+  return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, Frame& f) {
+  Ar << f.p1 << f.p2 << f.hitstop << f.pushbackPerFrame << f.hitPlayer << f.frameNumber;
+  Ar << f.numEvents;
+  if (Ar.IsLoading() && ((f.numEvents < 0) || (f.numEvents > FRAME_MAX_EVENTS))) {
+    Ar.SetError();
+    f.numEvents = 0;
+  }
+  for (int i = 0; i < f.numEvents; ++i)
+    Ar << f.events[i];
+  return Ar;
+}
+
+void Frame::addEvent(int frame, EFightEvent type, int player, int damage) {
+  if (numEvents == FRAME_MAX_EVENTS)
+    return;
+  FFightEvent& e = events[numEvents++];
+  e.type = type;
+  e.player = player;
+  e.frame = frame;
+  e.location = (player == 1) ? p2.pos : p1.pos;
+  e.damage = damage;
+}
+
+uint32 Frame::checksum() const {
+  Frame copy(*this);
+  TArray<uint8> bytes;
+  FMemoryWriter w(bytes);
+  w << copy;
+  return FCrc::MemCrc32(bytes.GetData(), bytes.Num());
+}
+
+// if aFacingRight is true, then flip box b. Else, flip box a
+bool Box::collides(const Box& b, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
+  float ax = x, axend = xend;
+  float bx = b.x, bxend = b.xend;
+  if (!aFacingRight) {
+    ax *= -1;
+    axend *= -1;
+    std::swap(ax, axend);
+  }
+  if (!bFacingRight) {
+    bx *= -1;
+    bxend *= -1;
+    std::swap(bx, bxend);
+  }
+  //MYLOG(Display, "Box collides(): (x %f y %f xend %f yend %f) (x %f y %f xend %f yend %f), (offsetax %f offset ay %f offsetbx %f offsetby %f)", ax, y, axend, yend, bx, b.y, bxend, b.yend, offsetax, offsetay, offsetbx, offsetby);
+  return
+    // TODO: i think some of these can be removed since ax<axend an bx<bxend
+    !(((ax+offsetax) < (bx+offsetbx)) &&
+      ((axend+offsetax) < (bx+offsetbx))) &&
+    !(((ax+offsetax) > (bxend+offsetbx)) &&
+      ((axend+offsetax) > (bxend+offsetbx))) &&
+    !(((y+offsetay) < (b.y+offsetby)) &&
+      ((yend+offsetay) < (b.y+offsetby))) &&
+    !(((y+offsetay) > (b.yend+offsetby)) &&
+      ((yend+offsetay) > (b.yend+offsetby)));
+}
+
+float Box::collisionExtent(const Box& b, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
+  float ax = x, axend = xend;
+  float bx = b.x, bxend = b.xend;
+  if (!aFacingRight) {
+    ax *= -1;
+    axend *= -1;
+    std::swap(ax, axend);
+  }
+  if (!bFacingRight) {
+    bx *= -1;
+    bxend *= -1;
+    std::swap(bx, bxend);
+  }
+  ax = ax+offsetax;
+  axend = axend+offsetax;
+  bx = bx+offsetbx;
+  bxend = bxend+offsetbx;
+  if (!(((y+offsetay) < (b.y+offsetby)) &&
+        ((yend+offsetay) < (b.y+offsetby))) &&
+      !(((y+offsetay) > (b.yend+offsetby)) &&
+        ((yend+offsetay) > (b.yend+offsetby)))) {
+    // boxes overlap on y axis
+    if (axend < bx) {
+      // no overlap on x axis
+      return 0.0;
+    }
+    else if (ax > bxend) {
+      // no overlap on x axis
+      return 0.0;
+    }
+    else if (ax <= bx) {
+      if (axend >= bxend) {
+        // B is inside A; move left/right based on centers
+        if ((bx+bxend) <= (ax+axend))
+          return bx-axend;
+        else
+          return ax-bxend;
+      }
+      else
+        // A overlaps the left side of B; suggest move A left
+        return bx-axend;
+    }
+    else if (axend >= bxend) {
+      // A overlaps the right side of B; suggest move A right
+      return bxend-ax;
+    }
+    else /* (ax < bx) && (axend < bxend) */ {
+      // A is inside B; move left/right based on centers
+      if ((bx+bxend) <= (ax+axend))
+        return bx-axend;
+      else
+        return ax-bxend;
+    }
+  }
+  else {
+    // no overlap on y axis
+    return 0.0;
+  }
+}
+
+hitbox_pair Hitbox::make_pair(int endFrame, std::vector<Box> boxes) {
+  return std::make_pair(endFrame, boxes);
+}
+
+Hitbox::Hitbox(std::vector<Box> _boxes) {
+  boxes = std::vector({Hitbox::make_pair(std::numeric_limits<int>::max(), _boxes)});
+}
+
+const std::vector<Box>* Hitbox::at(int frame) const {
+  // scan through boxes for the last pair that starts at or before
+  // frame, and return the corresponding vector
+  auto i =
+    find_if(boxes.begin(),
+            boxes.end(),
+            [frame](std::pair<int, std::vector<Box>> x){
+              return x.first >= frame;
+            });
+  if (i == boxes.end())
+    return nullptr;
+  else
+    return &(i->second);
+}
+
+// - b: other hitbox we are checking for collision with
+// - aframe: frame of our hitboxes to check for collision
+// - bframe: frame of b's hitboxes to check for collision
+bool Hitbox::collides(const Box& b, int aframe, int bframe, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
+  const std::vector<Box>* aboxes = at(aframe);
+  if (!aboxes) // at least one box is empty; no collision
+    return false;
+  for (auto& abox: *aboxes) {
+    if (abox.collides(b, offsetax, offsetay, offsetbx, offsetby, aFacingRight, bFacingRight))
+      return true;
+  }
+  return false;
+}
+
+// - b: other hitbox we are checking for collision with
+// - aframe: frame of our hitboxes to check for collision
+// - bframe: frame of b's hitboxes to check for collision
+bool Hitbox::collides(const Hitbox& b, int aframe, int bframe, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
+  const std::vector<Box>* aboxes = at(aframe);
+  const std::vector<Box>* bboxes = b.at(bframe);
+  if (!(aboxes && bboxes)) // at least one box is empty; no collision
+    return false;
+  for (auto& abox: *aboxes) {
+    for (auto& bbox: *bboxes) {
+      if (abox.collides(bbox, offsetax, offsetay, offsetbx, offsetby, aFacingRight, bFacingRight))
+        return true;
+    }
+  }
+  return false;
+}
+
+void Player::startNewAction(int frame, HAction newAction, bool isOnLeft) {
+  actionNumber++;
+  action = newAction;
+  actionStart = frame;
+  isFacingRight = isOnLeft;
+}
+
+void Player::TryStartingNewAction(int frame, InputHistory& input, bool isOnLeft) {
+  if (hitstun != 0) {
+    if ((frame - actionStart) == action.animationLength())
+      ++actionStart;
+  }
+  else {
+    if (action.type() == ActionType::Thrown) {
+      if ((frame - actionStart) == action.animationLength()) {
+        float knockdownVelocityp = knockdownVelocity;
+        doKdAction(frame, isOnLeft, knockdownVelocityp);
+      }
+    }
+    else {
+      if (frame - actionStart >= action.specialCancelFrames()) {
+        HAction newAction = input.action(action, isOnLeft, frame, actionStart);
+        // don't interrupt current action if the new action is just an idle unless we are walking
+        if (!((action.isWalkOrIdle() &&
+               (newAction == action) &&
+               (frame - actionStart < action.animationLength())) ||
+              (!action.isWalkOrIdle() &&
+               (newAction.type() == ActionType::Idle) &&
+               (frame - actionStart < action.animationLength())))) {
+          startNewAction(frame, newAction, isOnLeft);
+        }
+        // do update player direction if we are merely continuing
+        // walk/idle
+        else if (action.isWalkOrIdle() &&
+                 (newAction == action) &&
+                 (frame - actionStart < action.animationLength())) {
+          isFacingRight = isOnLeft;
+        }
+      }
+    }
+  }
+}
+
+void Player::doDamagedAction(int frame) {
+  // do not use startNewAction becauset we don't want to increment
+  // actionStart
+  action = action.character().damaged();
+  actionStart = frame;
+}
+
+void Player::doBlockAction(int frame) {
+  // do not use startNewAction becauset we don't want to increment
+  // actionStart
+  action = action.character().block();
+  actionStart = frame;
+}
+
+void Player::doKdAction(int frame, bool isOnLeft, float knockdownDistance) {
+  knockdownVelocity = knockdownDistance / action.getTables().knockdownAirborneFrames();
+  startNewAction(frame, action.character().kd(), isOnLeft);
+}
+
+void Player::doThrownAction(int frame, bool isOnLeft, float knockdownDistance, HAction newAction, Player& q) {
+  hitstun = 0;
+  startNewAction(frame, newAction, isOnLeft);
+  knockdownVelocity = knockdownDistance;
+  // base frame 1 of the throw, which starts this many frames in
+  const ActionTables& t = action.getTables();
+  pos = q.pos + (isOnLeft ? -1 : 1) * t.thrownBoxerPosition(t.scale.frames(1));
+}
+
+void Player::doMotion(int targetFrame) {
+  const ActionTables& t = action.getTables();
+  pos += (isFacingRight ? 1 : -1) * action.velocity();
+  if (action.type() == ActionType::Jump) {
+    pos.Z = 5*t.jumpHeight(targetFrame - actionStart);
+  }
+  if (action.type() == ActionType::Thrown) {
+    // one base frame ahead, like doThrownAction()
+    const int i = targetFrame - actionStart + t.scale.frames(1);
+    pos += (isFacingRight ? -1 : 1) * (t.thrownBoxerPosition(i) - t.thrownBoxerPosition(i-1));
+  }
+  if (action.type() == ActionType::KD) {
+    if ((targetFrame - actionStart) < t.knockdownAirborneFrames()) {
+      pos.Z = t.knockdownAirborneHeight(targetFrame - actionStart);
+      pos.Y += (isFacingRight ? -1 : 1) * knockdownVelocity;
+    }
+  }
+}
+
+struct PlayerDamageResult {
+  bool hit = false;
+  bool blocking = false;
+  bool grabbed = false;
+  int damage = 0;
+  float knockdownDistance = -1;
+  float pushbackDistance = 0;
+};
+
+static bool playerIsInvincible(Player& p, Player &q) {
+  return (p.action.type() == ActionType::KD) || ((p.action.type() == ActionType::DamageReaction) && (p.actionNumber == q.actionNumber));
+}
+
+// returns the amount of correction needed to move player out of the bound
+float Player::collidesWithBoundary(float boundary, bool isRightBound, int targetFrame) {
+  const Box& b = action.collision(targetFrame);
+  float x = b.x, xend = b.xend;
+  if (!isFacingRight) {
+    x *= -1;
+    xend *= -1;
+    std::swap(x, xend);
+  }
+  x += pos.Y;
+  xend += pos.Y;
+  if (isRightBound && (xend > boundary)) {
+    return boundary-xend;
+  }
+  else if (!isRightBound && (x < boundary)) {
+    return boundary-x;
+  }
+  else {
+    return 0.0;
+  }
+}
+
+static bool collides(const Hitbox &p1b, const Hitbox &p2b, const Player &p1, const Player& p2, int targetFrame) {
+  return p1b.collides(p2b,
+                      targetFrame - p1.actionStart,
+                      targetFrame - p2.actionStart,
+                      p1.pos.Y, p1.pos.Z,
+                      p2.pos.Y, p2.pos.Z,
+                      p1.isFacingRight,
+                      p2.isFacingRight);
+}
+
+// returns the amount of adjustment player P needs
+float FightSimulation::playerCollisionExtent(const Player &p, const Player &q, int targetFrame) {
+  if ((p.action.type() == ActionType::Thrown) ||
+        (q.action.type() == ActionType::Thrown) ||
+        ((p.action.type() == ActionType::KD) && (frame - p.actionStart) < tables->knockdownAirborneFrames()) ||
+        ((q.action.type() == ActionType::KD) && (frame - q.actionStart) < tables->knockdownAirborneFrames())) {
+    return 0.0;
+  }
+  else {
+    const Box &pb = p.action.collision(targetFrame);
+    const Box &qb = q.action.collision(targetFrame);
+    return qb.collisionExtent(pb, p.pos.Y, p.pos.Z, q.pos.Y, q.pos.Z, p.isFacingRight, q.isFacingRight);
+  }
+}
+
+static void computeDamage(Player& q, Player &p, InputHistory& qInput, const Frame& newFrame, int targetFrame, bool isOnLeft, struct PlayerDamageResult &r) {
+  const float chipDamageMultiplier = 0.1;
+  if (collides(p.action.hitbox(), q.action.hurtbox(), p, q, targetFrame) ||
+      collides(p.action.hitbox(), Hitbox({q.action.collision(targetFrame)}), p, q, targetFrame)) {
+    // hit q
+    if (p.action.type() == ActionType::Grab) {
+      r.grabbed = true;
+      r.knockdownDistance = p.action.knockdownDistance();
+    }
+    else {
+      r.hit = true;
+      q.actionNumber = p.actionNumber;
+      q.hitstun = p.action.lockedFrames() - (targetFrame-p.actionStart) - 1;
+      r.damage = p.action.damage();
+      r.pushbackDistance = p.action.pushbackDistance();
+      enum GuardLevel qGuard = qInput.isGuarding(isOnLeft, targetFrame);
+      if ((q.action.type() != ActionType::Jump) &&
+          (q.action != q.action.character().damaged()) &&
+          ((qGuard == GuardLevel::Low) ||
+           (qGuard == GuardLevel::High) && (!q.action.hitsWalkingBack()))) {
+        r.blocking = true;
+        if (p.action.blockAdvantage() >= 0)
+          q.hitstun += p.action.blockAdvantage();
+        else
+          p.hitstun -= p.action.blockAdvantage();
+        q.health -= r.damage * chipDamageMultiplier; // chip damage
+      }
+      else {
+        if (p.action.hitAdvantage() >= 0)
+          q.hitstun += p.action.hitAdvantage();
+        else
+          p.hitstun -= p.action.hitAdvantage();
+        q.health -= r.damage;
+        r.knockdownDistance = p.action.knockdownDistance();
+      }
+    }
+  }
+}
+
+static void addDamageEvents(Frame& f, const PlayerDamageResult& r, int targetFrame, int player) {
+  if (!r.hit)
+    return;
+  f.addEvent(targetFrame, r.blocking ? EFightEvent::Block : EFightEvent::Hit, player, r.damage);
+  if (!r.blocking && (r.knockdownDistance >= 0))
+    f.addEvent(targetFrame, EFightEvent::Knockdown, player);
+}
+
+// like roundWinner(), for a frame that isn't in the buffer yet
+static int winner(const Frame& f) {
+  if (f.p2.health < f.p1.health)
+    return 0;
+  else if (f.p1.health < f.p2.health)
+    return 1;
+  else
+    return 2;
+}
+
+static void doDamageReaction(Player &p, PlayerDamageResult &r, int targetFrame, bool isOnLeft) {
+  if (r.hit) {
+    p.pos.Z = 0;
+    if (r.blocking) {
+      p.doBlockAction(targetFrame);
+    }
+    else {
+      if (r.knockdownDistance >= 0)
+        p.doKdAction(targetFrame, isOnLeft, r.knockdownDistance);
+      else
+        p.doDamagedAction(targetFrame);
+    }
+  }
+}
+
+void FightSimulation::HandlePlayerBoundaryCollision(Frame &f, int targetFrame, bool doRightBoundary) {
+  float stageBound = doRightBoundary ? config.stageBoundRight : config.stageBoundLeft;
+  float p1CollisionAdj = f.p1.collidesWithBoundary(stageBound, doRightBoundary, targetFrame);
+  float p2CollisionAdj = f.p2.collidesWithBoundary(stageBound, doRightBoundary, targetFrame);
+  f.p1.pos.Y += p1CollisionAdj;
+  f.p2.pos.Y += p2CollisionAdj;
+  if ((p1CollisionAdj != 0.0) && (p2CollisionAdj == 0.0)) {
+    // if p2 collides with p1, also move p2
+    float collisionAdj = playerCollisionExtent(f.p2, f.p1, targetFrame);
+    //f.p2.pos.Y += collisionAdj;
+    // MYLOG(Display, "HandlePlayerBoundaryCollision: p1 collides with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
+  }
+  if ((p2CollisionAdj != 0.0) && (p1CollisionAdj == 0.0)) {
+    // if p1 collides with p2, also move p1
+    float collisionAdj = playerCollisionExtent(f.p1, f.p2, targetFrame);
+    f.p1.pos.Y += collisionAdj;
+    //MYLOG(Display, "p2 collides with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
+  }
+  else if ((p1CollisionAdj != 0.0) && (p2CollisionAdj != 0.0)) {
+    // at least one player must be jumping. Let the leftmost player
+    // take the corner
+    float collisionAdj;
+    if (doRightBoundary) {
+      collisionAdj = std::min(p1CollisionAdj, p2CollisionAdj);
+    }
+    else {
+      collisionAdj = std::max(p1CollisionAdj, p2CollisionAdj);
+    }
+    f.p1.pos.Y += collisionAdj;
+    f.p2.pos.Y += collisionAdj;
+    //MYLOG(Display, "p1 and p2 collide with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
+  }
+}
+
+FightSimulation::FightSimulation(): tables(nullptr), p1History(nullptr), p2History(nullptr), frame(0) {
+}
+
+void FightSimulation::init(const FightConfig& _config, InputHistory* _p1History, InputHistory* _p2History) {
+  config = _config;
+  scale = FrameScale(config.framerate);
+  tables = &ActionTables::forRate(config.framerate);
+  p1History = _p1History;
+  p2History = _p2History;
+
+  frames = RingBuffer();
+  frames.reserve(config.maxRollback+1);
+
+  pendingDelay = p1History->getDelay();
+  pendingDelayRound = -1;
+  roundDelays.Reset();
+  waitingForDelay = false;
+
+  mode = LogicMode::Wait;
+  inPreRound = false;
+  inEndRound = false;
+  roundEndFrame = std::numeric_limits<int>::max();
+  frame = 0;
+  rolledBackFrames = 0;
+  confirmedFrame = 0;
+  rollbackStats.reset(config.maxRollback);
+  reset(false);
+
+  roundNumber = 0;
+  p1Wins = 0;
+  p2Wins = 0;
+}
+
+void FightSimulation::setCharacters(HCharacter _p1Char, HCharacter _p2Char) {
+  p1Char = _p1Char;
+  p2Char = _p2Char;
+}
+
+void FightSimulation::reset(bool flipSpawns) {
+  p1History->reset();
+  p2History->reset();
+  // construct initial frame
+  p1Char = tables->bind(p1Char);
+  p2Char = tables->bind(p2Char);
+  Frame f (Player(flipSpawns ? config.rightStart : config.leftStart, p1Char.idle()), Player(flipSpawns ? config.leftStart : config.rightStart, p2Char.idle()));
+  f.frameNumber = frame;
+  f.p1.isFacingRight = IsP1OnLeft(f);
+  f.p2.isFacingRight = !IsP1OnLeft(f);
+  frames.clear();
+  frames.push(f);
+  // the frames are gone and won't be resimulated, so the events we
+  // dispatched for them stand
+  dispatchedEvents.Reset();
+}
+
+void FightSimulation::setMode(enum LogicMode m) {
+  mode = m;
+  p1History->setMode(m);
+  p2History->setMode(m);
+}
+
+void FightSimulation::preRound() {
+  MYLOG(Display, "preRound");
+  if (!config.skipPreRound) {
+    setMode(LogicMode::Idle);
+    inPreRound = true;
+    roundStartFrame = ((roundEndFrame == std::numeric_limits<int>::max()) ? 0 : roundEndFrame) + scale.frames(ENDROUND_TIME) + scale.frames(PREROUND_TIME);
+    MYLOG(Display, "preRound %i", roundStartFrame);
+  }
+  ++roundNumber;
+  if (roundNumber < roundDelays.Num()) {
+    // a spectator that joined late replays the delays the host used
+    p1History->setDelay(roundDelays[roundNumber]);
+    p2History->setDelay(roundDelays[roundNumber]);
+  }
+  else if (pendingDelayRound == roundNumber) {
+    MYLOG(Display, "preRound: input delay %i", pendingDelay);
+    p1History->setDelay(pendingDelay);
+    p2History->setDelay(pendingDelay);
+  }
+  roundDelays.SetNum(std::max(roundDelays.Num(), roundNumber+1));
+  roundDelays[roundNumber] = p1History->getDelay();
+  reset(bool((roundNumber+1)%2));
+  roundEndFrame = std::numeric_limits<int>::max();
+  rollbackStopFrame = frame;
+  if (config.skipPreRound)
+    beginRound();
+  else
+    onPreRound();
+}
+
+void FightSimulation::beginRound() {
+  MYLOG(Display, "beginRound");
+  rollbackStopFrame = frame;
+  setMode(LogicMode::Fight);
+  onBeginRound();
+}
+
+void FightSimulation::endRound() {
+  MYLOG(Display, "endRound %i", roundEndFrame);
+  setMode(LogicMode::Idle);
+  inEndRound = true;
+  roundTimeTotal = roundEndFrame - roundStartFrame;
+  roundStartFrame = roundEndFrame+scale.frames(ENDROUND_TIME);
+  rollbackStopFrame = roundEndFrame; // we need this because when we
+                                     // set the inputs to idle, a
+                                     // rollback could result in an
+                                     // attack turning into an idle.
+  onEndRound();
+}
+
+void FightSimulation::endFight() {
+  MYLOG(Display, "endFight");
+  setMode(LogicMode::Wait);
+  onEndFight();
+}
+
+void FightSimulation::updateRoundSequence() {
+  if (inPreRound && (frame >= (roundStartFrame-1))) {
+    if (frame > (roundStartFrame-1)) {
+      frames.popn(frame - (roundStartFrame-1));
+      frame = (roundStartFrame-1);
+      // TODO: we rewind FRAME here but this actually messes up
+      // AFightPlayerController::sendButtons(), which will put the
+      // buttons that belong on a later frame to the roundStartFrame
+      // instead
+    }
+    inPreRound = false;
+    beginRound();
+  }
+  if (inEndRound && (frame >= (roundStartFrame-1))) {
+    // if (frame > (roundStartFrame-1)) {
+    //   frames.popn(frame - (roundStartFrame-1));
+    //   frame = (roundStartFrame-1);
+    // }
+    // simulate() holds the frame here until we start the round
+    if (!hasRoundDelay(roundNumber+1)) {
+      if (!waitingForDelay)
+        MYLOG(Warning, "updateRoundSequence: no input delay from the host for round %i yet, holding it", roundNumber+1);
+      waitingForDelay = true;
+      return;
+    }
+    waitingForDelay = false;
+    inEndRound = false;
+    // nothing after roundEndFrame reads inputs, so these frames are
+    // final, and reset() is about to throw them away
+    confirmFrames(frame);
+    preRound();
+  }
+}
+
+bool FightSimulation::hasRoundDelay(int round) const {
+  return !config.roundDelayFromHost || (round < roundDelays.Num()) || (pendingDelayRound == round);
+}
+
+bool FightSimulation::IsPlayerOnLeft(const Player& p1, const Player& p2) {
+  return p1.pos.Y <= p2.pos.Y;
+}
+
+bool FightSimulation::IsP1OnLeft(const Frame& f) {
+  return IsPlayerOnLeft(f.p1, f.p2);
+}
+
+// the targetFrame field is required for using the right inputs from
+// AFightInputs. The frame buffer's latest frame should be the one
+// just before the targetFrame.
+void FightSimulation::computeFrame(int targetFrame) {
+  const Frame& lastFrame = frames.last();
+
+  // make a copy of the most recent frame. we will update the values
+  // in this newFrame and keep the last one.
+  Frame newFrame (lastFrame);
+  newFrame.numEvents = 0;
+  Player& p1 = newFrame.p1;
+  Player& p2 = newFrame.p2;
+
+  // If the player can act and there is a new action waiting, then
+  // start the new action
+  bool isP1OnLeft = IsP1OnLeft(newFrame);
+  // first do damage if they are leaving a thrown action
+  if ((p1.action.type() == ActionType::Thrown) && ((targetFrame - p1.actionStart) == p1.action.animationLength()))
+    p1.health -= p2.action.damage();
+  if ((p2.action.type() == ActionType::Thrown) && ((targetFrame - p2.actionStart) == p2.action.animationLength()))
+    p2.health -= p1.action.damage();
+  if ((targetFrame <= roundEndFrame) && (newFrame.hitstop == 0)) {
+    p1.TryStartingNewAction(targetFrame, *p1History, isP1OnLeft);
+    p2.TryStartingNewAction(targetFrame, *p2History, !isP1OnLeft);
+  }
+
+  // compute player positions (if they are in a moving action). This
+  // includes checking collision boxes and not letting players walk
+  // out of bounds.
+  FVector oldP1Posv = p1.pos,
+    oldP2Posv = p2.pos;
+  double oldP1Pos = p1.pos.Y,
+    oldP2Pos = p2.pos.Y,
+    oldPos = (oldP1Pos + oldP2Pos)/2;
+  p1.doMotion(targetFrame);
+  p2.doMotion(targetFrame);
+  if (std::abs(p1.pos.Y - p2.pos.Y) > 121.0) {
+    if (std::abs(p1.pos.Y - oldPos) > std::abs(oldP1Pos - oldPos)) {
+      p1.pos = oldP1Posv;
+    }
+    if (std::abs(p2.pos.Y - oldPos) > std::abs(oldP2Pos - oldPos)) {
+      p2.pos = oldP2Posv;
+    }
+  }
+  // recompute who is on left, useful in the case of a jumping cross
+  // up
+  isP1OnLeft = IsP1OnLeft(newFrame);
+
+  // check for player-player collisions
+  float collisionAdj = playerCollisionExtent(p1, p2, targetFrame);
+  if (collisionAdj != 0.0) {
+    float p1CollisionAdj = 0.5 * collisionAdj;
+    float p2CollisionAdj = -0.5 * collisionAdj;
+    if (p1.pos.Y == p2.pos.Y) {
+      // players are on top of eachother; move the higher player in
+      // their current velocity direction
+      int direction = (p1.action.velocity().Y > 0) ? 1 : -1;
+      p1CollisionAdj = direction * std::abs(p1CollisionAdj);
+      p2CollisionAdj = -1 * direction * std::abs(p2CollisionAdj);
+    }
+    p1.pos.Y += p1CollisionAdj;
+    p2.pos.Y += p2CollisionAdj;
+    // if (!(((p1v.Y > 0) && (p2v.Y > 0)) ||
+    //       ((p1v.Y < 0) && (p2v.Y < 0)))) {
+    //   // players are moving into eachother. dampen how much they push
+    //   // eachother by moving them back closer to where they were on
+    //   // the previous frame
+    //   float newMean = p1.pos.Y + p2.pos.Y;
+    //   float oldMean = frames.last().p1.pos.Y + frames.last().p2.pos.Y;
+    //   float meanAdj = 0.25 * (oldMean-newMean);
+    //   p1.pos.Y += meanAdj;
+    //   p2.pos.Y += meanAdj;
+    // }
+  }
+
+  // check for player-boundary collisions, not preserving spacing
+  HandlePlayerBoundaryCollision(newFrame, targetFrame, false);
+  HandlePlayerBoundaryCollision(newFrame, targetFrame, true);
+  isP1OnLeft = IsP1OnLeft(newFrame);
+
+  // check hitboxes, compute damage. Don't forget the case of ties.
+  //MYLOG(Display, "hitstop %i", newFrame.hitstop);
+  if (newFrame.hitstop == 0) { // only check hitboxes if we are not in hitstop
+    // first do hitstun if we are in hitstun
+    if (p1.hitstun) --p1.hitstun;
+    if (p2.hitstun) --p2.hitstun;
+
+    if (!(playerIsInvincible(p1, p2) || playerIsInvincible(p2, p1))) {
+      struct PlayerDamageResult p1Damage, p2Damage;
+      computeDamage(p1, p2, *p1History, newFrame, targetFrame, isP1OnLeft, p1Damage);
+      computeDamage(p2, p1, *p2History, newFrame, targetFrame, !isP1OnLeft, p2Damage);
+      if (p1Damage.hit || p2Damage.hit)
+        p1Damage.grabbed = p2Damage.grabbed = false; // grabs lose to attacks
+
+      doDamageReaction(p1, p1Damage, targetFrame, isP1OnLeft);
+      doDamageReaction(p2, p2Damage, targetFrame, !isP1OnLeft);
+      addDamageEvents(newFrame, p1Damage, targetFrame, 0);
+      addDamageEvents(newFrame, p2Damage, targetFrame, 1);
+      if (p1Damage.hit) {
+        newFrame.hitPlayer = 1;
+        MYLOG(Verbose, "P1 Hit %i", p1.health);
+      }
+      if (p2Damage.hit) {
+        newFrame.hitPlayer = 2;
+        MYLOG(Verbose, "P2 Hit %i", p2.health);
+      }
+      if (p1Damage.grabbed && p2Damage.grabbed) {
+        // both players grabbed at same time; no tech animation so just
+        // do block animation with pushback
+        p1.doBlockAction(targetFrame);
+        p2.doBlockAction(targetFrame);
+        newFrame.hitstop = scale.frames(10);
+        newFrame.pushbackPerFrame = scale.perFrame(3.0);
+      }
+      else if (p1Damage.hit || p2Damage.hit) {
+        newFrame.hitstop = scale.frames(std::max(1, (int) (std::ceil(std::sqrt(std::max(p1Damage.damage, p2Damage.damage))+0.0))));
+        newFrame.pushbackPerFrame = (p1Damage.pushbackDistance + p2Damage.pushbackDistance) / newFrame.hitstop;
+      }
+      if ((p1Damage.hit && p2Damage.hit) || (p1Damage.grabbed && p2Damage.grabbed)) {
+        newFrame.hitPlayer = 0;
+        // add the hitstop because we won't do real hitstop when ties
+        // happen, only pushback
+        p1.hitstun += newFrame.hitstop;
+        p2.hitstun += newFrame.hitstop;
+      }
+      if (!(p1Damage.grabbed && p2Damage.grabbed)) {
+        if (p1Damage.grabbed) {
+          p1.doThrownAction(targetFrame, isP1OnLeft, p1Damage.knockdownDistance, p1.action.character().thrown(), p2);
+          p2.startNewAction(targetFrame, p2.action.character().throw_(), !isP1OnLeft);
+          newFrame.addEvent(targetFrame, EFightEvent::Throw, 0, p2.action.damage());
+        }
+        if (p2Damage.grabbed) {
+          p1.startNewAction(targetFrame, p1.action.character().throw_(), isP1OnLeft);
+          p2.doThrownAction(targetFrame, !isP1OnLeft, p2Damage.knockdownDistance, p2.action.character().thrown(), p1);
+          newFrame.addEvent(targetFrame, EFightEvent::Throw, 1, p1.action.damage());
+        }
+      }
+    }
+  }
+  else { // we are in hitstop
+    // keep the attacking player frozen, do pushback, keep players in bounds
+    if ((newFrame.hitPlayer == 1) || (newFrame.hitPlayer == 0)) {
+      // do pushback
+      p1.pos.Y += (isP1OnLeft ? -1 : 1) * newFrame.pushbackPerFrame;
+    }
+    if ((newFrame.hitPlayer == 2) || (newFrame.hitPlayer == 0)) {
+      // do pushback
+      p2.pos.Y += (!isP1OnLeft ? -1 : 1) * newFrame.pushbackPerFrame;
+    }
+    // this causes the freeze on the players' animations
+    ++p2.actionStart;
+    ++p1.actionStart;
+
+    // put players back in bounds, preserving spacing
+    Player& pleft = isP1OnLeft ? p1 : p2;
+    Player& pright = !isP1OnLeft ? p1 : p2;
+    int collisionExtent = pleft.collidesWithBoundary(config.stageBoundLeft, false, targetFrame);
+    p1.pos.Y += collisionExtent;
+    p2.pos.Y += collisionExtent;
+    collisionExtent = pright.collidesWithBoundary(config.stageBoundRight, true, targetFrame);
+    p1.pos.Y += collisionExtent;
+    p2.pos.Y += collisionExtent;
+
+    --newFrame.hitstop;
+  }
+
+#define ROUND_TIME 99
+
+  if (!inEndRound) {
+    if (targetFrame <= roundEndFrame) {
+      // if we are not past the end of the round
+      if (((targetFrame - roundStartFrame)/config.framerate) == ROUND_TIME) {
+        // time out
+        roundEndFrame = targetFrame;
+        newFrame.addEvent(targetFrame, EFightEvent::RoundEnd, winner(newFrame));
+      }
+      else if ((p1.health <= 0) || (p2.health <= 0)) {
+        if (p1.health <= 0) {
+          p1.health = 0;
+          if (p1.action.type() != ActionType::KD)
+            p1.knockdownVelocity = scale.perFrame(2.3);
+          p1.startNewAction(targetFrame, p1.action.character().defeat(), isP1OnLeft);
+        }
+        if (p2.health <= 0){
+          p2.health = 0;
+          if (p2.action.type() != ActionType::KD)
+            p2.knockdownVelocity = scale.perFrame(2.3);
+          p2.startNewAction(targetFrame, p2.action.character().defeat(), !isP1OnLeft);
+        }
+        // round ended; update roundEndFrame. this could be the first
+        // time we set it or it could be setting it to an earlier time
+        roundEndFrame = targetFrame;
+        newFrame.addEvent(targetFrame, EFightEvent::RoundEnd, winner(newFrame));
+      }
+      else
+        // round did not end on roundEndFrame; unset it. This includes
+        // a rollback to exactly roundEndFrame that no longer ends it.
+        roundEndFrame = std::numeric_limits<int>::max();
+    }
+    if (p1History->hasRecievedInputForFrame(roundEndFrame) && p2History->hasRecievedInputForFrame(roundEndFrame)) {
+      // don't actually end round until players are synced up to round
+      // end
+      if (roundWinner() == 0)
+        ++p1Wins;
+      else if (roundWinner() == 1)
+        ++p2Wins;
+      else { // ties give win to both players
+        ++p1Wins;
+        ++p2Wins;
+      }
+      if ((p1Wins == 2) || (p2Wins == 2))
+        endFight();
+      else
+        endRound();
+    }
+  }
+
+  newFrame.frameNumber = frame;
+  frames.push(newFrame);
+}
+
+// frames that were simulated with a mispredicted input of `input'
+// before the rollback to rollbackToFrame
+static int mispredictedFrames(InputHistory& input, int rollbackToFrame, int frame) {
+  if (!input.needsRollback())
+    return 0;
+  return std::max(0, frame - std::max(input.getNeedsRollbackToFrame(), rollbackToFrame) + 1);
+}
+
+static float decodeCacheHitRate(const InputHistory& input) {
+  int total = input.getDecodeCacheHits() + input.getDecodeCacheMisses();
+  return (total == 0) ? 0.0 : ((float) input.getDecodeCacheHits()) / total;
+}
+
+int FightSimulation::getInputConfirmedFrame() const {
+  // the inputs of frame f are used on frame f+delay
+  int inputFrame = std::min(p1History->getLastInputFrame() + p1History->getDelay(),
+                            p2History->getLastInputFrame() + p2History->getDelay());
+  // we never roll back past rollbackStopFrame anyway
+  return std::max(inputFrame, rollbackStopFrame);
+}
+
+int FightSimulation::getLastPredictableFrame() const {
+  // The next input we are missing is for the first frame after the
+  // confirmed one, and we can roll back to it as long as we are less
+  // than maxRollback frames past it.
+  return getInputConfirmedFrame() + config.maxRollback;
+}
+
+int FightSimulation::getConfirmedFrame() const {
+  return confirmedFrame;
+}
+
+void FightSimulation::dispatchEvents() {
+  // newest frame first
+  currentEvents.Reset();
+  for (int i = 0; i < frames.size(); ++i) {
+    const Frame& f = frames.fromLast(i);
+    if (f.frameNumber <= confirmedFrame)
+      break;
+    for (int j = f.numEvents-1; j >= 0; --j)
+      currentEvents.Add(f.events[j]);
+  }
+  for (const FFightEvent& e : dispatchedEvents)
+    if ((e.frame > confirmedFrame) && !currentEvents.Contains(e))
+      onFightEventCancelled(e);
+  for (int i = currentEvents.Num()-1; i >= 0; --i)
+    if (!dispatchedEvents.Contains(currentEvents[i]))
+      onFightEvent(currentEvents[i]);
+  // oldest frame first, like we dispatched them
+  dispatchedEvents.Reset();
+  for (int i = currentEvents.Num()-1; i >= 0; --i)
+    dispatchedEvents.Add(currentEvents[i]);
+}
+
+void FightSimulation::confirmFrames(int upTo) {
+  dispatchEvents();
+  while (confirmedFrame < upTo) {
+    ++confirmedFrame;
+    onFrameConfirmed(confirmedFrame);
+  }
+}
+
+bool FightSimulation::isStalled() const {
+  return frame >= getLastPredictableFrame();
+}
+
+bool FightSimulation::simulate(int lastFrame) {
+  int latestInputFrame = std::max(p1History->getCurrentFrame(), p2History->getCurrentFrame());
+  int targetFrame = std::max(latestInputFrame, frame+1);
+  const int lastPredictableFrame = getLastPredictableFrame();
+
+  if (config.alwaysRollback || p1History->needsRollback() || p2History->needsRollback()) {
+    if (!config.alwaysRollback) {
+      MYLOG(Verbose, "Rollback");
+    }
+    // rollbackToFrame is the frame of the input new input
+    int rollbackToFrame = std::min(p1History->getNeedsRollbackToFrame(), p2History->getNeedsRollbackToFrame());
+    // as far as we can, and never to "no frame" (max int)
+    if (config.alwaysRollback || (rollbackToFrame == std::numeric_limits<int>::max()))
+      rollbackToFrame = std::min(rollbackToFrame, frame - config.maxRollback + 1);
+    rollbackToFrame = std::max(rollbackStopFrame+1, rollbackToFrame);
+    if ((frame - rollbackToFrame) >= config.maxRollback) {
+      // exceeded maximum rollback. we do not have data old enough to
+      // rollback, simulate the fight and guarantee consistency. The
+      // stall below should keep this from happening.
+      MYLOG(Warning, "MAXIMUM ROLLBACK EXCEEDED!");
+      rollbackStats.addMaxRollbackExceeded();
+      setMode(LogicMode::Wait);
+      return false;
+    }
+    else {
+      // pop off all the frames that occur at or after the input
+      frames.popn(frame - rollbackToFrame + 1);
+    }
+    rolledBackFrames = frame - rollbackToFrame + 1;
+    rollbackStats.addRollback(rolledBackFrames, config.maxRollback,
+                              mispredictedFrames(*p1History, rollbackToFrame, frame),
+                              mispredictedFrames(*p2History, rollbackToFrame, frame));
+    p1History->clearRollbackFlags();
+    p2History->clearRollbackFlags();
+    frame = rollbackToFrame-1;
+  }
+
+  // frames up to here were already simulated (and logged) once
+  const int resimulateUntil = frame + rolledBackFrames;
+  // don't predict further than a late input could roll back
+  if (targetFrame > lastPredictableFrame) {
+    targetFrame = std::max(lastPredictableFrame, resimulateUntil);
+    if (targetFrame == resimulateUntil) {
+      MYLOG(Verbose, "Stalled on frame %i", resimulateUntil);
+      rollbackStats.addStalledTick();
+    }
+  }
+  // updateRoundSequence() has to see the last frame before a round
+  // starts, or catching up would start it later than the other side
+  if (inPreRound || inEndRound)
+    lastFrame = std::min(lastFrame, std::max(roundStartFrame-1, frame));
+  targetFrame = std::max(std::min(targetFrame, lastFrame), resimulateUntil);
+  const int firstNewFrame = std::max(frame+1, resimulateUntil+1);
+  const uint64 start = FPlatformTime::Cycles64();
+  uint64 resimulationCycles = 0;
+  // decode cache hit rates of the resimulated frames alone
+  float p1HitRate = 0.0;
+  float p2HitRate = 0.0;
+  p1History->resetDecodeCacheStats();
+  p2History->resetDecodeCacheStats();
+  while (frame < targetFrame) {
+    ++frame;
+    // a caller that simulates frames that never happen, like
+    // FightBot, keeps them quiet
+    FightLog::ResimulationScope resimulation(FightLog::resimulating || (frame <= resimulateUntil));
+    computeFrame(frame);
+    if (frame == resimulateUntil) {
+      resimulationCycles = FPlatformTime::Cycles64() - start;
+      p1HitRate = decodeCacheHitRate(*p1History);
+      p2HitRate = decodeCacheHitRate(*p2History);
+    }
+    // MYLOG(Display, "TICK %i %i!", frame, frames.last().frameNumber);
+  }
+  rollbackStats.addTick(std::max(0, frame - firstNewFrame + 1), rolledBackFrames,
+                        FPlatformTime::ToSeconds64(resimulationCycles));
+
+  if (rolledBackFrames > 0) {
+    if (!config.alwaysRollback) {
+      MYLOG(Verbose,
+            "Rollback of %i frames: decode cache hit rate p1 %.2f p2 %.2f",
+            rolledBackFrames, p1HitRate, p2HitRate);
+    }
+    rolledBackFrames = 0;
+  }
+
+  int upTo = std::min(frame, getInputConfirmedFrame());
+  // the frames of the preround after its last one are thrown away when
+  // the round starts
+  if (inPreRound)
+    upTo = std::min(upTo, roundStartFrame-1);
+  confirmFrames(upTo);
+  return true;
+}
+
+bool FightSimulation::fastForward(int toFrame) {
+  while ((frame < toFrame) && !isStalled()) {
+    if (mode == LogicMode::Idle)
+      updateRoundSequence();
+    if (mode == LogicMode::Wait)
+      break;
+    const int before = frame;
+    if (!simulate(frame+1))
+      return false;
+    if (frame == before)
+      break;
+  }
+  return true;
+}
+
+void FightSimulation::serializeSnapshot(FArchive& Ar) {
+  int32 version = SNAPSHOT_VERSION;
+  Ar << version;
+  if (Ar.IsLoading() && (version != SNAPSHOT_VERSION)) {
+    Ar.SetError();
+    return;
+  }
+  uint8 m = (uint8) mode;
+  Ar << m << frame << confirmedFrame << rollbackStopFrame;
+  Ar << inPreRound << inEndRound << roundStartFrame << roundEndFrame << roundTimeTotal;
+  Ar << pendingDelay << pendingDelayRound << roundDelays;
+  Ar << roundNumber << p1Wins << p2Wins << p1Char << p2Char;
+  frames.serialize(Ar);
+  p1History->serializeSnapshot(Ar);
+  p2History->serializeSnapshot(Ar);
+  if (Ar.IsLoading()) {
+    frames.bind(*tables);
+    if (m > (uint8) LogicMode::Fight)
+      Ar.SetError();
+    mode = (enum LogicMode) m;
+    rolledBackFrames = 0;
+  }
+}
+
+const FRollbackStats& FightSimulation::getRollbackStats() const {
+  return rollbackStats;
+}
+
+enum LogicMode FightSimulation::getMode() const {
+  return mode;
+}
+
+int FightSimulation::getFrame() const {
+  return frame;
+}
+
+int FightSimulation::roundWinner() {
+  if (latestFrame().p2.health < latestFrame().p1.health)
+    return 0;
+  else if (latestFrame().p1.health < latestFrame().p2.health)
+    return 1;
+  else // if (latestFrame().p1.health == latestFrame().p2.health)
+    return 2;
+}
+
+int FightSimulation::getP1Wins() const {
+  return p1Wins;
+}
+
+int FightSimulation::getP2Wins() const {
+  return p2Wins;
+}
+
+const Frame& FightSimulation::latestFrame() {
+  return frames.last();
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Action.h"
+#include "InputHistory.h"
+#include "LogicMode.h"
+#include "RollbackStats.h"
+#include "FightEvent.h"
+#include <limits>
+#include <vector>
+
+// in base frames (see FrameScale)
+#define PREROUND_TIME 60
+#define ENDROUND_TIME 60
+
+// bump whenever serializeSnapshot() changes
+#define SNAPSHOT_VERSION 2
+
+// most events one frame can have: a hit or block and a knockdown for
+// each player, and the end of the round
+#define FRAME_MAX_EVENTS 6
+
+class Player {
+public:
+  FVector pos;
+  HAction action;
+  bool isFacingRight;
+  int actionStart;
+  int health;
+  int hitstun = 0;
+  float knockdownVelocity = 0.0;
+  int actionNumber = 0; // used to prevent a lingering hitbox from hitting every frame
+
+  Player(FVector pos, HAction action): pos(pos), action(action), actionStart(0), health(100) {};
+  Player() {};
+
+  void startNewAction(int frame, HAction newAction, bool isOnLeft);
+  void TryStartingNewAction(int frame, InputHistory& input, bool isOnLeft);
+  float collidesWithBoundary(float boundary, bool isRightBound, int targetFrame);
+  void doDamagedAction(int frame);
+  void doBlockAction(int frame);
+  void doKdAction(int frame, bool isOnLeft, float knockdownDistance);
+  void doThrownAction(int frame, bool isOnLeft, float knockdownDistance, HAction newAction, Player& q);
+  void doMotion(int frame);
+};
+
+class Frame {
+public:
+  Player p1;
+  Player p2;
+  int hitstop = 0; // number of frames of hitstop left
+  float pushbackPerFrame = 0.0;
+  int hitPlayer = 0; // when hitstop>0, 0=both, 1=p1, 2=p2
+  int frameNumber;
+  // what happened on this frame, see FightSimulation::onFightEvent()
+  FFightEvent events[FRAME_MAX_EVENTS];
+  int numEvents = 0;
+
+  Frame(Player p1, Player p2): p1(p1), p2(p2) {};
+  Frame() {};
+
+  // `player' is 0 or 1
+  void addEvent(int frame, EFightEvent type, int player, int damage = 0);
+  // CRC of the serialized frame. Two simulations that got the same
+  // inputs have the same checksum on every confirmed frame.
+  uint32 checksum() const;
+};
+
+FArchive& operator<<(FArchive& Ar, Player& p);
+FArchive& operator<<(FArchive& Ar, Frame& f);
+
+class RingBuffer {
+private:
+  std::vector<Frame> v;
+  int n;
+  int end;
+  int count; // frames pushed and not popped, up to n
+
+public:
+  RingBuffer() = default;
+
+  void reserve(int size);
+
+  void clear();
+
+  void push(const Frame& x);
+
+  const Frame& last();
+  // the i-th frame before the last one, for i < size()
+  const Frame& fromLast(int i) const;
+  int size() const;
+
+  // pop the m last elements
+  void popn(int m);
+
+  // sets an error on `Ar' if a loaded buffer has a different size
+  void serialize(FArchive& Ar);
+  // point the actions of every frame at `tables', e.g. after loading
+  void bind(const ActionTables& tables);
+};
+
+// Everything about the stage and the rules that a FightSimulation
+// needs. ALogic fills this in from its properties.
+class FightConfig {
+public:
+  // set to true to skip the preround
+  bool skipPreRound = false;
+  // set to true to always rollback the maximum amount for testing
+  // purposes
+  bool alwaysRollback = false;
+  int maxRollback = 20;
+  // see InputHistory's buffer
+  int inputBuffer = 2;
+  float stageBoundLeft = 0.0;
+  float stageBoundRight = 0.0;
+  FVector leftStart;
+  FVector rightStart;
+  // set to true when the host picks the input delay of every round
+  // after the first (see pendingDelay). A round then doesn't start
+  // before its delay has arrived, since with the old one the inputs
+  // would land on other frames than on the host.
+  bool roundDelayFromHost = false;
+  // seconds that the owner lets the simulation stall on a lagging
+  // input before it gives up on the match; see isStalled()
+  float disconnectTimeout = 5.0;
+  // logic frames per second. The simulation runs on the action tables
+  // of this rate. maxRollback and inputBuffer are in frames of this
+  // rate.
+  int framerate = BASE_FRAMERATE;
+};
+
+// The deterministic part of a fight: the frames, the round sequence
+// and rollback over the inputs of two InputHistory objects. It has no
+// world, clock or network; whoever owns it feeds it inputs and calls
+// simulate() once per logic frame. ALogic is one of these in a game,
+// and a headless server runs many of them in a FightMatchPool.
+//
+// The round sequence calls the on*() hooks so that the owner can fire
+// events, e.g. ALogic's blueprint delegates.
+class FightSimulation {
+public:
+  FightSimulation();
+  virtual ~FightSimulation() = default;
+
+  // Start over with the given inputs, which the caller has already
+  // initialized with its own rollback and buffer sizes.
+  void init(const FightConfig& _config, InputHistory* _p1History, InputHistory* _p2History);
+  // characters for the next reset(), bound to our tables there
+  void setCharacters(HCharacter _p1Char, HCharacter _p2Char);
+
+  // reset() and Enter FightMode::Idle mode. Calls onPreRound().
+  void preRound();
+  // Enter FightMode::Fight mode. Calls onBeginRound().
+  void beginRound();
+  // Go to FightMode::Idle mode. Calls onEndRound().
+  void endRound();
+  // Go to FightMode::Wait. Calls onEndFight().
+  void endFight();
+
+  // Start the next round once the preround or endround timer has run
+  // out and, with config.roundDelayFromHost, its input delay has
+  // arrived. Call this before simulate() while in Idle mode.
+  void updateRoundSequence();
+  // Roll back if the inputs changed and simulate up to the newest
+  // input, or at least one frame, but not past lastFrame. Returns
+  // false and goes to Wait if the inputs go back further than the
+  // rollback buffer.
+  //
+  // It never predicts so far past the inputs it has that a late one
+  // could need more than the rollback buffer. Once it would, it
+  // stalls: simulate() only resimulates and holds the last frame
+  // until the missing inputs arrive.
+  bool simulate(int lastFrame = std::numeric_limits<int>::max());
+  // Step one frame at a time up to `toFrame', like the owner's ticks
+  // would but without waiting for them, e.g. to catch up after
+  // loading a snapshot. Stops early when stalled. Returns false like
+  // simulate().
+  bool fastForward(int toFrame);
+  // newest frame that we have the inputs of both players for, i.e.
+  // that no late input can roll back
+  int getInputConfirmedFrame() const;
+  // newest frame that simulate() may advance to with the inputs so far
+  int getLastPredictableFrame() const;
+  // Newest simulated frame that can't change anymore. onFrameConfirmed()
+  // is called for every frame up to it in order.
+  int getConfirmedFrame() const;
+  // true if the next simulate() can't advance. The owner should not
+  // sample new local inputs then, and may end the match once this
+  // lasts longer than config.disconnectTimeout.
+  bool isStalled() const;
+
+  enum LogicMode getMode() const;
+  int getFrame() const;
+  // 0 means player 1, 1 means player 2 and 2 means draw
+  int roundWinner();
+  int getP1Wins() const;
+  int getP2Wins() const;
+  const Frame& latestFrame();
+  // counters since init(). rollbacksPerSecond is left to the owner,
+  // which knows the framerate.
+  const FRollbackStats& getRollbackStats() const;
+
+  // Save or load everything needed to carry on with the match: the
+  // round state, the rollback buffer, which reaches back to the
+  // confirmed frame, and both input histories. This lets a player
+  // that dropped out rejoin the match. The round state isn't part of
+  // Frame, so the frames after the confirmed one are sent as they
+  // are rather than resimulated. The loading side must have been
+  // init()ed with the same config. Check Ar.IsError() after loading.
+  void serializeSnapshot(FArchive& Ar);
+
+protected:
+  FightConfig config;
+  // converts the base frames of the frame data to config.framerate
+  FrameScale scale;
+  // the actions and characters at config.framerate. Every action in
+  // the frames is bound to these.
+  const ActionTables* tables;
+  InputHistory* p1History;
+  InputHistory* p2History;
+
+  RingBuffer frames;
+  int frame;
+  int rollbackStopFrame; // When starting a new round, we don't
+                         // want to rollback past the first
+                         // frame.
+  int rolledBackFrames; // number of frames popped by the
+                        // rollback in the current simulate()
+  int confirmedFrame;
+  FRollbackStats rollbackStats;
+
+  enum LogicMode mode;
+  bool inPreRound; // setting this to true will cause
+                   // updateRoundSequence() to count forward 30
+                   // frames rounded to the nearest 15 frames,
+                   // and then call beginRound().
+  bool inEndRound;
+  int roundStartFrame;
+  int roundEndFrame;
+  int roundTimeTotal; // used just for displaying the timer
+
+  // input delay sent by the host for round pendingDelayRound
+  int pendingDelay;
+  int pendingDelayRound;
+  // input delay of every round so far, indexed by round number
+  TArray<int32> roundDelays;
+  // true while updateRoundSequence() holds the next round for its
+  // delay, so that it logs that once
+  bool waitingForDelay;
+
+  // false if config.roundDelayFromHost and we don't know the delay of
+  // `round' yet
+  bool hasRoundDelay(int round) const;
+
+  int roundNumber;
+  int p1Wins;
+  int p2Wins;
+  HCharacter p1Char;
+  HCharacter p2Char;
+
+  void setMode(enum LogicMode);
+
+  // Reset the fight; put players back at start with full
+  // health, clear inputs and rollback buffer.
+  void reset(bool flipSpawns);
+
+  // a bunch of convenience functions for computeFrame()
+  float playerCollisionExtent(const Player &p, const Player &q, int targetFrame);
+  void HandlePlayerBoundaryCollision(Frame &f, int targetFrame, bool doRightBoundary);
+  bool IsPlayerOnLeft(const Player& p1, const Player& p2);
+  bool IsP1OnLeft(const Frame& f);
+
+  void computeFrame(int targetFrame);
+  // Dispatch the events of the frames that changed, then move the
+  // confirmed frame up to `upTo', if it is higher, and call
+  // onFrameConfirmed() for every frame on the way. simulate() does
+  // this itself; owners that step the frames on their own, like
+  // spectators, call it with the frames they know are final.
+  void confirmFrames(int upTo);
+  // Compare the events of the frames after the confirmed one with
+  // the ones we dispatched before and call onFightEventCancelled() and
+  // onFightEvent() for the difference.
+  void dispatchEvents();
+
+  virtual void onPreRound() {}
+  virtual void onBeginRound() {}
+  virtual void onEndRound() {}
+  virtual void onEndFight() {}
+  // `frame' and every frame before it are final; no rollback will
+  // change them anymore
+  virtual void onFrameConfirmed(int frame) {}
+  // An event on a frame that is simulated for the first time or that
+  // a rollback changed. However often a frame is resimulated, this is
+  // called once for each event unless a rollback takes it away, in
+  // which case onFightEventCancelled() is called. Events of confirmed
+  // frames are never cancelled.
+  virtual void onFightEvent(const FFightEvent& e) {}
+  virtual void onFightEventCancelled(const FFightEvent& e) {}
+
+private:
+  // events passed to onFightEvent() of the frames after the confirmed
+  // one, and the events of those frames now
+  TArray<FFightEvent> dispatchedEvents;
+  TArray<FFightEvent> currentEvents;
+};
@@ -0,0 +1,27 @@
+#include "FightSimulationThread.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformProcess.h"
+#include <algorithm>
+
+FightSimulationThread::FightSimulationThread(TFunction<float(double)> _step, float firstStepTime, int maxCatchUpSteps):
+  step(MoveTemp(_step)), stepTime(firstStepTime), clock(maxCatchUpSteps), running(true) {
+}
+
+uint32 FightSimulationThread::Run() {
+  double last = FPlatformTime::Seconds();
+  while (running) {
+    const double now = FPlatformTime::Seconds();
+    clock.advance(now - last);
+    last = now;
+    while (running && clock.step(stepTime))
+      stepTime = step(now - clock.getLateness());
+    // sleep until the next frame is due
+    const float wait = stepTime * (1.0f - clock.getAlpha());
+    FPlatformProcess::Sleep(std::max(0.0f, wait));
+  }
+  return 0;
+}
+
+void FightSimulationThread::Stop() {
+  running = false;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "FixedStepClock.h"
+#include <atomic>
+
+// Steps a simulation at its own frame rate on a thread of its own,
+// so that hitches on the game thread don't delay logic frames.
+//
+// `step' runs one logic frame and returns how long the next one
+// should be, in seconds, so the owner can keep stretching frames with
+// TimeSync. It gets the FPlatformTime::Seconds() when the frame was
+// due. Whatever it shares with other threads it has to lock
+// itself.
+class FightSimulationThread : public FRunnable {
+public:
+  FightSimulationThread(TFunction<float(double)> _step, float firstStepTime, int maxCatchUpSteps);
+
+  virtual uint32 Run() override;
+  virtual void Stop() override;
+
+private:
+  TFunction<float(double)> step;
+  float stepTime;
+  FixedStepClock clock;
+  std::atomic<bool> running;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FightVisualState.generated.h"
+
+// What ALogic's player*() getters return for one player
+USTRUCT(BlueprintType)
+struct FFightPlayerVisualState {
+  GENERATED_BODY()
+
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  FVector pos = FVector(0, 0, 0);
+  // pos blended between the last two logic frames, see
+  // ALogic::playerInterpolatedPos()
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  FVector interpolatedPos = FVector(0, 0, 0);
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  bool isFacingRight = false;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 health = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 animation = 0;
+  // frames since the animation started
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 animationFrame = 0;
+  // side of the stage that the player started the round on and is on
+  // now, 0 means left side, 1 means right side
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 side = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 currentSide = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 wins = 0;
+};
+
+// Everything a blueprint draws of a fight, all from the same logic
+// frame. Getting this once per render frame is a lot cheaper than
+// calling the single getters for every value of both players.
+USTRUCT(BlueprintType)
+struct FFightVisualState {
+  GENERATED_BODY()
+
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  FFightPlayerVisualState p1;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  FFightPlayerVisualState p2;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 frame = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 roundNumber = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 roundTime = 0;
+  // see ALogic::getRoundWinner()
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  int32 roundWinner = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Visual State")
+  float interpolationAlpha = 0.0;
+};
@@ -0,0 +1,47 @@
+#include "FixedStepClock.h"
+#include <algorithm>
+
+FixedStepClock::FixedStepClock(int maxSteps): maxSteps(maxSteps) {
+  reset();
+}
+
+void FixedStepClock::reset() {
+  acc = 0.0;
+  steps = 0;
+  lastStepTime = 0.0;
+}
+
+void FixedStepClock::setMaxSteps(int _maxSteps) {
+  maxSteps = std::max(1, _maxSteps);
+}
+
+void FixedStepClock::advance(float deltaSeconds) {
+  acc += std::max(0.0f, deltaSeconds);
+  steps = 0;
+}
+
+bool FixedStepClock::step(float stepTime) {
+  lastStepTime = stepTime;
+  // the small epsilon keeps a render rate that is an exact multiple
+  // of the logic rate from missing frames to rounding
+  if (acc < stepTime - 0.00001)
+    return false;
+  if (steps >= maxSteps) {
+    // drop what we can't catch up on, but keep the phase
+    acc = std::min(acc, stepTime);
+    return false;
+  }
+  acc = std::max(0.0f, acc - stepTime);
+  ++steps;
+  return true;
+}
+
+float FixedStepClock::getLateness() const {
+  return acc;
+}
+
+float FixedStepClock::getAlpha() const {
+  if (lastStepTime <= 0.0)
+    return 0.0;
+  return std::clamp(acc / lastStepTime, 0.0f, 1.0f);
+}
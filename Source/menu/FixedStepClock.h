@@ -0,0 +1,42 @@
+#pragma once
+
+// Turns render frames of any length into logic frames of a fixed
+// length.
+//
+// Render time is added with advance() and step() hands it out again
+// in logic frames. Time that is left over carries into the next render
+// frame, so the logic frame rate doesn't depend on the render frame
+// rate. After a hitch at most maxSteps logic frames run in one render
+// frame and the rest of the lost time is dropped, instead of piling up
+// into a burst of frames. The time carried over, as a fraction of a
+// logic frame, is how far the display is between the last two logic
+// frames.
+class FixedStepClock {
+private:
+  int maxSteps;
+
+  float acc;
+  int steps; // steps in the current render frame
+  float lastStepTime;
+
+public:
+  FixedStepClock(int maxSteps = 3);
+
+  void reset();
+  void setMaxSteps(int _maxSteps);
+
+  // Start a render frame that took `deltaSeconds'
+  void advance(float deltaSeconds);
+
+  // Returns true and consumes the time of a logic frame when one that
+  // is `stepTime' seconds long is due. The step time may change from
+  // frame to frame, e.g. when TimeSync stretches it.
+  bool step(float stepTime);
+
+  // Time since the last logic frame as a fraction of its length, in
+  // [0, 1]
+  float getAlpha() const;
+  // Seconds from the frame that step() just handed out becoming due
+  // to the start of the render frame
+  float getLateness() const;
+};
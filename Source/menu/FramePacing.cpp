@@ -0,0 +1,112 @@
+#include "FramePacing.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <algorithm>
+
+float FramePacing::Sample::lateMs() const {
+  return (started - due) * 1000.0;
+}
+
+FramePacing::FramePacing() {
+  reset();
+}
+
+void FramePacing::reset() {
+  samples.assign(FRAME_PACING_SAMPLES, Sample());
+  end = 0;
+  count = 0;
+  lastStarted = -1.0;
+}
+
+void FramePacing::add(int frame, double due, double started, double finished, int resimulatedFrames, float renderDeltaSeconds, bool stalled) {
+  Sample& s = samples[end];
+  s.frame = frame;
+  s.due = due;
+  s.started = started;
+  s.intervalMs = (lastStarted < 0.0) ? 0.0 : (started - lastStarted) * 1000.0;
+  s.computeMs = (finished - started) * 1000.0;
+  s.resimulatedFrames = resimulatedFrames;
+  s.renderDeltaMs = renderDeltaSeconds * 1000.0;
+  s.stalled = stalled;
+  lastStarted = started;
+  end = (end + 1) % samples.size();
+  count = std::min(count + 1, (int) samples.size());
+}
+
+int FramePacing::sampleCount() const {
+  return count;
+}
+
+const FramePacing::Sample& FramePacing::get(int i) const {
+  return samples[(end - count + i + samples.size()) % samples.size()];
+}
+
+template <class F>
+std::vector<float> FramePacing::sorted(F value) const {
+  std::vector<float> v;
+  v.reserve(count);
+  for (int i = 0; i < count; ++i)
+    v.push_back(value(get(i)));
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+static float percentileOf(const std::vector<float>& v, float p) {
+  if (v.empty())
+    return 0.0;
+  return v[std::clamp((int) (p * (v.size() - 1) + 0.5f), 0, (int) v.size() - 1)];
+}
+
+float FramePacing::lateMsPercentile(float p) const {
+  return percentileOf(sorted([](const Sample& s) { return s.lateMs(); }), p);
+}
+
+float FramePacing::intervalMsPercentile(float p) const {
+  return percentileOf(sorted([](const Sample& s) { return s.intervalMs; }), p);
+}
+
+float FramePacing::computeMsPercentile(float p) const {
+  return percentileOf(sorted([](const Sample& s) { return s.computeMs; }), p);
+}
+
+float FramePacing::renderDeltaMsPercentile(float p) const {
+  return percentileOf(sorted([](const Sample& s) { return s.renderDeltaMs; }), p);
+}
+
+int FramePacing::resimulatedFrames() const {
+  int n = 0;
+  for (int i = 0; i < count; ++i)
+    n += get(i).resimulatedFrames;
+  return n;
+}
+
+int FramePacing::stalledFrames() const {
+  int n = 0;
+  for (int i = 0; i < count; ++i)
+    n += get(i).stalled ? 1 : 0;
+  return n;
+}
+
+FString FramePacing::toCsv() const {
+  FString s;
+  s.Append(TEXT("# name,p50,p95,p99,max\n"));
+  auto line = [&s](const TCHAR* name, const std::vector<float>& v) {
+    s.Append(FString::Printf(TEXT("%s,%f,%f,%f,%f\n"), name, percentileOf(v, 0.5), percentileOf(v, 0.95), percentileOf(v, 0.99), percentileOf(v, 1.0)));
+  };
+  line(TEXT("lateMs"), sorted([](const Sample& x) { return x.lateMs(); }));
+  line(TEXT("intervalMs"), sorted([](const Sample& x) { return x.intervalMs; }));
+  line(TEXT("computeMs"), sorted([](const Sample& x) { return x.computeMs; }));
+  line(TEXT("renderDeltaMs"), sorted([](const Sample& x) { return x.renderDeltaMs; }));
+  s.Append(FString::Printf(TEXT("resimulatedFrames,%i\n"), resimulatedFrames()));
+  s.Append(FString::Printf(TEXT("stalledFrames,%i\n"), stalledFrames()));
+  s.Append(TEXT("# frame,lateMs,intervalMs,computeMs,resimulatedFrames,renderDeltaMs,stalled\n"));
+  for (int i = 0; i < count; ++i) {
+    const Sample& x = get(i);
+    s.Append(FString::Printf(TEXT("%i,%f,%f,%f,%i,%f,%i\n"), x.frame, x.lateMs(), x.intervalMs, x.computeMs, x.resimulatedFrames, x.renderDeltaMs, x.stalled ? 1 : 0));
+  }
+  return s;
+}
+
+bool FramePacing::save(const FString& fileName) const {
+  return FFileHelper::SaveStringToFile(toCsv(), *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("FramePacing"), fileName));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+
+// number of logic frames that FramePacing remembers
+#define FRAME_PACING_SAMPLES 900
+
+// Timing of the most recent logic frames, to tell where a stutter came
+// from:
+// - a long render frame shows up as a large renderDeltaMs and frames
+//   that start late,
+// - the network as stalled frames and rollbacks, i.e. resimulated
+//   frames,
+// - resimulation as a long computeMs with resimulated frames.
+class FramePacing {
+public:
+  class Sample {
+  public:
+    int frame;
+    // FPlatformTime::Seconds() when the frame was due and when it
+    // started
+    double due;
+    double started;
+    // time from the start of the previous frame, in ms
+    float intervalMs;
+    // simulate() and everything around it, in ms
+    float computeMs;
+    int resimulatedFrames;
+    // length of the render frame that ran this logic frame, in ms. 0
+    // on the simulation thread.
+    float renderDeltaMs;
+    bool stalled;
+
+    float lateMs() const;
+  };
+
+private:
+  std::vector<Sample> samples;
+  int end;
+  int count;
+  double lastStarted;
+
+  // `value' of every sample in the ring, sorted
+  template <class F>
+  std::vector<float> sorted(F value) const;
+
+public:
+  FramePacing();
+
+  void reset();
+  void add(int frame, double due, double started, double finished, int resimulatedFrames, float renderDeltaSeconds, bool stalled);
+
+  int sampleCount() const;
+  // the i-th oldest sample that we still have
+  const Sample& get(int i) const;
+
+  // p in [0,1]
+  float lateMsPercentile(float p) const;
+  float intervalMsPercentile(float p) const;
+  float computeMsPercentile(float p) const;
+  float renderDeltaMsPercentile(float p) const;
+  int resimulatedFrames() const;
+  int stalledFrames() const;
+
+  // percentiles as "name,p50,p95,p99,max" lines, then one line per
+  // sample
+  FString toCsv() const;
+  // Write toCsv() into the FramePacing directory of the project's
+  // Saved directory. Returns false if writing failed.
+  bool save(const FString& fileName) const;
+};
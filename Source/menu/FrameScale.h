@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cmath>
+
+// Frame data (action lengths, advantages, hitboxes, hitstop,
+// velocities, round timers, ...) is written in frames of
+// BASE_FRAMERATE, i.e. in thirtieths of a second, whatever rate the
+// simulation runs at. FrameScale converts it to frames of the actual
+// rate when the tables are built.
+#define BASE_FRAMERATE 30
+// highest rate that the input packets (see INPUT_REDUNDANCY) and the
+// rollback buffer are sized for
+#define MAX_FRAMERATE 60
+
+class FrameScale {
+private:
+  int framerate;
+
+public:
+  explicit FrameScale(int _framerate = BASE_FRAMERATE): framerate(_framerate) {}
+
+  int getFramerate() const {
+    return framerate;
+  }
+
+  // `n' base frames in frames of our rate, rounded away from zero so
+  // that nothing that lasts at least a frame disappears
+  int frames(int n) const {
+    if (n == 0)
+      return 0;
+    const double x = ((double) n) * framerate / BASE_FRAMERATE;
+    return (n > 0) ? (int) std::ceil(x - 0.001) : (int) std::floor(x + 0.001);
+  }
+
+  // The last frame of our rate within base frame `n', e.g. for the
+  // inclusive ends of hitbox windows. frames() of an end would end the
+  // window up to a frame early.
+  int lastFrame(int n) const {
+    return frames(n+1) - 1;
+  }
+
+  // something that changes by `x' per base frame (a velocity), per
+  // frame of our rate
+  float perFrame(float x) const {
+    return x * BASE_FRAMERATE / framerate;
+  }
+
+  // how many base frames `frame' frames of our rate are
+  float toBase(int frame) const {
+    return ((float) frame) * BASE_FRAMERATE / framerate;
+  }
+};
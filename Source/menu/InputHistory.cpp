@@ -0,0 +1,581 @@
+#include "InputHistory.h"
+#include "InputPacket.h"
+#include "FightLog.h"
+#include <algorithm>
+#include <limits>
+
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFightInput, category, TEXT("InputHistory " message), ##__VA_ARGS__)
+
+void ButtonRingBuffer::reserve(int size) {
+  n = size;
+  clear();
+}
+
+void ButtonRingBuffer::clear() {
+  v.clear();
+  v.resize(n, {});
+  end = 0;
+}
+
+void ButtonRingBuffer::push(const std::optional<enum Button>& x) {
+  end = end+1;
+  if (end == n) end = 0;
+  v.at(end) = x;
+}
+
+std::optional<enum Button>& ButtonRingBuffer::last() {
+  return v.at(end);
+}
+
+std::optional<enum Button>& ButtonRingBuffer::nthlast(int i) {
+  int j = end-i;
+  if (j < 0) j += n;
+  check(j >= 0);
+  check(j < n);
+  return v.at(j);
+}
+
+bool InputHistory::is_button(const enum Button& b) {
+  switch (b) {
+  case Button::LP:
+  case Button::HP:
+  case Button::LK:
+  case Button::HK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+enum Button toSingleDirection(std::optional<enum Button> dx, std::optional<enum Button> dy) {
+  if (dx.has_value()) {
+    if (dx.value() == Button::FORWARD) {
+      if (dy.has_value() && (dy.value() == Button::DOWN))
+        return Button::DOWNFORWARD;
+      else if (dy.has_value() && (dy.value() == Button::UP))
+        return Button::UPFORWARD;
+      else
+        return Button::FORWARD;
+    }
+    else if (dx.value() == Button::BACK) {
+      if (dy.has_value() && (dy.value() == Button::DOWN))
+        return Button::DOWNBACK;
+      if (dy.has_value() && (dy.value() == Button::UP))
+        return Button::UPBACK;
+      else
+        return Button::BACK;
+    }
+  }
+
+  if (dy.has_value())
+    return dy.value();
+  else
+    return Button::NEUTRAL;
+}
+
+// bool InputHistory::is_none(const Button& b) {
+//   return b == Button::NONE;
+// }
+
+// amount of input we keep for looking back for command inputs, in
+// base frames (see FrameScale)
+#define LOOKBEHIND_SIZE 30
+// amount of input we keep to cope with inputs from the future
+#define FUTURE_SIZE maxRollback
+// base frames allowed between the inputs of a motion command
+#define MOTION_INPUT_GAP 4
+
+void InputHistory::init(int _maxRollback, int _buffer, int _delay, int _framerate) {
+  const FrameScale scale(_framerate);
+  maxRollback = _maxRollback;
+  buffer = _buffer;
+  delay = _delay;
+  motionInputGap = scale.frames(MOTION_INPUT_GAP);
+  n = maxRollback+buffer+MAX_INPUT_DELAY+scale.frames(LOOKBEHIND_SIZE)+FUTURE_SIZE;
+  buttonHistory.reserve(n);
+  directionHistoryX.reserve(n);
+  directionHistoryY.reserve(n);
+  decodeCache.resize(n);
+  resetDecodeCacheStats();
+  mode = LogicMode::Wait;
+  lastInputFrame = currentFrame = 0;
+  lastPacketState = 0;
+  packedHistory.assign(n, 0);
+  reset();
+}
+
+void InputHistory::reset() {
+  clearRollbackFlags();
+  buttonHistory.clear();
+  directionHistoryX.clear();
+  directionHistoryY.clear();
+  decodeCache.assign(n, DecodeCacheEntry());
+}
+
+void InputHistory::invalidateDecodeCache(int inputFrame) {
+  // action() for targetFrame reads the inputs of targetFrame-delay
+  // and older, so a change on inputFrame can only affect decodes from
+  // inputFrame+delay onward.
+  int firstFrame = inputFrame + delay;
+  for (auto& e : decodeCache) {
+    if (e.targetFrame >= firstFrame)
+      e.targetFrame = -1;
+  }
+}
+
+void InputHistory::setMode(enum LogicMode m) {
+  mode = m;
+}
+
+enum LogicMode InputHistory::getMode() const {
+  return mode;
+}
+
+void InputHistory::setDelay(int _delay) {
+  delay = std::clamp(_delay, 0, MAX_INPUT_DELAY);
+  // cached decodes were made with the old delay
+  decodeCache.assign(n, DecodeCacheEntry());
+}
+
+int InputHistory::getDelay() const {
+  return delay;
+}
+
+void InputHistory::ensureFrame(int targetFrame) {
+  while (targetFrame > currentFrame) {
+    // assume nothing was pressed for frames we are skipping here. The
+    // last one we push is actually for the new frame and we will
+    // store the recieved inputs in that one.
+    buttonHistory.push({});
+    directionHistoryX.push(directionHistoryX.last());
+    directionHistoryY.push(directionHistoryY.last());
+    ++currentFrame;
+  }
+}
+
+auto buttonToString(enum Button b) {
+  switch (b) {
+  case Button::LP: return TEXT("LP"); break;
+  case Button::HP: return TEXT("HP"); break;
+  case Button::LK: return TEXT("LK"); break;
+  case Button::HK: return TEXT("HK"); break;
+  case Button::FORWARD: return TEXT("FORWARD"); break;
+  case Button::BACK: return TEXT("BACK"); break;
+  case Button::UP: return TEXT("UP"); break;
+  case Button::DOWN: return TEXT("DOWN"); break;
+  case Button::LEFT: return TEXT("LEFT"); break;
+  case Button::RIGHT: return TEXT("RIGHT"); break;
+  case Button::UPBACK: return TEXT("UPBACK"); break;
+  case Button::UPFORWARD: return TEXT("UPFORWARD"); break;
+  case Button::DOWNBACK: return TEXT("DOWNBACK"); break;
+  case Button::DOWNFORWARD: return TEXT("DOWNFORWARD"); break;
+  case Button::NEUTRAL: return TEXT("NEUTRAL"); break;
+  case Button::QCFP: return TEXT("QCFP"); break;
+  default: return TEXT("0");
+  }
+}
+
+FString ButtonRingBuffer::toString() {
+  FString s;
+  for (int i = 0; i < n; ++i) {
+    std::optional<enum Button> o = nthlast(i);
+    if (o.has_value())
+      s.Append(buttonToString(o.value()));
+    else
+      s.Append(FString("None"));
+    s.Append(FString(" "));
+  }
+  return s;
+}
+
+void ButtonRingBuffer::serialize(FArchive& Ar) {
+  int32 size = v.size();
+  Ar << size << end;
+  if (Ar.IsLoading() && ((size != n) || (end < 0) || (end >= n))) {
+    Ar.SetError();
+    return;
+  }
+  for (auto& b : v) {
+    uint8 x = b ? (uint8) *b : 0xFF;
+    Ar << x;
+    if (Ar.IsLoading())
+      b = (x == 0xFF) ? std::nullopt : std::make_optional((enum Button) x);
+  }
+}
+
+FString InputHistory::encodedButtonsToString(int8 e) {
+  FString r;
+  for (auto b : {Button::LP, Button::HP, Button::LK, Button::HK,
+                 Button::UP, Button::DOWN, Button::LEFT, Button::RIGHT}) {
+    if (decodeButton(b, e)) {
+      r.Append(buttonToString(b));
+      r.Append(FString(" "));
+    }
+  }
+  return r;
+}
+
+int8 InputHistory::encodeButton(enum Button b, int8 encoded) {
+  return encoded | (1 << (int) b);
+}
+
+int8 InputHistory::unsetButton(enum Button b, int8 encoded) {
+  return encoded & (~(1 << (int) b));
+}
+
+bool InputHistory::decodeButton(enum Button b, int8 encoded) {
+  return (encoded & (1 << (int) b)) != 0;
+}
+
+void InputHistory::buttons(int8 buttonsPressed, int8 buttonsReleased, int targetFrame) {
+  if ((mode != LogicMode::Fight) && (mode != LogicMode::Idle)) return;
+  // MYLOG(Display,
+  //       TEXT("buttons(): (current frame %i) (target frame %i) (buttonsPressed %s) (buttonsReleased %s)"),
+  //       currentFrame,
+  //       targetFrame,
+  //       *encodedButtonsToString(buttonsPressed),
+  //       *encodedButtonsToString(buttonsReleased));
+
+  if ((targetFrame - currentFrame) > FUTURE_SIZE)
+    return; // we are too far behind to store it. It isn't acknowledged,
+            // so the peer sends it again once we caught up.
+
+  lastInputFrame = targetFrame; // assumes calls maintain order
+  bool changesInput = (buttonsPressed != 0) || (buttonsReleased != 0);
+
+  // check if a rollback will be needed. Frames without presses or
+  // releases match what we predicted for them.
+  if (changesInput && (targetFrame <= (currentFrame-delay))) {
+    needsRollbackToFrame = std::min(needsRollbackToFrame, targetFrame+delay);
+    if (needsRollback() && (currentFrame - needsRollbackToFrame) >= maxRollback) {
+      return; // there is nothing that this class can do in this
+              // situation. We don't have input data going back that
+              // far. Let ALogic decide how to reset or quit the
+              // match.
+    }
+  }
+  ensureFrame(targetFrame);
+  if (changesInput)
+    invalidateDecodeCache(targetFrame);
+
+  // get the data for the frame we want to modify
+  int i = currentFrame - targetFrame;
+  std::optional<enum Button>& bh = buttonHistory.nthlast(i);
+  std::optional<enum Button>& dxh = directionHistoryX.nthlast(i);
+  std::optional<enum Button>& dyh = directionHistoryY.nthlast(i);
+
+  // handle presses. this is a really simple implementation that just
+  // sets the button pressed to the last button/direction that happens
+  // to appear in buttonsPressed.
+  for (auto b: {Button::LP, Button::HP, Button::LK, Button::HK}) {
+    if (decodeButton(b, buttonsPressed))
+        bh = std::make_optional(b);
+  }
+  for (auto b: {Button::LEFT, Button::RIGHT}) {
+    if (decodeButton(b, buttonsPressed)) {
+      dxh = std::make_optional(b);
+      for (int j = 1; j <= i; ++j)
+        directionHistoryX.nthlast(i-j) = dxh;
+    }
+  }
+  for (auto b: {Button::UP, Button::DOWN}) {
+    if (decodeButton(b, buttonsPressed)) {
+      dyh = std::make_optional(b);
+      for (int j = 1; j <= i; ++j)
+        directionHistoryY.nthlast(i-j) = dyh;
+    }
+  }
+
+  // handle releases. this should probably just ignore everything
+  // except directional inputs. we don't have to care when a button is
+  // released, except when its a directional input. TODO: keep track
+  // of all directions held so that when one is released we can use
+  // one of the other currently held ones. _action() will have to pick
+  // between which directions to prioritize.
+  for (auto b: {Button::LEFT, Button::RIGHT}) {
+    if (decodeButton(b, buttonsReleased) && (directionHistoryX.last() == b)) {
+      dxh = {};
+      for (int j = 1; j <= i; ++j)
+        directionHistoryX.nthlast(i-j) = {};
+    }
+  }
+  for (auto b: {Button::UP, Button::DOWN}) {
+    if (decodeButton(b, buttonsReleased) && (directionHistoryY.last() == b)) {
+      dyh = {};
+      for (int j = 1; j <= i; ++j)
+        directionHistoryY.nthlast(i-j) = {};
+    }
+  }
+}
+
+void InputHistory::packedButtons(uint8 state, int targetFrame) {
+  if ((mode != LogicMode::Fight) && (mode != LogicMode::Idle)) return;
+  if ((targetFrame - currentFrame) > FUTURE_SIZE) return; // see buttons()
+  // frames that we skip were predicted to hold the same directions
+  for (int f = std::max(lastInputFrame+1, targetFrame-n+1); f < targetFrame; ++f)
+    packedHistory.at(f % n) = lastPacketState & InputPacket::directionBits;
+  packedHistory.at(targetFrame % n) = state;
+
+  uint8 pressed, released;
+  InputPacket::diff(lastPacketState, state, pressed, released);
+  lastPacketState = state;
+  buttons(pressed, released, targetFrame);
+}
+
+uint8 InputHistory::getPackedInput(int frame) const {
+  return (frame < 0) ? 0 : packedHistory.at(frame % n);
+}
+
+enum Button InputHistory::translateDirection(const enum Button& d, bool isOnLeft) {
+  if (((d == Button::RIGHT) && isOnLeft) ||
+      ((d == Button::LEFT) && !isOnLeft))
+    return Button::FORWARD;
+  else if (((d == Button::LEFT) && isOnLeft) ||
+           ((d == Button::RIGHT) && !isOnLeft))
+    return Button::BACK;
+  else
+    return d;
+}
+
+std::optional<enum Button> InputHistory::translateDirection(std::optional<enum Button>& d, bool isOnLeft) {
+  if (d.has_value())
+    return std::make_optional(translateDirection(d.value(), isOnLeft));
+  else
+    return {};
+}
+
+int InputHistory::computeIndex(int targetFrame) {
+  return (currentFrame - targetFrame)+delay;
+}
+
+HAction InputHistory::_action(HAction currentAction, int frame, bool isOnLeft, int actionFrame) {
+  const HCharacter& c = currentAction.character();
+  // MYLOG(Warning, "_action(): %s (frame %i) (button %s)", *GetActorLabel(false), frame, directionHistory.nthlast(frame).has_value() ? ((directionHistory.nthlast(frame).value() == Button::RIGHT) ? TEXT("right") : TEXT("not right")) : TEXT("none"));
+
+  // first we will determine the "button".
+  std::vector<enum Button> buttons;
+
+  // first try motion commands; they have the highest priority
+  enum Button newButton = Button::NEUTRAL;
+  if (buttonHistory.nthlast(frame).has_value()) {
+    for (auto i = motionCommands.begin(); i != motionCommands.end(); ++i) {
+      for (auto j = i->second.begin(); j != i->second.end(); ++j) {
+        if (j->back() == buttonHistory.nthlast(frame).value()) {
+          if (checkMotionCommand(*j, 1, frame, isOnLeft)) {
+            MYLOG(Verbose, "_action(): %s!", buttonToString(i->first));
+            newButton = i->first;
+          }
+        }
+      }
+    }
+  }
+  if (newButton != Button::NEUTRAL)
+    buttons.push_back(newButton);
+
+  // try a normal attack
+  if (buttonHistory.nthlast(frame).has_value()) {
+    buttons.push_back(buttonHistory.nthlast(frame).value());
+  }
+
+  // try directional input
+  buttons.push_back(toSingleDirection(translateDirection(directionHistoryX.nthlast(frame), isOnLeft), directionHistoryY.nthlast(frame)));
+
+  // now with our "button" we pick an action
+
+  // first try chains; these have highest priority
+  for (auto b : buttons) {
+    if (actionFrame >= currentAction.specialCancelFrames()) {
+      auto i = currentAction.chains().find(b);
+      if (i != currentAction.chains().end()) return i->second;
+    }
+  }
+
+  if (actionFrame < currentAction.lockedFrames())
+    return currentAction.character().idle(); // idle doesn't interrupt
+                                             // any actions so this is
+                                             // safe as a "do nothing"
+                                             // return value
+
+  for (auto b : buttons) {
+    // try specials
+    for (auto i : currentAction.character().specials()) {
+      if (i.first == b) return i.second;
+    }
+
+    // try normals and motion
+    switch (b) {
+    case Button::NEUTRAL:
+    case Button::DOWNFORWARD:
+    case Button::DOWNBACK:
+      return c.idle();
+    case Button::FORWARD:
+      return c.walkForward();
+    case Button::BACK:
+    case Button::UPBACK:
+      return c.walkBackward();
+    case Button::UPFORWARD:
+      return c.fJump();
+    case Button::HP:
+      return c.sthp();
+    case Button::LP:
+      return c.stlp();
+    case Button::LK:
+      return c.grab();
+    }
+  }
+
+  // just idle if no other action was chosen
+  return c.idle();
+}
+
+bool InputHistory::checkMotionCommand(const std::vector<enum Button>& motion, int m, int frame, bool isOnLeft) {
+  if (m == motion.size())
+    return true;
+  if (frame >= n-3)
+    return false;
+
+  check(frame >= 0);
+  check((motion.size() - m - 1) < motion.size());
+  // MYLOG(Display,
+  //       "checkMotionCommand() %i %i %s %s %s",
+  //       m,
+  //       frame,
+  //       buttonToString(toSingleDirection(translateDirection(directionHistoryX.nthlast(frame), isOnLeft), directionHistoryY.nthlast(frame))),
+  //       directionHistoryX.nthlast(frame).has_value() ? buttonToString(translateDirection(directionHistoryX.nthlast(frame).value(), isOnLeft)) : TEXT("None"),
+  //       directionHistoryY.nthlast(frame).has_value() ? buttonToString(directionHistoryY.nthlast(frame).value()) : TEXT("None"));
+  for (int i = 0; i < motionInputGap; ++i) {
+    if (toSingleDirection(translateDirection(directionHistoryX.nthlast(frame+i), isOnLeft), directionHistoryY.nthlast(frame+i)) == motion[motion.size() - m - 1]) {
+      if (checkMotionCommand(motion, m+1, frame+i+1, isOnLeft))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+HAction InputHistory::action(HAction currentAction, bool isOnLeft, int targetFrame, int actionStart) {
+  if (mode == LogicMode::Idle)
+    return currentAction.character().idle();
+
+  int frameBefore = currentFrame;
+  int actionFrame = targetFrame - actionStart;
+  ensureFrame(targetFrame);
+
+  DecodeCacheEntry& cached = decodeCache.at(targetFrame % n);
+  if ((cached.targetFrame == targetFrame) &&
+      (cached.currentAction == currentAction) &&
+      (cached.actionFrame == actionFrame) &&
+      (cached.isOnLeft == isOnLeft)) {
+    ++decodeCacheHits;
+    return cached.result;
+  }
+  ++decodeCacheMisses;
+  //MYLOG(Warning, "action(): %s (current frame %i) (target frame %i)", *GetActorLabel(false), currentFrame, targetFrame);
+
+  int frame = computeIndex(targetFrame);
+  // Try decoding an action based on the inputs at `frame'. If the
+  // action we decode is walking or idling, then try using the inputs
+  // one frame earlier. Repeat until we find an action that isn't
+  // idling or walking, or we have tried all of the `input
+  // buffer' frames.
+  HAction mostRecentAction = _action(currentAction, frame, isOnLeft, actionFrame);
+  // MYLOG(Warning, "action(): %s (current frame %i) (target frame %i) (action: %s)", *GetActorLabel(false), currentFrame, targetFrame, (mostRecentAction == HActionIdle) ? TEXT("idle") : TEXT("not idle"));
+  HAction action = mostRecentAction;
+
+  for (int i = 1; (i < buffer) && action.isWalkOrIdle(); ++i) {
+    action = _action(currentAction, frame+i, isOnLeft, actionFrame);
+  }
+  // MYLOG(Display,
+  //       "action() (action %i) (current frame %i) (target frame %i) (actionFrame %i) (new action %i)",
+  //       currentAction.animation(),
+  //       currentFrame,
+  //       targetFrame,
+  //       actionFrame,
+  //       (action.isWalkOrIdle() ? mostRecentAction : action).animation());
+  // MYLOG(Display, "buttonHistory: %s", *(buttonHistory.toString()));
+  HAction result = action.isWalkOrIdle() ? mostRecentAction : action;
+  cached.targetFrame = targetFrame;
+  cached.currentAction = currentAction;
+  cached.actionFrame = actionFrame;
+  cached.isOnLeft = isOnLeft;
+  cached.result = result;
+  return result;
+}
+
+enum GuardLevel InputHistory::isGuarding(bool isOnLeft, int targetFrame) {
+  ensureFrame(targetFrame);
+  int frame = computeIndex(targetFrame);
+  if (directionHistoryX.nthlast(frame).has_value() &&
+      (translateDirection(directionHistoryX.nthlast(frame).value(), isOnLeft) == Button::BACK)) {
+    if (directionHistoryX.nthlast(frame).has_value() &&
+        directionHistoryX.nthlast(frame).value() == Button::DOWN)
+      return GuardLevel::Low;
+    else
+      return GuardLevel::High;
+  }
+  else
+    return GuardLevel::None;
+}
+
+int InputHistory::getCurrentFrame() {
+  return currentFrame;
+}
+
+int InputHistory::getLastInputFrame() const {
+  return lastInputFrame;
+}
+
+bool InputHistory::needsRollback() {
+  return needsRollbackToFrame != std::numeric_limits<int>::max();
+}
+
+int InputHistory::getNeedsRollbackToFrame() {
+  return needsRollbackToFrame;
+}
+
+void InputHistory::clearRollbackFlags() {
+  needsRollbackToFrame = std::numeric_limits<int>::max();
+}
+
+bool InputHistory::hasRecievedInputForFrame(int frame) const {
+  return frame <= (lastInputFrame+delay);
+}
+
+int InputHistory::getDecodeCacheHits() const {
+  return decodeCacheHits;
+}
+
+int InputHistory::getDecodeCacheMisses() const {
+  return decodeCacheMisses;
+}
+
+void InputHistory::resetDecodeCacheStats() {
+  decodeCacheHits = decodeCacheMisses = 0;
+}
+
+void InputHistory::serializeSnapshot(FArchive& Ar) {
+  // the sizes come from the FightConfig, which both sides share
+  int32 size = n;
+  Ar << size;
+  if (Ar.IsLoading() && (size != n)) {
+    Ar.SetError();
+    return;
+  }
+  uint8 m = (uint8) mode;
+  Ar << delay << currentFrame << needsRollbackToFrame << lastInputFrame << lastPacketState << m;
+  if (Ar.IsLoading()) {
+    if ((delay < 0) || (delay > MAX_INPUT_DELAY) || (m > (uint8) LogicMode::Fight)) {
+      Ar.SetError();
+      return;
+    }
+    mode = (enum LogicMode) m;
+  }
+  buttonHistory.serialize(Ar);
+  directionHistoryX.serialize(Ar);
+  directionHistoryY.serialize(Ar);
+  for (auto& p : packedHistory)
+    Ar << p;
+  // the decode cache is only a cache
+  if (Ar.IsLoading())
+    decodeCache.assign(n, DecodeCacheEntry());
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Action.h"
+#include "LogicMode.h"
+#include "Button.h"
+#include <optional>
+#include <vector>
+
+// UE doesn't support type aliases
+#define int8 char
+
+// largest artificial input delay that the input histories are sized
+// for. ALogic can change the delay between rounds up to this value.
+#define MAX_INPUT_DELAY 8
+
+// ideally we'd only have one RingBuffer<T> class but unreal doesn't
+// like templates and I don't want to figure out how to build it as an
+// external library that can still be distributed to many platforms
+// just yet.
+class ButtonRingBuffer {
+private:
+  int n;
+  int end;
+
+public:
+  std::vector<std::optional<enum Button>> v;
+  void reserve(int size);
+  void clear();
+
+  void push(const std::optional<enum Button>& x);
+
+  std::optional<enum Button>& last();
+
+  std::optional<enum Button>& nthlast(int i);
+
+  FString toString();
+  // for snapshots; sets an error on `Ar' if a loaded buffer has a
+  // different size
+  void serialize(FArchive& Ar);
+};
+
+enum class GuardLevel { High, Low, None };
+
+// One memoized result of InputHistory::action(). The decoded action
+// only depends on the inputs in the history and on these keys, so
+// resimulating a frame after a rollback can reuse it as long as none
+// of the inputs it looked at have changed.
+class DecodeCacheEntry {
+public:
+  int targetFrame = -1;
+  HAction currentAction;
+  int actionFrame;
+  bool isOnLeft;
+  HAction result;
+};
+
+// This class will decode input sequences and support replaying input
+// in case of rollback. In the case that each move is triggered by a
+// single button press, this is simply mapping the most recent button
+// to a move. In the case of chorded moves or motion commands, we have
+// to keep track of all buttons pressed over time.
+//
+// It knows nothing about actors or the network, so the same histories
+// back AFightInput in a game and the matches of a headless server (see
+// FightMatchPool).
+class InputHistory {
+private:
+  int maxRollback;
+  int n;
+
+  // number of frames to "buffer" inputs. if there are no actions in
+  // the latest frame to decode besides walking, then use inputs from
+  // the latest frame within `buffer` frames away that results in an
+  // action.
+  int buffer;
+
+  // artificial input delay. action() should decode an action based on
+  // the inputs `delay` frames ago.
+  int delay;
+
+  // frames allowed between the inputs of a motion command
+  int motionInputGap;
+
+  int currentFrame;
+  int needsRollbackToFrame;
+
+  // for now, just allow one button at a time
+  ButtonRingBuffer buttonHistory;
+  // this assumes that the player cannot press opposite directions at
+  // the same time
+  ButtonRingBuffer directionHistoryX;
+  ButtonRingBuffer directionHistoryY;
+
+  enum LogicMode mode;
+
+  // decoded actions indexed by targetFrame % n. Entries are cleared
+  // from the first frame whose input changes; see
+  // invalidateDecodeCache().
+  std::vector<DecodeCacheEntry> decodeCache;
+  int decodeCacheHits;
+  int decodeCacheMisses;
+
+  int lastInputFrame;
+  // packed input of lastInputFrame, used to turn the next packed
+  // frames back into presses and releases
+  uint8 lastPacketState;
+  // packed inputs indexed by frame % n, for the spectator feed
+  std::vector<uint8> packedHistory;
+
+  bool is_button(const enum Button& b);
+  // bool is_none(const Button& b);
+  enum Button translateDirection(const enum Button& d, bool isOnLeft);
+  std::optional<enum Button> translateDirection(std::optional<enum Button>& d, bool isOnLeft);
+  // compute how far back in our history we have to look for the input
+  // data for targetFrame
+  int computeIndex(int targetFrame);
+
+  // Make sure that we have some data for the new frame. We will either
+  // do nothing or "predict" the input (assume nothing was pressed or
+  // released).
+  void ensureFrame(int targetFrame);
+
+  // returns true if a sequence of `motion` inputs ends on `frame`
+  bool checkMotionCommand(const std::vector<enum Button>& motion, int n, int frame, bool isOnLeft);
+  // return action using input `frame` frames ago as latest input
+  HAction _action(HAction currentAction, int frame, bool isOnLeft, int actionFrame);
+  // forget every decoded action that could have looked at the inputs
+  // of `inputFrame` or later
+  void invalidateDecodeCache(int inputFrame);
+
+public:
+  // initialize all member variables
+  // `framerate' scales the time allowed between the inputs of a
+  // motion command
+  void init(int _maxRollback, int _buffer, int _delay, int _framerate = BASE_FRAMERATE);
+  // clear all inputs and rollback state
+  void reset();
+
+  void setMode(enum LogicMode);
+  enum LogicMode getMode() const;
+
+  // Change the artificial input delay. This reinterprets which inputs
+  // belong to which frame, so it must only be called when both peers
+  // do it on the same frame, i.e. between rounds right before reset().
+  void setDelay(int _delay);
+  int getDelay() const;
+
+  // Returns the encoding given in `encoded' plus the button `b'
+  // encoded into it
+  static FString encodedButtonsToString(int8 e);
+  static int8 encodeButton(enum Button b, int8 encoded=0);
+  static int8 unsetButton(enum Button b, int8 encoded=0);
+  static bool decodeButton(enum Button b, int8 encoded);
+
+  // The player controller will call this function to say which
+  // buttons were pressed and released on the given frame. frame is
+  // the frame that the inputs should first appear. It is 1+ the frame
+  // number stored in ALogic at the time that this function is called
+  // by the player controller. Inputs more than maxRollback frames
+  // ahead of the history are ignored and not counted as recieved.
+  void buttons(int8 buttonsPressed, int8 buttonsReleased, int targetFrame);
+  // Same as buttons(), but takes the packed input of the frame (see
+  // InputPacket) and works out the presses and releases from the
+  // previous one. Both local and remote inputs go through here.
+  void packedButtons(uint8 state, int targetFrame);
+  // packed input recorded for a recent frame
+  uint8 getPackedInput(int frame) const;
+
+  // Returns the decoded action for the given targetFrame.
+  HAction action(HAction currentAction, bool isOnLeft, int targetFrame, int actionStart);
+
+  // guarding might not depend on the action but rather the inputs
+  // (holding back or down-back), so we use a new method here. We
+  // could also add a `guard' flag to some actions.
+  enum GuardLevel isGuarding(bool isOnLeft, int targetFrame);
+
+  int getCurrentFrame();
+  // newest frame that buttons() was called for
+  int getLastInputFrame() const;
+  bool needsRollback();
+  int getNeedsRollbackToFrame();
+  void clearRollbackFlags();
+  bool hasRecievedInputForFrame(int frame) const;
+
+  // Decode cache statistics since the last call to
+  // resetDecodeCacheStats(). The simulation uses these to report the
+  // hit rate of each rollback.
+  int getDecodeCacheHits() const;
+  int getDecodeCacheMisses() const;
+  void resetDecodeCacheStats();
+
+  // Save or load every input and the rollback flags, for
+  // FightSimulation::serializeSnapshot(). The loading side must have
+  // been initialized with the same sizes.
+  void serializeSnapshot(FArchive& Ar);
+};
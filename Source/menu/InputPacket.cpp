@@ -0,0 +1,161 @@
+#include "InputPacket.h"
+#include "HAL/PlatformTime.h"
+#include <algorithm>
+
+void InputPacket::writeVarint(TArray<uint8>& out, uint32 x) {
+  while (x >= 0x80) {
+    out.Add((uint8) (x | 0x80));
+    x >>= 7;
+  }
+  out.Add((uint8) x);
+}
+
+bool InputPacket::readVarint(const TArray<uint8>& in, int& i, uint32& x) {
+  x = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (i >= in.Num())
+      return false;
+    uint8 b = in[i++];
+    x |= ((uint32) (b & 0x7F)) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static uint32 zigzag(int x) {
+  return (((uint32) x) << 1) ^ ((uint32) (x >> 31));
+}
+
+static int unzigzag(uint32 x) {
+  return (int) (x >> 1) ^ -((int) (x & 1));
+}
+
+// the full frame number closest to `reference' whose low 16 bits are
+// `low'
+static int unwrapFrame(uint16 low, int reference) {
+  int f = (reference & ~0xFFFF) | low;
+  if (f < reference - 0x8000)
+    f += 0x10000;
+  else if (f > reference + 0x8000)
+    f -= 0x10000;
+  return f;
+}
+
+int InputPacket::lastFrame() const {
+  return firstFrame + states.Num() - 1;
+}
+
+void InputPacket::encode(TArray<uint8>& out) const {
+  out.Reset();
+  out.Add((uint8) (firstFrame & 0xFF));
+  out.Add((uint8) ((firstFrame >> 8) & 0xFF));
+  writeVarint(out, zigzag(firstFrame - ackFrame));
+  out.Add((uint8) (std::clamp(frameAdvantage, -128, 127) & 0xFF));
+  out.Add((uint8) (timestamp & 0xFF));
+  out.Add((uint8) (timestamp >> 8));
+  out.Add((uint8) (echoTimestamp & 0xFF));
+  out.Add((uint8) (echoTimestamp >> 8));
+  writeVarint(out, (echoDelay < 0) ? 0 : std::min(echoDelay, 0xFFFF) + 1);
+  for (int i = 0; i < states.Num();) {
+    int run = 1;
+    while ((i+run < states.Num()) && (states[i+run] == states[i]))
+      ++run;
+    writeVarint(out, run);
+    out.Add(states[i]);
+    i += run;
+  }
+}
+
+bool InputPacket::decode(const TArray<uint8>& in, int referenceFrame) {
+  states.Reset();
+  if (in.Num() < 2)
+    return false;
+  firstFrame = unwrapFrame(in[0] | (in[1] << 8), referenceFrame);
+  int i = 2;
+  uint32 x;
+  if (!readVarint(in, i, x))
+    return false;
+  ackFrame = firstFrame - unzigzag(x);
+  if (i+5 > in.Num())
+    return false;
+  frameAdvantage = (in[i] >= 128) ? (in[i] - 256) : in[i];
+  timestamp = in[i+1] | (in[i+2] << 8);
+  echoTimestamp = in[i+3] | (in[i+4] << 8);
+  i += 5;
+  if (!readVarint(in, i, x))
+    return false;
+  echoDelay = ((int) x) - 1;
+  while (i < in.Num()) {
+    if (!readVarint(in, i, x) || (i >= in.Num()) || (x > INPUT_REDUNDANCY))
+      return false;
+    uint8 state = in[i++];
+    for (uint32 j = 0; j < x; ++j)
+      states.Add(state);
+  }
+  return states.Num() > 0;
+}
+
+uint16 InputPacket::clockMs() {
+  return (uint16) (((uint64) (FPlatformTime::Seconds() * 1000.0)) & 0xFFFF);
+}
+
+void InputPacket::diff(uint8 prev, uint8 state, uint8& pressed, uint8& released) {
+  pressed = (state & attackBits) | (state & ~prev & directionBits);
+  released = prev & ~state & directionBits;
+}
+
+InputSendBuffer::InputSendBuffer() {
+  reset();
+}
+
+void InputSendBuffer::reset() {
+  v.clear();
+  v.resize(INPUT_REDUNDANCY, 0);
+  newestFrame = -1;
+  count = 0;
+}
+
+void InputSendBuffer::push(int frame, uint8 state) {
+  if ((count > 0) && (frame <= newestFrame)) {
+    // ALogic rewound its frame counter at the start of a round. The
+    // peer drops frames it already has, so just start over.
+    count = 0;
+  }
+  else if (count > 0) {
+    uint8 held = v.at(newestFrame % INPUT_REDUNDANCY) & InputPacket::directionBits;
+    for (int f = newestFrame+1; f < frame; ++f) {
+      v.at(f % INPUT_REDUNDANCY) = held;
+      count = std::min(count+1, INPUT_REDUNDANCY);
+    }
+  }
+  v.at(frame % INPUT_REDUNDANCY) = state;
+  newestFrame = frame;
+  count = std::min(count+1, INPUT_REDUNDANCY);
+}
+
+void InputSendBuffer::makePacket(int peerAck, InputPacket& p) const {
+  p.states.Reset();
+  if (count == 0)
+    return;
+  int first = std::min(std::max(peerAck+1, newestFrame-count+1), newestFrame);
+  p.firstFrame = first;
+  for (int f = first; f <= newestFrame; ++f)
+    p.states.Add(v.at(f % INPUT_REDUNDANCY));
+}
+
+void ByteRateCounter::add(int bytes) {
+  double now = FPlatformTime::Seconds();
+  if (windowStart < 0.0)
+    windowStart = now;
+  windowBytes += bytes;
+  if ((now - windowStart) >= 1.0) {
+    rate = windowBytes / (now - windowStart);
+    windowStart = now;
+    windowBytes = 0;
+  }
+}
+
+float ByteRateCounter::bytesPerSecond() const {
+  return rate;
+}
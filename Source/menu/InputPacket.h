@@ -0,0 +1,110 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+
+// Number of past frames of input that we keep repeating until the peer
+// acknowledges them. A lost packet is covered by any of the next
+// packets, so losing one costs at most one frame of prediction instead
+// of a retransmit round trip. It is larger than the rollback buffer so
+// that frames sent during a stall (see FightSimulation::isStalled())
+// survive until the link comes back; normally only the few frames of
+// one round trip are unacknowledged.
+#define INPUT_REDUNDANCY 64
+
+// Inputs for a run of consecutive frames, as sent between peers.
+//
+// Each frame is packed into a byte using the bit layout of
+// AFightInput::encodeButton(). The bits of the directions are set on
+// every frame that the direction is held, while the bits of the attack
+// buttons are only set on the frame they are pressed. Unlike the
+// pressed/released masks, a frame packed like this does not depend on
+// the frames before it, so frames can be repeated and lost frames can
+// be skipped.
+//
+// On the wire (see encode()) a packet is:
+// - the low 16 bits of firstFrame. The receiver unwraps them against
+//   the newest frame it has from us, which is the frame it acks.
+// - ackFrame as a zigzag varint delta from firstFrame
+// - frameAdvantage clamped to a signed byte
+// - timestamp and echoTimestamp, 16 bits each
+// - echoDelay+1 as a varint, or 0 if there is nothing to echo yet
+// - runs of identical packed frames, each a varint run length followed
+//   by the packed frame, until the end of the packet
+// Holding a direction for all INPUT_REDUNDANCY frames costs 11 bytes.
+class InputPacket {
+public:
+  static constexpr uint8 directionBits = 0xF0;
+  static constexpr uint8 attackBits = 0x0F;
+
+  int firstFrame = 0;
+  // newest frame of the receiver's inputs that the sender has
+  int ackFrame = 0;
+  // how many frames the sender thinks it is ahead of us, in quarter
+  // frames. See ALogic::getLocalFrameAdvantage().
+  int frameAdvantage = 0;
+  // Ping/pong for measuring round trip time. timestamp is the sender's
+  // clockMs() when sending. echoTimestamp is the newest timestamp the
+  // sender recieved from us and echoDelay is how many ms it held on
+  // to it before sending this packet, or -1 if it has none yet.
+  uint16 timestamp = 0;
+  uint16 echoTimestamp = 0;
+  int echoDelay = -1;
+  TArray<uint8> states;
+
+  int lastFrame() const;
+
+  // milliseconds on a monotonic clock, wrapping every 65.5 seconds
+  static uint16 clockMs();
+
+  void encode(TArray<uint8>& out) const;
+  // referenceFrame is the newest frame we have from the sender.
+  // Returns false if the packet is malformed.
+  bool decode(const TArray<uint8>& in, int referenceFrame);
+
+  // Compute the pressed/released masks for AFightInput::buttons()
+  // that turn the packed frame `prev' into `state'.
+  static void diff(uint8 prev, uint8 state, uint8& pressed, uint8& released);
+
+  // LEB128 varints, also used by SpectatorPacket. readVarint() reads
+  // from in[i] on and advances i; it returns false if `in' ends first.
+  static void writeVarint(TArray<uint8>& out, uint32 x);
+  static bool readVarint(const TArray<uint8>& in, int& i, uint32& x);
+};
+
+// Keeps the packed inputs of our own most recent frames so that they
+// can be repeated until the peer acknowledges them.
+class InputSendBuffer {
+private:
+  std::vector<uint8> v; // indexed by frame % INPUT_REDUNDANCY
+  int newestFrame;
+  int count;
+
+public:
+  InputSendBuffer();
+
+  void reset();
+
+  // Store the packed input for `frame'. Frames skipped since the last
+  // push keep the held directions with no presses, which is the same
+  // thing AFightInput predicts for them.
+  void push(int frame, uint8 state);
+
+  // Fill `p' with every stored frame newer than `peerAck', which is
+  // the newest of our frames that the peer told us it has. Always
+  // includes at least the newest frame.
+  void makePacket(int peerAck, InputPacket& p) const;
+};
+
+// Counts the bytes going over one connection, averaged over the last
+// full second.
+class ByteRateCounter {
+private:
+  double windowStart = -1.0;
+  int windowBytes = 0;
+  float rate = 0.0;
+
+public:
+  void add(int bytes);
+  float bytesPerSecond() const;
+};
@@ -0,0 +1,44 @@
+#include "InputSampler.h"
+#include "InputPacket.h"
+#include "HAL/PlatformTime.h"
+
+InputSampler::InputSampler(): latency(0.0, 1.0, 100) {
+  reset();
+}
+
+void InputSampler::reset() {
+  events.Empty();
+  held = 0;
+  latency.reset();
+}
+
+void InputSampler::press(uint8 bits) {
+  events.Enqueue(Event{FPlatformTime::Seconds(), bits, true});
+}
+
+void InputSampler::release(uint8 bits) {
+  events.Enqueue(Event{FPlatformTime::Seconds(), bits, false});
+}
+
+uint8 InputSampler::sample() {
+  double now = FPlatformTime::Seconds();
+  uint8 tapped = 0;
+  uint8 attacks = 0;
+  Event e;
+  while (events.Dequeue(e)) {
+    latency.addSample((now - e.time) * 1000.0);
+    if (e.pressed) {
+      attacks |= e.bits & InputPacket::attackBits;
+      held |= e.bits & InputPacket::directionBits;
+      tapped |= e.bits & InputPacket::directionBits;
+    }
+    else {
+      held &= ~e.bits;
+    }
+  }
+  return held | tapped | attacks;
+}
+
+const LatencyEstimator& InputSampler::getLatency() const {
+  return latency;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "LatencyEstimator.h"
+
+// Collects the button events of the local player between two logic
+// frames and turns them into the packed input of the next frame (see
+// InputPacket).
+//
+// Every event is timestamped when it arrives and goes through a
+// single producer, single consumer queue, so the side that records
+// events never waits on the side that samples them. A direction that
+// is pressed and released again before the next sample still shows up
+// as held for that one frame instead of being lost.
+class InputSampler {
+private:
+  struct Event {
+    double time; // FPlatformTime::Seconds()
+    uint8 bits;
+    bool pressed;
+  };
+  TQueue<Event, EQueueMode::Spsc> events;
+
+  // consumer side only
+  uint8 held;
+  // ms from an event arriving to it being sampled
+  LatencyEstimator latency;
+
+public:
+  InputSampler();
+
+  // consumer side; drops any queued events
+  void reset();
+
+  // producer side. `bits' are packed like InputPacket's frames.
+  void press(uint8 bits);
+  void release(uint8 bits);
+
+  // consumer side. Returns the packed input for the frame about to be
+  // simulated.
+  uint8 sample();
+
+  const LatencyEstimator& getLatency() const;
+};
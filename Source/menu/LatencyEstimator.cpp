@@ -0,0 +1,86 @@
+#include "LatencyEstimator.h"
+#include <algorithm>
+#include <cmath>
+
+LatencyEstimator::LatencyEstimator(float minValue, float bucketWidth, int buckets, int maxSamples): minValue(minValue), bucketWidth(bucketWidth), maxSamples(maxSamples) {
+  histogram.resize(buckets);
+  reset();
+}
+
+void LatencyEstimator::reset() {
+  std::fill(histogram.begin(), histogram.end(), 0);
+  histogramTotal = 0;
+  smoothed = variation = last = 0.0;
+  samples = 0;
+}
+
+void LatencyEstimator::addSample(float x) {
+  // gains from RFC 6298
+  const float alpha = 1.0/8.0;
+  const float beta = 1.0/4.0;
+  if (samples == 0) {
+    smoothed = x;
+    variation = x/2;
+  }
+  else {
+    variation = (1-beta)*variation + beta*std::abs(smoothed - x);
+    smoothed = (1-alpha)*smoothed + alpha*x;
+  }
+  last = x;
+  ++samples;
+
+  int bucket = std::clamp((int) std::floor((x - minValue) / bucketWidth), 0, (int) histogram.size() - 1);
+  ++histogram[bucket];
+  ++histogramTotal;
+  if (histogramTotal > maxSamples) {
+    histogramTotal = 0;
+    for (auto& h : histogram) {
+      h /= 2;
+      histogramTotal += h;
+    }
+  }
+}
+
+int LatencyEstimator::sampleCount() const {
+  return samples;
+}
+
+float LatencyEstimator::lastSample() const {
+  return last;
+}
+
+float LatencyEstimator::mean() const {
+  return smoothed;
+}
+
+float LatencyEstimator::jitter() const {
+  return variation;
+}
+
+float LatencyEstimator::percentile(float p) const {
+  if (histogramTotal == 0)
+    return smoothed;
+  float target = std::clamp(p, 0.0f, 1.0f) * histogramTotal;
+  int seen = 0;
+  for (int i = 0; i < (int) histogram.size(); ++i) {
+    if ((histogram[i] > 0) && (seen + histogram[i] >= target))
+      return bucketStart(i) + bucketWidth * ((target - seen) / histogram[i]);
+    seen += histogram[i];
+  }
+  return bucketStart(histogram.size());
+}
+
+const std::vector<int>& LatencyEstimator::getHistogram() const {
+  return histogram;
+}
+
+float LatencyEstimator::bucketStart(int i) const {
+  return minValue + i*bucketWidth;
+}
+
+FString LatencyEstimator::histogramToCsv() const {
+  FString s;
+  for (int i = 0; i < (int) histogram.size(); ++i)
+    s.Append(FString::Printf(TEXT("%f,%i\n"), bucketStart(i), histogram[i]));
+  return s;
+}
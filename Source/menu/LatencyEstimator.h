@@ -0,0 +1,46 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+
+// Smoothed mean and jitter of a stream of latency samples, computed
+// like TCP's retransmission timer (RFC 6298), plus a histogram for
+// percentiles.
+//
+// The histogram forgets old samples by halving every bucket once it
+// holds more than `maxSamples' samples, so percentiles follow the
+// recent state of the connection.
+class LatencyEstimator {
+private:
+  float minValue;
+  float bucketWidth;
+  std::vector<int> histogram; // the last bucket also counts overflow
+  int histogramTotal;
+  int maxSamples;
+
+  float smoothed;
+  float variation;
+  float last;
+  int samples;
+
+public:
+  LatencyEstimator(float minValue, float bucketWidth, int buckets, int maxSamples = 1000);
+
+  void reset();
+  void addSample(float x);
+
+  int sampleCount() const;
+  float lastSample() const;
+  // smoothed mean; 0 before the first sample
+  float mean() const;
+  // smoothed mean deviation
+  float jitter() const;
+  // p in [0,1]. Interpolates inside the histogram bucket.
+  float percentile(float p) const;
+
+  const std::vector<int>& getHistogram() const;
+  // value at the start of histogram bucket i
+  float bucketStart(int i) const;
+  // "bucket start,count" lines
+  FString histogramToCsv() const;
+};
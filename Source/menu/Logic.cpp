@@ -1,873 +1,671 @@
 #include "Logic.h"
 #include "FightInput.h"
 #include "FightGameState.h"
-#include "Hitbox.h"
-#include "Box.h"
 #include "Action.h"
 #include "StreetBrallersGameInstance.h"
 #include "Kismet/GameplayStatics.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/IConsoleManager.h"
+#include "FightLog.h"
 #include <algorithm>
 #include <cmath>
-#include <limits>
 
-#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("ALogic (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFight, category, TEXT("ALogic (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
 
-void RingBuffer::reserve(int size) {
-  n = size;
-  clear();
-}
-
-void RingBuffer::clear() {
-  v.clear();
-  v.resize(n);
-  end = 0;
-}
+static FAutoConsoleCommandWithWorldAndArgs CmdDumpFramePacing(
+  TEXT("fight.DumpFramePacing"),
+  TEXT("Write the timing of the recent logic frames to Saved/FramePacing. Takes an optional file name."),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& args, UWorld* world) {
+    ALogic* l = FindLogic(world);
+    if (!l)
+      return;
+    FString fileName = (args.Num() > 0) ? args[0] : FString::Printf(TEXT("pacing-%s.csv"), *FDateTime::Now().ToString());
+    if (l->exportFramePacing(fileName))
+      UE_LOG(LogFight, Display, TEXT("wrote Saved/FramePacing/%s"), *fileName);
+    else
+      UE_LOG(LogFight, Warning, TEXT("could not write Saved/FramePacing/%s"), *fileName);
+  }));
 
-void RingBuffer::push(const Frame& x) {
-  end = end+1;
-  if (end == n) end = 0;
-  v.at(end) = x;
+// Sets default values for this component's properties
+ALogic::ALogic()
+{
+  // Set this component to be initialized when the game starts, and to
+  // be ticked every frame. You can turn these features off to improve
+  // performance if you don't need them.
+  PrimaryActorTick.bCanEverTick = true;
+  PrimaryActorTick.TickGroup = TG_PrePhysics;
+  bReplicates = true;
+  framerate = 30;
+  simulationRunnable = nullptr;
+  simulationThread = nullptr;
 }
 
-const Frame& RingBuffer::last() {
-  return v.at(end);
-}
+// Called when the game starts or when spawned
+void ALogic::BeginPlay()
+{
+  Super::BeginPlay();
 
-void RingBuffer::popn(int m) {
-  // assumes that we don't pop off more elements than we have
-  end = end - m;
-  if (end < 0) end += n;
-}
+  MYLOG(Display, TEXT("BeginPlay"));
 
-// if aFacingRight is true, then flip box b. Else, flip box a
-bool Box::collides(const Box& b, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
-  float ax = x, axend = xend;
-  float bx = b.x, bxend = b.xend;
-  if (!aFacingRight) {
-    ax *= -1;
-    axend *= -1;
-    std::swap(ax, axend);
-  }
-  if (!bFacingRight) {
-    bx *= -1;
-    bxend *= -1;
-    std::swap(bx, bxend);
-  }
-  //MYLOG(Display, "Box collides(): (x %f y %f xend %f yend %f) (x %f y %f xend %f yend %f), (offsetax %f offset ay %f offsetbx %f offsetby %f)", ax, y, axend, yend, bx, b.y, bxend, b.yend, offsetax, offsetay, offsetbx, offsetby);
-  return
-    // TODO: i think some of these can be removed since ax<axend an bx<bxend
-    !(((ax+offsetax) < (bx+offsetbx)) &&
-      ((axend+offsetax) < (bx+offsetbx))) &&
-    !(((ax+offsetax) > (bxend+offsetbx)) &&
-      ((axend+offsetax) > (bxend+offsetbx))) &&
-    !(((y+offsetay) < (b.y+offsetby)) &&
-      ((yend+offsetay) < (b.y+offsetby))) &&
-    !(((y+offsetay) > (b.yend+offsetby)) &&
-      ((yend+offsetay) > (b.yend+offsetby)));
-}
-
-float Box::collisionExtent(const Box& b, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
-  float ax = x, axend = xend;
-  float bx = b.x, bxend = b.xend;
-  if (!aFacingRight) {
-    ax *= -1;
-    axend *= -1;
-    std::swap(ax, axend);
-  }
-  if (!bFacingRight) {
-    bx *= -1;
-    bxend *= -1;
-    std::swap(bx, bxend);
-  }
-  ax = ax+offsetax;
-  axend = axend+offsetax;
-  bx = bx+offsetbx;
-  bxend = bxend+offsetbx;
-  if (!(((y+offsetay) < (b.y+offsetby)) &&
-        ((yend+offsetay) < (b.y+offsetby))) &&
-      !(((y+offsetay) > (b.yend+offsetby)) &&
-        ((yend+offsetay) > (b.yend+offsetby)))) {
-    // boxes overlap on y axis
-    if (axend < bx) {
-      // no overlap on x axis
-      return 0.0;
-    }
-    else if (ax > bxend) {
-      // no overlap on x axis
-      return 0.0;
-    }
-    else if (ax <= bx) {
-      if (axend >= bxend) {
-        // B is inside A; move left/right based on centers
-        if ((bx+bxend) <= (ax+axend))
-          return bx-axend;
-        else
-          return ax-bxend;
-      }
-      else
-        // A overlaps the left side of B; suggest move A left
-        return bx-axend;
-    }
-    else if (axend >= bxend) {
-      // A overlaps the right side of B; suggest move A right
-      return bxend-ax;
-    }
-    else /* (ax < bx) && (axend < bxend) */ {
-      // A is inside B; move left/right based on centers
-      if ((bx+bxend) <= (ax+axend))
-        return bx-axend;
-      else
-        return ax-bxend;
-    }
-  }
-  else {
-    // no overlap on y axis
-    return 0.0;
-  }
+  // initialize some variables
+  if ((framerate < 1) || (framerate > MAX_FRAMERATE)) {
+    MYLOG(Warning, "framerate %i is out of range, using %i", framerate, BASE_FRAMERATE);
+    framerate = BASE_FRAMERATE;
+  }
+  gameInstance = getSBGameInstance(GetWorld());
+
+  const int delay = std::clamp(inputDelay, 0, MAX_INPUT_DELAY);
+  FightConfig fightConfig = makeConfig();
+  p1Input->init(fightConfig.maxRollback, fightConfig.inputBuffer, delay, fightConfig.framerate);
+  p2Input->init(fightConfig.maxRollback, fightConfig.inputBuffer, delay, fightConfig.framerate);
+  NetworkConditions conditions = NetworkConditions::fromConsoleVariables();
+  if (!conditions.isPerfect()) {
+    MYLOG(Display, "simulating network: latency %.0f ms jitter %.0f ms loss %.2f duplicate %.2f reorder %.2f seed %i",
+          conditions.latencyMs, conditions.jitterMs, conditions.lossRate, conditions.duplicateRate, conditions.reorderRate, conditions.seed);
+  }
+  p1Input->setNetworkConditions(conditions, 1);
+  p2Input->setNetworkConditions(conditions, 2);
+
+  spectating = false;
+  spectatorFeed.reset(1);
+  spectators.clear();
+
+  updateCharacters();
+  init(fightConfig, p1Input, p2Input);
+  bot.reset();
+  if (cpuOpponent && !isOnline()) {
+    MYLOG(Display, "player 2 is a bot thinking %.1f ms per decision", cpuThinkTimeMs);
+    bot.reset(new FightBot(fightConfig, delay, 1, cpuThinkTimeMs));
+  }
+  acc2 = 0;
+  clock.reset();
+  clock.setMaxSteps(maxCatchUpSteps);
+  previousFrame = frames.last();
+  startFrame_ = frame_ = 0;
+  framePacing.reset();
+  timeSync.reset();
+  frameStretch = 0.0;
+  stallStart = -1.0;
+  waitingForRejoin = false;
+  pcs.clear();
+  sendsDue = false;
+  publishFrame(1.0/framerate);
+  if (simulateOnThread)
+    startSimulationThread();
+}
+
+void ALogic::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+  stopSimulationThread();
+  Super::EndPlay(EndPlayReason);
+}
+
+void ALogic::startSimulationThread() {
+  MYLOG(Display, "stepping the simulation on its own thread");
+  simulationRunnable = new FightSimulationThread([this](double due) { return simulationStep(due); },
+                                                 1.0 / framerate, maxCatchUpSteps);
+  simulationThread = FRunnableThread::Create(simulationRunnable, TEXT("FightSimulation"), 0, TPri_AboveNormal);
+}
+
+void ALogic::stopSimulationThread() {
+  if (!simulationThread)
+    return;
+  simulationThread->Kill(true); // calls Stop() and waits for Run() to return
+  delete simulationThread;
+  delete simulationRunnable;
+  simulationThread = nullptr;
+  simulationRunnable = nullptr;
+}
+
+void ALogic::runOnGameThread(TFunction<void()> event) {
+  if (IsInGameThread()) {
+    event();
+    return;
+  }
+  FScopeLock l(&simulationLock);
+  gameThreadEvents.push_back(MoveTemp(event));
+}
+
+FightConfig ALogic::makeConfig() {
+  FightConfig c;
+  c.skipPreRound = skipPreRound;
+  c.alwaysRollback = alwaysRollback;
+  // the same time at every rate
+  const FrameScale scale(framerate);
+  c.framerate = framerate;
+  c.maxRollback = scale.frames(20);
+  c.inputBuffer = scale.frames(2);
+  c.stageBoundLeft = stageBoundLeft.Y;
+  c.stageBoundRight = stageBoundRight.Y;
+  c.leftStart = leftStart;
+  c.rightStart = rightStart;
+  c.disconnectTimeout = disconnectTimeout;
+  c.roundDelayFromHost = adaptiveInputDelay && isOnline();
+  return c;
+}
+
+void ALogic::addSpectator(ALogicPlayerController* pc) {
+  MYLOG(Display, "addSpectator");
+  spectators.push_back({pc, 0});
+  if (roundNumber > 0)
+    sendSpectate(pc);
+}
+
+void ALogic::removeSpectator(ALogicPlayerController* pc) {
+  spectators.erase(std::remove_if(spectators.begin(), spectators.end(),
+                                  [pc](const SpectatorConnection& s) { return s.pc == pc; }),
+                   spectators.end());
+}
+
+void ALogic::sendSpectate(ALogicPlayerController* pc) {
+  AFightGameState* gs = GetFightGameState(GetWorld());
+  pc->ClientSpectate(gs->p1Char, gs->p2Char, roundDelays);
+}
+
+void ALogic::startSpectating(int p1Char_, int p2Char_, const TArray<int32>& _roundDelays) {
+  FScopeLock l(&simulationLock);
+  MYLOG(Display, "startSpectating");
+  spectating = true;
+  spectatedP1Char = p1Char_;
+  spectatedP2Char = p2Char_;
+  roundDelays = _roundDelays;
+  spectatorFeed.reset(1);
+  preRound();
 }
 
-hitbox_pair Hitbox::make_pair(int endFrame, std::vector<Box> boxes) {
-  return std::make_pair(endFrame, boxes);
+void ALogic::spectatorInputs(const TArray<uint8>& packet) {
+  FScopeLock l(&simulationLock);
+  SpectatorPacket p;
+  if (!p.decode(packet) || !spectatorFeed.addPacket(p))
+    MYLOG(Warning, "spectatorInputs: dropping bad packet");
+}
+
+bool ALogic::isSpectating() {
+  return spectating;
+}
+
+bool ALogic::isMatchInProgress() {
+  FScopeLock l(&simulationLock);
+  return (roundNumber > 0) && (mode != LogicMode::Wait);
+}
+
+void ALogic::playerDisconnected() {
+  FScopeLock l(&simulationLock);
+  MYLOG(Display, "playerDisconnected: waiting %.0f s for a rejoin", reconnectTimeout);
+  waitingForRejoin = true;
+}
+
+void ALogic::rejoinPlayer(ALogicPlayerController* pc) {
+  FScopeLock l(&simulationLock);
+  // The client can only start simulating once the snapshot arrives,
+  // by which time we are about half a round trip further
+  int32 aheadFrames = FMath::CeilToInt(remoteInput()->getRoundTripTime() / 2000.0 * framerate);
+  TArray<uint8> snapshot;
+  FMemoryWriter Ar(snapshot);
+  Ar << aheadFrames;
+  serializeSnapshot(Ar);
+  MYLOG(Display, "rejoinPlayer: sending %i B snapshot of frame %i (confirmed %i)", snapshot.Num(), frame, confirmedFrame);
+  waitingForRejoin = false;
+  // the stall goes on until the client's inputs arrive, but it is a
+  // new one for disconnectTimeout
+  stallStart = -1.0;
+  pc->ClientRejoin(snapshot);
+}
+
+void ALogic::resumeFromSnapshot(ALogicPlayerController* pc, const TArray<uint8>& snapshot) {
+  FScopeLock l(&simulationLock);
+  FMemoryReader Ar(snapshot);
+  int32 aheadFrames = 0;
+  Ar << aheadFrames;
+  serializeSnapshot(Ar);
+  if (Ar.IsError()) {
+    MYLOG(Warning, "resumeFromSnapshot: bad snapshot of %i B", snapshot.Num());
+    setMode(LogicMode::Wait);
+    gameInstance->ReturnToMenuWithMessage(FString("Could not rejoin the match."));
+    return;
+  }
+  p1Input->snapshotLoaded();
+  p2Input->snapshotLoaded();
+  // The host is stalled on our inputs, and so would we be, since we
+  // only sample the frames that we simulate
+  pc->holdButtons(frame);
+  const int loadedFrame = frame;
+  const uint64 start = FPlatformTime::Cycles64();
+  if (!fastForward(frame + std::clamp((int) aheadFrames, 0, config.maxRollback))) {
+    setMode(LogicMode::Wait);
+    gameInstance->ReturnToMenuWithMessage(FString("Could not rejoin the match."));
+    return;
+  }
+  const double ms = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - start) * 1000.0;
+  acc2 = 0;
+  clock.reset();
+  previousFrame = frames.last();
+  publishFrame(1.0/framerate);
+  startFrame_ = frame_ = frame;
+  timeSync.reset();
+  frameStretch = 0.0;
+  stallStart = -1.0;
+  MYLOG(Display, "rejoined at frame %i, fast-forwarded %i frames in %.1f ms", loadedFrame, frame - loadedFrame, ms);
 }
 
-Hitbox::Hitbox(std::vector<Box> _boxes) {
-  boxes = std::vector({Hitbox::make_pair(std::numeric_limits<int>::max(), _boxes)});
+void ALogic::addPlayerController(ALogicPlayerController* pc) {
+  FScopeLock l(&simulationLock);
+  pcs.push_back(pc);
 }
 
-const std::vector<Box>* Hitbox::at(int frame) const {
-  // scan through boxes for the last pair that starts at or before
-  // frame, and return the corresponding vector
-  auto i =
-    find_if(boxes.begin(),
-            boxes.end(),
-            [frame](std::pair<int, std::vector<Box>> x){
-              return x.first >= frame;
-            });
-  if (i == boxes.end())
-    return nullptr;
+void ALogic::updateCharacters() {
+  check(UGameplayStatics::GetGameState(GetWorld()) != nullptr);
+  AFightGameState* gs = Cast<AFightGameState>(UGameplayStatics::GetGameState(GetWorld()));
+  check(gs != nullptr);
+  HCharacter c1 = HCharacter(spectating ? spectatedP1Char : gs->p1Char);
+  HCharacter c2;
+  if (spectating)
+    c2 = HCharacter(spectatedP2Char);
+  else if (GetWorld()->IsNetMode(NM_Client))
+    c2 = HCharacter(gameInstance->p2Char);
   else
-    return &(i->second);
-}
-
-// - b: other hitbox we are checking for collision with
-// - aframe: frame of our hitboxes to check for collision
-// - bframe: frame of b's hitboxes to check for collision
-bool Hitbox::collides(const Box& b, int aframe, int bframe, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
-  const std::vector<Box>* aboxes = at(aframe);
-  if (!aboxes) // at least one box is empty; no collision
-    return false;
-  for (auto& abox: *aboxes) {
-    if (abox.collides(b, offsetax, offsetay, offsetbx, offsetby, aFacingRight, bFacingRight))
-      return true;
-  }
-  return false;
+    c2 = HCharacter(gs->p2Char);
+  setCharacters(c1, c2);
 }
 
-// - b: other hitbox we are checking for collision with
-// - aframe: frame of our hitboxes to check for collision
-// - bframe: frame of b's hitboxes to check for collision
-bool Hitbox::collides(const Hitbox& b, int aframe, int bframe, float offsetax, float offsetay, float offsetbx, float offsetby, bool aFacingRight, bool bFacingRight) const {
-  const std::vector<Box>* aboxes = at(aframe);
-  const std::vector<Box>* bboxes = b.at(bframe);
-  if (!(aboxes && bboxes)) // at least one box is empty; no collision
-    return false;
-  for (auto& abox: *aboxes) {
-    for (auto& bbox: *bboxes) {
-      if (abox.collides(bbox, offsetax, offsetay, offsetbx, offsetby, aFacingRight, bFacingRight))
-        return true;
-    }
+void ALogic::preRound() {
+  FScopeLock l(&simulationLock);
+  // the characters are fixed for the rest of the fight
+  updateCharacters();
+  FightSimulation::preRound();
+  if ((roundNumber == 1) && GetWorld()->IsNetMode(NM_ListenServer)) {
+    for (auto& spectator: spectators)
+      sendSpectate(spectator.pc);
   }
-  return false;
+  publishFrame(1.0/framerate);
 }
 
-void Player::startNewAction(int frame, HAction newAction, bool isOnLeft) {
-  actionNumber++;
-  action = newAction;
-  actionStart = frame;
-  isFacingRight = isOnLeft;
+void ALogic::beginRound() {
+  FScopeLock l(&simulationLock);
+  FightSimulation::beginRound();
 }
 
-void Player::TryStartingNewAction(int frame, AFightInput& input, bool isOnLeft) {
-  if (hitstun != 0) {
-    if ((frame - actionStart) == action.animationLength())
-      ++actionStart;
-  }
-  else {
-    if (action.type() == ActionType::Thrown) {
-      if ((frame - actionStart) == action.animationLength()) {
-        float knockdownVelocityp = knockdownVelocity;
-        doKdAction(frame, isOnLeft, knockdownVelocityp);
-      }
-    }
-    else {
-      if (frame - actionStart >= action.specialCancelFrames()) {
-        HAction newAction = input.action(action, isOnLeft, frame, actionStart);
-        // don't interrupt current action if the new action is just an idle unless we are walking
-        if (!((action.isWalkOrIdle() &&
-               (newAction == action) &&
-               (frame - actionStart < action.animationLength())) ||
-              (!action.isWalkOrIdle() &&
-               (newAction.type() == ActionType::Idle) &&
-               (frame - actionStart < action.animationLength())))) {
-          startNewAction(frame, newAction, isOnLeft);
-        }
-        // do update player direction if we are merely continuing
-        // walk/idle
-        else if (action.isWalkOrIdle() &&
-                 (newAction == action) &&
-                 (frame - actionStart < action.animationLength())) {
-          isFacingRight = isOnLeft;
-        }
-      }
-    }
-  }
+void ALogic::endRound() {
+  FScopeLock l(&simulationLock);
+  FightSimulation::endRound();
 }
 
-void Player::doDamagedAction(int frame) {
-  // do not use startNewAction becauset we don't want to increment
-  // actionStart
-  action = action.character().damaged();
-  actionStart = frame;
+void ALogic::endFight() {
+  FScopeLock l(&simulationLock);
+  FightSimulation::endFight();
 }
 
-void Player::doBlockAction(int frame) {
-  // do not use startNewAction becauset we don't want to increment
-  // actionStart
-  action = action.character().block();
-  actionStart = frame;
-}
+// The round sequence hooks run on the simulation thread with
+// simulateOnThread, so everything that touches blueprints or the
+// network goes through runOnGameThread().
 
-void Player::doKdAction(int frame, bool isOnLeft, float knockdownDistance) {
-  knockdownVelocity = knockdownDistance / knockdownAirborneLength;
-  startNewAction(frame, action.character().kd(), isOnLeft);
+void ALogic::onPreRound() {
+  runOnGameThread([this]() {
+    if(OnPreRound.IsBound()) {
+      OnPreRound.Broadcast();
+    }
+  });
 }
 
-void Player::doThrownAction(int frame, bool isOnLeft, float knockdownDistance, HAction newAction, Player& q) {
-  hitstun = 0;
-  startNewAction(frame, newAction, isOnLeft);
-  knockdownVelocity = knockdownDistance;
-  pos = q.pos + (isOnLeft ? -1 : 1) * thrownBoxerPositions[1];
+void ALogic::onBeginRound() {
+  runOnGameThread([this]() {
+    if(OnBeginRound.IsBound()) {
+      OnBeginRound.Broadcast();
+    }
+  });
 }
 
-void Player::doMotion(int targetFrame) {
-  pos += (isFacingRight ? 1 : -1) * action.velocity();
-  if (action.type() == ActionType::Jump) {
-    pos.Z = 5*jumpHeights[targetFrame - actionStart];
-  }
-  if (action.type() == ActionType::Thrown) {
-    pos += (isFacingRight ? -1 : 1) * (thrownBoxerPositions[targetFrame - actionStart + 1] - thrownBoxerPositions[targetFrame - actionStart]);
-  }
-  if (action.type() == ActionType::KD) {
-    if ((targetFrame - actionStart) < knockdownAirborneLength) {
-      pos.Z = knockdownAirborneHeights[targetFrame - actionStart];
-      pos.Y += (isFacingRight ? -1 : 1) * knockdownVelocity;
+void ALogic::onEndRound() {
+  const int nextRound = roundNumber+1;
+  runOnGameThread([this, nextRound]() {
+    if (adaptiveInputDelay && GetWorld()->IsNetMode(NM_ListenServer))
+      MulticastInputDelay(chooseInputDelay(), nextRound);
+    if(OnEndRound.IsBound()) {
+      OnEndRound.Broadcast();
     }
-  }
+  });
 }
 
-struct PlayerDamageResult {
-  bool hit = false;
-  bool blocking = false;
-  bool grabbed = false;
-  int damage = 0;
-  float knockdownDistance = -1;
-  float pushbackDistance = 0;
-};
-
-static bool playerIsInvincible(Player& p, Player &q) {
-  return (p.action.type() == ActionType::KD) || ((p.action.type() == ActionType::DamageReaction) && (p.actionNumber == q.actionNumber));
+void ALogic::onEndFight() {
+  runOnGameThread([this]() {
+    saveRollbackStats();
+    if(OnEndFight.IsBound()) {
+      OnEndFight.Broadcast();
+    }
+  });
 }
 
-// returns the amount of correction needed to move player out of the bound
-float Player::collidesWithBoundary(float boundary, bool isRightBound, int targetFrame) {
-  const Box& b = action.collision(targetFrame);
-  float x = b.x, xend = b.xend;
-  if (!isFacingRight) {
-    x *= -1;
-    xend *= -1;
-    std::swap(x, xend);
-  }
-  x += pos.Y;
-  xend += pos.Y;
-  if (isRightBound && (xend > boundary)) {
-    return boundary-xend;
-  }
-  else if (!isRightBound && (x < boundary)) {
-    return boundary-x;
-  }
-  else {
-    return 0.0;
-  }
+FRollbackStats ALogic::getMatchRollbackStats() {
+  FScopeLock l(&simulationLock);
+  FRollbackStats s = getRollbackStats();
+  s.computeRates(framerate);
+  return s;
 }
 
-static bool collides(const Hitbox &p1b, const Hitbox &p2b, const Player &p1, const Player& p2, int targetFrame) {
-  return p1b.collides(p2b,
-                      targetFrame - p1.actionStart,
-                      targetFrame - p2.actionStart,
-                      p1.pos.Y, p1.pos.Z,
-                      p2.pos.Y, p2.pos.Z,
-                      p1.isFacingRight,
-                      p2.isFacingRight);
+bool ALogic::exportRollbackStats(const FString& fileName) {
+  FScopeLock l(&simulationLock);
+  return getMatchRollbackStats().save(fileName);
 }
 
-// returns the amount of adjustment player P needs
-float ALogic::playerCollisionExtent(const Player &p, const Player &q, int targetFrame) {
-  if ((p.action.type() == ActionType::Thrown) ||
-        (q.action.type() == ActionType::Thrown) ||
-        ((p.action.type() == ActionType::KD) && (frame - p.actionStart) < knockdownAirborneLength) ||
-        ((q.action.type() == ActionType::KD) && (frame - q.actionStart) < knockdownAirborneLength)) {
-    return 0.0;
-  }
-  else {
-    const Box &pb = p.action.collision(targetFrame);
-    const Box &qb = q.action.collision(targetFrame);
-    return qb.collisionExtent(pb, p.pos.Y, p.pos.Z, q.pos.Y, q.pos.Z, p.isFacingRight, q.isFacingRight);
-  }
+void ALogic::saveRollbackStats() {
+  // spectators never roll back
+  if (spectating)
+    return;
+  const FRollbackStats s = getMatchRollbackStats();
+  MYLOG(Display, "%i rollbacks (%.2f per second), %i frames resimulated in %.1f ms, %i near misses",
+        s.rollbacks, s.rollbacksPerSecond, s.resimulatedFrames, s.resimulationMs, s.nearMisses);
+  FString fileName = FString::Printf(TEXT("match-%s-%s.csv"), *FDateTime::Now().ToString(),
+                                     GetWorld()->IsNetMode(NM_Client) ? TEXT("client") : TEXT("host"));
+  if (!s.save(fileName))
+    MYLOG(Warning, "could not write %s", *fileName);
 }
 
-static void computeDamage(Player& q, Player &p, AFightInput& qInput, const Frame& newFrame, int targetFrame, bool isOnLeft, struct PlayerDamageResult &r) {
-  const float chipDamageMultiplier = 0.1;
-  if (collides(p.action.hitbox(), q.action.hurtbox(), p, q, targetFrame) ||
-      collides(p.action.hitbox(), Hitbox({q.action.collision(targetFrame)}), p, q, targetFrame)) {
-    // hit q
-    if (p.action.type() == ActionType::Grab) {
-      r.grabbed = true;
-      r.knockdownDistance = p.action.knockdownDistance();
-    }
-    else {
-      r.hit = true;
-      q.actionNumber = p.actionNumber;
-      q.hitstun = p.action.lockedFrames() - (targetFrame-p.actionStart) - 1;
-      r.damage = p.action.damage();
-      r.pushbackDistance = p.action.pushbackDistance();
-      enum GuardLevel qGuard = qInput.isGuarding(isOnLeft, targetFrame);
-      if ((q.action.type() != ActionType::Jump) &&
-          (q.action != q.action.character().damaged()) &&
-          ((qGuard == GuardLevel::Low) ||
-           (qGuard == GuardLevel::High) && (!q.action.hitsWalkingBack()))) {
-        r.blocking = true;
-        if (p.action.blockAdvantage() >= 0)
-          q.hitstun += p.action.blockAdvantage();
-        else
-          p.hitstun -= p.action.blockAdvantage();
-        q.health -= r.damage * chipDamageMultiplier; // chip damage
-      }
-      else {
-        if (p.action.hitAdvantage() >= 0)
-          q.hitstun += p.action.hitAdvantage();
-        else
-          p.hitstun -= p.action.hitAdvantage();
-        q.health -= r.damage;
-        r.knockdownDistance = p.action.knockdownDistance();
-      }
+void ALogic::onFrameConfirmed(int frame) {
+  runOnGameThread([this, frame]() {
+    if (OnFrameConfirmed.IsBound()) {
+      OnFrameConfirmed.Broadcast(frame);
     }
-  }
+  });
 }
 
-static void doDamageReaction(Player &p, PlayerDamageResult &r, int targetFrame, bool isOnLeft) {
-  if (r.hit) {
-    p.pos.Z = 0;
-    if (r.blocking) {
-      p.doBlockAction(targetFrame);
+void ALogic::onFightEvent(const FFightEvent& e) {
+  runOnGameThread([this, e]() {
+    if (OnFightEvent.IsBound()) {
+      OnFightEvent.Broadcast(e);
     }
-    else {
-      if (r.knockdownDistance >= 0)
-        p.doKdAction(targetFrame, isOnLeft, r.knockdownDistance);
-      else
-        p.doDamagedAction(targetFrame);
-    }
-  }
+  });
 }
 
-void ALogic::HandlePlayerBoundaryCollision(Frame &f, int targetFrame, bool doRightBoundary) {
-  float stageBound = doRightBoundary ? stageBoundRight.Y : stageBoundLeft.Y;
-  float p1CollisionAdj = f.p1.collidesWithBoundary(stageBound, doRightBoundary, targetFrame);
-  float p2CollisionAdj = f.p2.collidesWithBoundary(stageBound, doRightBoundary, targetFrame);
-  f.p1.pos.Y += p1CollisionAdj;
-  f.p2.pos.Y += p2CollisionAdj;
-  if ((p1CollisionAdj != 0.0) && (p2CollisionAdj == 0.0)) {
-    // if p2 collides with p1, also move p2
-    float collisionAdj = playerCollisionExtent(f.p2, f.p1, targetFrame);
-    //f.p2.pos.Y += collisionAdj;
-    // MYLOG(Display, "HandlePlayerBoundaryCollision: p1 collides with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
-  }
-  if ((p2CollisionAdj != 0.0) && (p1CollisionAdj == 0.0)) {
-    // if p1 collides with p2, also move p1
-    float collisionAdj = playerCollisionExtent(f.p1, f.p2, targetFrame);
-    f.p1.pos.Y += collisionAdj;
-    //MYLOG(Display, "p2 collides with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
-  }
-  else if ((p1CollisionAdj != 0.0) && (p2CollisionAdj != 0.0)) {
-    // at least one player must be jumping. Let the leftmost player
-    // take the corner
-    float collisionAdj;
-    if (doRightBoundary) {
-      collisionAdj = std::min(p1CollisionAdj, p2CollisionAdj);
-    }
-    else {
-      collisionAdj = std::max(p1CollisionAdj, p2CollisionAdj);
+void ALogic::onFightEventCancelled(const FFightEvent& e) {
+  runOnGameThread([this, e]() {
+    if (OnFightEventCancelled.IsBound()) {
+      OnFightEventCancelled.Broadcast(e);
     }
-    f.p1.pos.Y += collisionAdj;
-    f.p2.pos.Y += collisionAdj;
-    //MYLOG(Display, "p1 and p2 collide with %s", doRightBoundary ? TEXT("right") : TEXT("left"));
-  }
+  });
 }
 
-// Sets default values for this component's properties
-ALogic::ALogic(): frame(0)
-{
-  // Set this component to be initialized when the game starts, and to
-  // be ticked every frame. You can turn these features off to improve
-  // performance if you don't need them.
-  PrimaryActorTick.bCanEverTick = true;
-  PrimaryActorTick.TickGroup = TG_PrePhysics;
-  bReplicates = true;
-  init_actions();
-  framerate = 30;
-  rollbackAdjust = 0.001;
+int ALogic::getLastConfirmedFrame() {
+  FScopeLock l(&simulationLock);
+  return getConfirmedFrame();
 }
 
-// Called when the game starts or when spawned
-void ALogic::BeginPlay()
-{
-  Super::BeginPlay();
-
-  MYLOG(Display, TEXT("BeginPlay"));
-
-  // initialize some variables
-  init_actions();
-
-  frames = RingBuffer();
-  maxRollback = 20;
-  frames.reserve(maxRollback+1);
-
-  const int delay = 1;
-  const int buffer = 2;
-  p1Input->init(maxRollback, buffer, delay);
-  p2Input->init(maxRollback, buffer, delay);
-
-  mode = LogicMode::Wait;
-  inPreRound = false;
-  inEndRound = false;
-  roundEndFrame = std::numeric_limits<int>::max();
-  frame = 0;
-  reset(false);
-  acc = acc2 = 0;
-  pcs.clear();
-
-  roundNumber = 0;
-  p1Wins = 0;
-  p2Wins = 0;
+int ALogic::chooseInputDelay() {
+  // An input sent for frame T arrives half a round trip later and is
+  // used on frame T+delay, so the frames we have to resimulate are
+  // about oneWay-delay. Use a high percentile so that jitter spikes
+  // are covered too.
+  const LatencyEstimator& rtt = remoteInput()->getRttEstimator();
+  if (rtt.sampleCount() == 0)
+    return p1Input->getDelay();
+  float oneWayFrames = rtt.percentile(0.9) / 2000.0 * framerate;
+  int delay = std::ceil(oneWayFrames) - rollbackBudget;
+  return std::clamp(delay, 0, std::min(maxInputDelay, MAX_INPUT_DELAY));
 }
 
-void ALogic::addPlayerController(ALogicPlayerController* pc) {
-  pcs.push_back(pc);
+AFightInput* ALogic::remoteInput() {
+  // the host is always player 1
+  return GetWorld()->IsNetMode(NM_Client) ? p1Input : p2Input;
 }
 
-static UEngine* ge;
-static UStreetBrallersGameInstance* gi;
-
-void ALogic::reset(bool flipSpawns) {
-  gi = getSBGameInstance(GetWorld());
-  ge = gi->GetEngine();
-  p1Input->reset();
-  p2Input->reset();
-  // construct initial frame
-  check(UGameplayStatics::GetGameState(GetWorld()) != nullptr);
-  AFightGameState* gs = Cast<AFightGameState>(UGameplayStatics::GetGameState(GetWorld()));
-  check(gs != nullptr);
-  p1Char = HCharacter(gs->p1Char);
-  if (GetWorld()->IsNetMode(NM_Client))
-    p2Char = HCharacter(gi->p2Char);
-  else
-    p2Char = HCharacter(gs->p2Char);
-  Frame f (Player(flipSpawns ? rightStart : leftStart, p1Char.idle()), Player(flipSpawns ? leftStart : rightStart, p2Char.idle()));
-  f.frameNumber = frame;
-  f.p1.isFacingRight = IsP1OnLeft(f);
-  f.p2.isFacingRight = !IsP1OnLeft(f);
-  frames.clear();
-  frames.push(f);
+bool ALogic::isOnline() {
+  return !GetWorld()->IsNetMode(NM_Standalone);
 }
 
-void ALogic::setMode(enum LogicMode m) {
-  mode = m;
-  p1Input->setMode(m);
-  p2Input->setMode(m);
+void ALogic::MulticastInputDelay_Implementation(int delay, int round) {
+  FScopeLock l(&simulationLock);
+  MYLOG(Display, "MulticastInputDelay %i (round %i)", delay, round);
+  pendingDelay = delay;
+  pendingDelayRound = round;
 }
 
-void ALogic::preRound() {
-  MYLOG(Display, "preRound");
-  if (!skipPreRound) {
-    setMode(LogicMode::Idle);
-    inPreRound = true;
-    roundStartFrame = ((roundEndFrame == std::numeric_limits<int>::max()) ? 0 : roundEndFrame) + ENDROUND_TIME + PREROUND_TIME;
-    MYLOG(Display, "preRound %i", roundStartFrame);
-  }
-  ++roundNumber;
-  reset(bool((roundNumber+1)%2));
-  roundEndFrame = std::numeric_limits<int>::max();
-  rollbackStopFrame = frame;
-  if (skipPreRound) {
-    beginRound();
-  }
-  else {
-    if(OnPreRound.IsBound()) {
-      OnPreRound.Broadcast();
-    }
-  }
-}
-void ALogic::beginRound() {
-  MYLOG(Display, "beginRound");
-  rollbackStopFrame = frame;
-  setMode(LogicMode::Fight);
-  if(OnBeginRound.IsBound()) {
-    OnBeginRound.Broadcast();
+void ALogic::FightTick() {
+  // MYLOG(Display, "FightTick");
+  p1Input->drainRecievedInputs();
+  p2Input->drainRecievedInputs();
+  // Only sample inputs for a frame that we are going to simulate, but
+  // keep sending the old ones; the peer may be stalled on them.
+  const bool stalled = isStalled();
+  for (auto pc: pcs) {
+    if (stalled)
+      pc->resendButtons();
+    else
+      pc->sendButtons();
   }
+  if (bot && !stalled)
+    sampleBot();
+  if (simulateFrame())
+    updateStall();
 }
 
-void ALogic::endRound() {
-  MYLOG(Display, "endRound %i", roundEndFrame);
-  setMode(LogicMode::Idle);
-  inEndRound = true;
-  roundTimeTotal = roundEndFrame - roundStartFrame;
-  roundStartFrame = roundEndFrame+ENDROUND_TIME;
-  rollbackStopFrame = roundEndFrame; // we need this because when we
-                                     // set AFightInput to idle, a
-                                     // rollback could result in an
-                                     // attack turning into an idle.
-  if(OnEndRound.IsBound()) {
-    OnEndRound.Broadcast();
-  }
+void ALogic::sampleBot() {
+  p2Input->packedButtons(bot->nextInput(*this), frame+1);
 }
 
-void ALogic::endFight() {
-  MYLOG(Display, "endFight");
+bool ALogic::simulateFrame() {
+  if (simulate())
+    return true;
   setMode(LogicMode::Wait);
-  if(OnEndFight.IsBound()) {
-    OnEndFight.Broadcast();
-  }
-}
-
-bool ALogic::IsPlayerOnLeft(const Player& p1, const Player& p2) {
-  return p1.pos.Y <= p2.pos.Y;
-}
-
-bool ALogic::IsP1OnLeft(const Frame& f) {
-  return IsPlayerOnLeft(f.p1, f.p2);
+  runOnGameThread([this]() {
+    saveRollbackStats();
+    gameInstance->ReturnToMenuWithMessage(FString("Maximum rollback exceeded."));
+  });
+  return false;
 }
 
-// the targetFrame field is required for using the right inputs from
-// AFightInputs. The frame buffer's latest frame should be the one
-// just before the targetFrame.
-void ALogic::computeFrame(int targetFrame) {
-  const Frame& lastFrame = frames.last();
-
-  // make a copy of the most recent frame. we will update the values
-  // in this newFrame and keep the last one.
-  Frame newFrame (lastFrame);
-  Player& p1 = newFrame.p1;
-  Player& p2 = newFrame.p2;
-
-  // If the player can act and there is a new action waiting, then
-  // start the new action
-  bool isP1OnLeft = IsP1OnLeft(newFrame);
-  // first do damage if they are leaving a thrown action
-  if ((p1.action.type() == ActionType::Thrown) && ((targetFrame - p1.actionStart) == p1.action.animationLength()))
-    p1.health -= p2.action.damage();
-  if ((p2.action.type() == ActionType::Thrown) && ((targetFrame - p2.actionStart) == p2.action.animationLength()))
-    p2.health -= p1.action.damage();
-  if ((targetFrame <= roundEndFrame) && (newFrame.hitstop == 0)) {
-    p1.TryStartingNewAction(targetFrame, *p1Input, isP1OnLeft);
-    p2.TryStartingNewAction(targetFrame, *p2Input, !isP1OnLeft);
-  }
-
-  // compute player positions (if they are in a moving action). This
-  // includes checking collision boxes and not letting players walk
-  // out of bounds.
-  FVector oldP1Posv = p1.pos,
-    oldP2Posv = p2.pos;
-  double oldP1Pos = p1.pos.Y,
-    oldP2Pos = p2.pos.Y,
-    oldPos = (oldP1Pos + oldP2Pos)/2;
-  p1.doMotion(targetFrame);
-  p2.doMotion(targetFrame);
-  if (std::abs(p1.pos.Y - p2.pos.Y) > 121.0) {
-    if (std::abs(p1.pos.Y - oldPos) > std::abs(oldP1Pos - oldPos)) {
-      p1.pos = oldP1Posv;
-    }
-    if (std::abs(p2.pos.Y - oldPos) > std::abs(oldP2Pos - oldPos)) {
-      p2.pos = oldP2Posv;
-    }
-  }
-  // recompute who is on left, useful in the case of a jumping cross
-  // up
-  isP1OnLeft = IsP1OnLeft(newFrame);
-
-  // check for player-player collisions
-  float collisionAdj = playerCollisionExtent(p1, p2, targetFrame);
-  if (collisionAdj != 0.0) {
-    float p1CollisionAdj = 0.5 * collisionAdj;
-    float p2CollisionAdj = -0.5 * collisionAdj;
-    if (p1.pos.Y == p2.pos.Y) {
-      // players are on top of eachother; move the higher player in
-      // their current velocity direction
-      int direction = (p1.action.velocity().Y > 0) ? 1 : -1;
-      p1CollisionAdj = direction * std::abs(p1CollisionAdj);
-      p2CollisionAdj = -1 * direction * std::abs(p2CollisionAdj);
-    }
-    p1.pos.Y += p1CollisionAdj;
-    p2.pos.Y += p2CollisionAdj;
-    // if (!(((p1v.Y > 0) && (p2v.Y > 0)) ||
-    //       ((p1v.Y < 0) && (p2v.Y < 0)))) {
-    //   // players are moving into eachother. dampen how much they push
-    //   // eachother by moving them back closer to where they were on
-    //   // the previous frame
-    //   float newMean = p1.pos.Y + p2.pos.Y;
-    //   float oldMean = frames.last().p1.pos.Y + frames.last().p2.pos.Y;
-    //   float meanAdj = 0.25 * (oldMean-newMean);
-    //   p1.pos.Y += meanAdj;
-    //   p2.pos.Y += meanAdj;
-    // }
-  }
-
-  // check for player-boundary collisions, not preserving spacing
-  HandlePlayerBoundaryCollision(newFrame, targetFrame, false);
-  HandlePlayerBoundaryCollision(newFrame, targetFrame, true);
-  isP1OnLeft = IsP1OnLeft(newFrame);
-
-  // check hitboxes, compute damage. Don't forget the case of ties.
-  //MYLOG(Display, "hitstop %i", newFrame.hitstop);
-  if (newFrame.hitstop == 0) { // only check hitboxes if we are not in hitstop
-    // first do hitstun if we are in hitstun
-    if (p1.hitstun) --p1.hitstun;
-    if (p2.hitstun) --p2.hitstun;
-
-    if (!(playerIsInvincible(p1, p2) || playerIsInvincible(p2, p1))) {
-      struct PlayerDamageResult p1Damage, p2Damage;
-      computeDamage(p1, p2, *p1Input, newFrame, targetFrame, isP1OnLeft, p1Damage);
-      computeDamage(p2, p1, *p2Input, newFrame, targetFrame, !isP1OnLeft, p2Damage);
-      if (p1Damage.hit || p2Damage.hit)
-        p1Damage.grabbed = p2Damage.grabbed = false; // grabs lose to attacks
-
-      // TODO: should spawn special FX on hit/block here
-      doDamageReaction(p1, p1Damage, targetFrame, isP1OnLeft);
-      doDamageReaction(p2, p2Damage, targetFrame, !isP1OnLeft);
-      if (p1Damage.hit) {
-        newFrame.hitPlayer = 1;
-        MYLOG(Display, "P1 Hit %i", p1.health);
-      }
-      if (p2Damage.hit) {
-        newFrame.hitPlayer = 2;
-        MYLOG(Display, "P2 Hit %i", p2.health);
-      }
-      if (p1Damage.grabbed && p2Damage.grabbed) {
-        // both players grabbed at same time; no tech animation so just
-        // do block animation with pushback
-        p1.doBlockAction(targetFrame);
-        p2.doBlockAction(targetFrame);
-        newFrame.hitstop = 10;
-        newFrame.pushbackPerFrame = 3.0;
-      }
-      else if (p1Damage.hit || p2Damage.hit) {
-        newFrame.hitstop = std::max(1, (int) (std::ceil(std::sqrt(std::max(p1Damage.damage, p2Damage.damage))+0.0)));
-        newFrame.pushbackPerFrame = (p1Damage.pushbackDistance + p2Damage.pushbackDistance) / newFrame.hitstop;
-      }
-      if ((p1Damage.hit && p2Damage.hit) || (p1Damage.grabbed && p2Damage.grabbed)) {
-        newFrame.hitPlayer = 0;
-        // add the hitstop because we won't do real hitstop when ties
-        // happen, only pushback
-        p1.hitstun += newFrame.hitstop;
-        p2.hitstun += newFrame.hitstop;
-      }
-      if (!(p1Damage.grabbed && p2Damage.grabbed)) {
-        if (p1Damage.grabbed) {
-          p1.doThrownAction(targetFrame, isP1OnLeft, p1Damage.knockdownDistance, p1.action.character().thrown(), p2);
-          p2.startNewAction(targetFrame, p2.action.character().throw_(), !isP1OnLeft);
-        }
-        if (p2Damage.grabbed) {
-          p1.startNewAction(targetFrame, p1.action.character().throw_(), isP1OnLeft);
-          p2.doThrownAction(targetFrame, !isP1OnLeft, p2Damage.knockdownDistance, p2.action.character().thrown(), p1);
-        }
-      }
-    }
-  }
-  else { // we are in hitstop
-    // keep the attacking player frozen, do pushback, keep players in bounds
-    if ((newFrame.hitPlayer == 1) || (newFrame.hitPlayer == 0)) {
-      // do pushback
-      p1.pos.Y += (isP1OnLeft ? -1 : 1) * newFrame.pushbackPerFrame;
-    }
-    if ((newFrame.hitPlayer == 2) || (newFrame.hitPlayer == 0)) {
-      // do pushback
-      p2.pos.Y += (!isP1OnLeft ? -1 : 1) * newFrame.pushbackPerFrame;
-    }
-    // this causes the freeze on the players' animations
-    ++p2.actionStart;
-    ++p1.actionStart;
-
-    // put players back in bounds, preserving spacing
-    Player& pleft = isP1OnLeft ? p1 : p2;
-    Player& pright = !isP1OnLeft ? p1 : p2;
-    int collisionExtent = pleft.collidesWithBoundary(stageBoundLeft.Y, false, targetFrame);
-    p1.pos.Y += collisionExtent;
-    p2.pos.Y += collisionExtent;
-    collisionExtent = pright.collidesWithBoundary(stageBoundRight.Y, true, targetFrame);
-    p1.pos.Y += collisionExtent;
-    p2.pos.Y += collisionExtent;
-
-    --newFrame.hitstop;
+void ALogic::updateStall() {
+  if (!isStalled()) {
+    stallStart = -1.0;
+    return;
+  }
+  const float now = GetWorld()->GetRealTimeSeconds();
+  if (stallStart < 0.0) {
+    MYLOG(Display, "stalled on frame %i, waiting for inputs", frame);
+    stallStart = now;
+  }
+  else if ((now - stallStart) > (waitingForRejoin ? reconnectTimeout : config.disconnectTimeout)) {
+    MYLOG(Warning, "no inputs for %.1f s, giving up", now - stallStart);
+    saveRollbackStats();
+    setMode(LogicMode::Wait);
+    gameInstance->ReturnToMenuWithMessage(FString("Opponent disconnected."));
+  }
+}
+
+bool ALogic::isWaitingForOpponent() {
+  return published.read().waitingForOpponent;
+}
+
+void ALogic::ThreadedTick() {
+  // The events broadcast to blueprints and write files, so run them
+  // without holding up the simulation thread. They lock what they
+  // need themselves.
+  std::vector<TFunction<void()>> events;
+  {
+    FScopeLock l(&simulationLock);
+    std::swap(events, gameThreadEvents);
+  }
+  for (auto& event: events)
+    event();
+
+  FScopeLock l(&simulationLock);
+  p1Input->drainRecievedInputs();
+  p2Input->drainRecievedInputs();
+  if ((mode == LogicMode::Wait) || spectating)
+    return;
+  // once per logic frame, like FightTick()
+  if (sendsDue) {
+    for (auto pc: pcs)
+      pc->resendButtons();
+    sendsDue = false;
+  }
+  updateStall();
+  if (GetWorld()->IsNetMode(NM_ListenServer))
+    feedSpectators();
+}
+
+float ALogic::simulationStep(double due) {
+  FScopeLock l(&simulationLock);
+  const float frameTime = 1.0/framerate;
+  if (mode == LogicMode::Wait)
+    return frameTime;
+  const double started = FPlatformTime::Seconds();
+  const int resimulatedBefore = getRollbackStats().resimulatedFrames;
+  if (mode == LogicMode::Idle)
+    updateRoundSequence();
+  previousFrame = frames.last();
+  if (spectating) {
+    SpectatorTick();
   }
+  else {
+    // like FightTick(), but the game thread does the networking
+    if (!isStalled()) {
+      for (auto pc: pcs)
+        pc->sampleButtons();
+      if (bot)
+        sampleBot();
+    }
+    sendsDue = true;
+    simulateFrame();
+  }
+  p1Input->setLocalFrame(frame);
+  p2Input->setLocalFrame(frame);
+  if (isOnline() && !spectating) {
+    timeSync.update(getLocalFrameAdvantage(), remoteInput()->getPeerFrameAdvantage());
+    frameStretch = timeSync.nextFrameStretch();
+  }
+  const float stepTime = frameTime*(1.0f + frameStretch);
+  publishFrame(stepTime);
+  recordFrame(due, started, resimulatedBefore, 0.0);
+  return stepTime;
+}
+
+void ALogic::recordFrame(double due, double started, int resimulatedBefore, float renderDeltaSeconds) {
+  framePacing.add(frame, due, started, FPlatformTime::Seconds(),
+                  getRollbackStats().resimulatedFrames - resimulatedBefore, renderDeltaSeconds, isStalled());
+}
+
+bool ALogic::exportFramePacing(const FString& fileName) {
+  FScopeLock l(&simulationLock);
+  return framePacing.save(fileName);
+}
+
+void ALogic::publishFrame(float stepTime) {
+  PublishedFrame& p = published.write();
+  p.latest = frames.last();
+  p.previous = previousFrame;
+  p.frame = frame;
+  p.roundNumber = roundNumber;
+  p.p1Wins = p1Wins;
+  p.p2Wins = p2Wins;
+  p.roundTime = inPreRound ? 0 : (inEndRound ? roundTimeTotal : (frame - roundStartFrame)) / framerate;
+  p.roundWinner = roundWinner();
+  p.inputDelay = p1Input->getDelay();
+  p.frameAdvantage = timeSync.getAdvantage();
+  p.waitingForOpponent = isStalled();
+  p.p1CharName = p1Char.name();
+  p.p2CharName = p2Char.name();
+  p.time = FPlatformTime::Seconds();
+  p.stepTime = stepTime;
+  published.publish();
+}
 
-#define ROUND_TIME 99
-
-  if (!inEndRound) {
-    if (targetFrame <= roundEndFrame) {
-      // if we are not past the end of the round
-      if (((targetFrame - roundStartFrame)/30) == 99) {
-        // time out
-        roundEndFrame = targetFrame;
-      }
-      else if ((p1.health <= 0) || (p2.health <= 0)) {
-        if (p1.health <= 0) {
-          p1.health = 0;
-          if (p1.action.type() != ActionType::KD)
-            p1.knockdownVelocity = 2.3;
-          p1.startNewAction(targetFrame, p1.action.character().defeat(), isP1OnLeft);
-        }
-        if (p2.health <= 0){
-          p2.health = 0;
-          if (p2.action.type() != ActionType::KD)
-            p2.knockdownVelocity = 2.3;
-          p2.startNewAction(targetFrame, p2.action.character().defeat(), !isP1OnLeft);
-        }
-        // round ended; update roundEndFrame. this could be the first
-        // time we set it or it could be setting it to an earlier time
-        roundEndFrame = targetFrame;
-      }
-      else if (roundEndFrame != targetFrame)
-        // round did not end on roundEndFrame; unset it
-        roundEndFrame = std::numeric_limits<int>::max();
-    }
-    if (p1Input->hasRecievedInputForFrame(roundEndFrame) && p2Input->hasRecievedInputForFrame(roundEndFrame)) {
-      // don't actually end round until players are synced up to round
-      // end
-      if (getRoundWinner() == 0)
-        ++p1Wins;
-      else if (getRoundWinner() == 1)
-        ++p2Wins;
-      else { // ties give win to both players
-        ++p1Wins;
-        ++p2Wins;
-      }
-      if ((p1Wins == 2) || (p2Wins == 2))
-        endFight();
-      else
-        endRound();
-    }
+// Called every frame
+void ALogic::SpectatorTick() {
+  // run faster while far behind, e.g. after joining late
+  int steps = ((spectatorFeed.lastFrame() - frame) > SPECTATOR_CATCHUP_FRAMES) ? SPECTATOR_CATCHUP_STEPS : 1;
+  for (int i = 0; i < steps; ++i) {
+    if (mode == LogicMode::Wait)
+      break;
+    // updateRoundSequence() starts rounds on exactly this frame
+    if ((inPreRound || inEndRound) && (frame >= (roundStartFrame-1)))
+      break;
+    int targetFrame = frame+1;
+    if (targetFrame > spectatorFeed.lastFrame())
+      break; // wait for the host
+    // the same inputs that the players gave their inputs for this
+    // frame, which can never need a rollback
+    p1Input->packedButtons(spectatorFeed.p1State(targetFrame), targetFrame);
+    p2Input->packedButtons(spectatorFeed.p2State(targetFrame), targetFrame);
+    frame = targetFrame;
+    computeFrame(frame);
   }
-
-  newFrame.frameNumber = frame;
-  frames.push(newFrame);
+  // every frame we simulate is final, and we won't read its inputs
+  // again
+  confirmFrames(frame);
+  spectatorFeed.prune(frame+1);
 }
 
-void ALogic::FightTick() {
-  // MYLOG(Display, "FightTick");
-
-  int latestInputFrame = std::max(p1Input->getCurrentFrame(), p2Input->getCurrentFrame());
-  int targetFrame = std::max(latestInputFrame, frame+1);
+void ALogic::feedSpectators() {
+  // A frame is confirmed once we have the inputs of both players for
+  // it. Nothing after that can change them.
+  int confirmed = std::min(p1Input->getLastInputFrame(), p2Input->getLastInputFrame());
+  for (int f = spectatorFeed.lastFrame()+1; f <= confirmed; ++f)
+    spectatorFeed.add(p1Input->getPackedInput(f), p2Input->getPackedInput(f));
 
-  if (alwaysRollback || p1Input->needsRollback() || p2Input->needsRollback()) {
-    if (!alwaysRollback) {
-      MYLOG(Warning, "Rollback");
-    }
-    // rollbackToFrame is the frame of the input new input
-    int rollbackToFrame = std::min(p1Input->getNeedsRollbackToFrame(), p2Input->getNeedsRollbackToFrame());
-    if (rollbackToFrame != -1) {
-      if (alwaysRollback || (rollbackToFrame == std::numeric_limits<int>::max()))
-        rollbackToFrame = std::max(rollbackToFrame, frame - maxRollback + 1);
-      rollbackToFrame = std::max(rollbackStopFrame+1, rollbackToFrame);
-    }
-    if ((rollbackToFrame == -1) || ((frame - rollbackToFrame) >= maxRollback)) {
-      // exceeded maximum rollback. we do not have data old enough to
-      // rollback, simulate the fight and guarantee consistency.
-      if (rollbackToFrame == -1) {
-        MYLOG(Warning, "MAXIMUM FUTURE EXCEEDED!");
-      }
-      else {
-        MYLOG(Warning, "MAXIMUM ROLLBACK EXCEEDED!");
-      }
-      setMode(LogicMode::Wait);
-      gi->ReturnToMenuWithMessage(FString("Maximum rollback exceeded."));
-      return;
-    }
-    else {
-      // pop off all the frames that occur at or after the input
-      frames.popn(frame - rollbackToFrame + 1);
-    }
-    p1Input->clearRollbackFlags();
-    p2Input->clearRollbackFlags();
-    frame = rollbackToFrame-1;
-  }
-
-  while (frame < targetFrame) {
-    ++frame;
-    computeFrame(frame);
-    // MYLOG(Display, "TICK %i %i!", frame, frames.last().frameNumber);
+  if (spectators.empty() || ((frame % std::max(1, spectatorSendInterval)) != 0))
+    return;
+  int upTo = spectatorFeed.lastFrame() - spectatorDelay;
+  for (auto& spectator: spectators) {
+    SpectatorPacket p;
+    if (!spectatorFeed.makePacket(spectator.sentFrame, upTo, p))
+      continue;
+    TArray<uint8> packet;
+    p.encode(packet);
+    spectator.pc->ClientSpectatorInputs(packet);
+    spectator.sentFrame = p.lastFrame();
   }
 }
 
-static int frame_ = 0;
-
-// Called every frame
 void ALogic::Tick(float DeltaSeconds)
 {
   Super::Tick(DeltaSeconds);
 
   // MYLOG(Display, "Tick");
+  if (simulationThread) {
+    ThreadedTick();
+    return;
+  }
   switch (mode) {
+  case LogicMode::Wait:
+    // drop the inputs that arrive while we are not simulating
+    p1Input->drainRecievedInputs();
+    p2Input->drainRecievedInputs();
+    break;
   case LogicMode::Idle:
-    if (inPreRound && (frame >= (roundStartFrame-1))) {
-      if (frame > (roundStartFrame-1)) {
-        frames.popn(frame - (roundStartFrame-1));
-        frame = (roundStartFrame-1);
-        // TODO: we rewind FRAME here but this actually messes up
-        // AFightPlayerController::sendButtons(), which will put the
-        // buttons that belong on a later frame to the roundStartFrame
-        // instead
-      }
-      inPreRound = false;
-      beginRound();
-    }
-    if (inEndRound && (frame >= (roundStartFrame-1))) {
-      // if (frame > (roundStartFrame-1)) {
-      //   frames.popn(frame - (roundStartFrame-1));
-      //   frame = (roundStartFrame-1);
-      // }
-      inEndRound = false;
-      preRound();
-    }
+    updateRoundSequence();
   case LogicMode::Fight:
-    acc += DeltaSeconds;
-    float desyncAdjustment = 0.0;
-    if (p1Input->getDesync() != 0.0)
-      desyncAdjustment = p1Input->getDesync();
-    if (p2Input->getDesync() != 0.0)
-      desyncAdjustment = p2Input->getDesync();
-    if (std::abs(desyncAdjustment) <= 1.0)
-      desyncAdjustment = 0.0;
-    else
-      desyncAdjustment *= -1.0 * rollbackAdjust;
-    if (acc >= ((1.0/framerate) + desyncAdjustment - 0.00001)) {
-      for (auto pc: pcs)
-        pc->sendButtons();
-      FightTick();
-      acc = 0;
+    clock.advance(DeltaSeconds);
+    const double now = FPlatformTime::Seconds();
+    const float frameTime = 1.0/framerate;
+    while (clock.step(frameTime*(1.0f + frameStretch))) {
+      const double started = FPlatformTime::Seconds();
+      const int resimulatedBefore = getRollbackStats().resimulatedFrames;
+      previousFrame = frames.last();
+      if (spectating) {
+        SpectatorTick();
+      }
+      else {
+        FightTick();
+      }
+      p1Input->setLocalFrame(frame);
+      p2Input->setLocalFrame(frame);
+      if (isOnline() && !spectating) {
+        timeSync.update(getLocalFrameAdvantage(), remoteInput()->getPeerFrameAdvantage());
+        frameStretch = timeSync.nextFrameStretch();
+      }
+      if (GetWorld()->IsNetMode(NM_ListenServer))
+        feedSpectators();
+      publishFrame(frameTime*(1.0f + frameStretch));
+      recordFrame(now - clock.getLateness(), started, resimulatedBefore, DeltaSeconds);
+      if (mode == LogicMode::Wait)
+        break;
     }
     acc2 += DeltaSeconds;
     ++frame_;
     if (acc2 >= 1.0) {
-      ge->AddOnScreenDebugMessage(-1, 5.f, FColor::Red, FString::Printf(TEXT("FPS: %i (ticks %i) (frame %i) %f %f %f %s"), frame - startFrame_, frame_ - startFrame_, frame, p1Input->getDesync(), p2Input->getDesync(), desyncAdjustment, (desyncAdjustment == 0.0) ? TEXT("No adj") : TEXT("Yes Adj")));
-      // MYLOG(Display, "FPS: %i (ticks %i) (frame %i) %f %f %f %s", frame - startFrame_, frame - frame_, frame, p1Input->getDesync(), p2Input->getDesync(), desyncAdjustment, (desyncAdjustment == 0.0) ? TEXT("No adj") : TEXT("Yes Adj"));
+      gameInstance->GetEngine()->AddOnScreenDebugMessage(-1, 5.f, FColor::Red, FString::Printf(TEXT("FPS: %i (ticks %i) (frame %i) (advantage %.2f local %.2f remote %.2f wait %.2f) (in %.0f %.0f B/s) (rtt %.0f ms jitter %.0f ms)"), frame - startFrame_, frame_ - startFrame_, frame, timeSync.getAdvantage(), getLocalFrameAdvantage(), remoteInput()->getPeerFrameAdvantage(), timeSync.getPendingWait(), p1Input->getRecievedBytesPerSecond(), p2Input->getRecievedBytesPerSecond(), remoteInput()->getRoundTripTime(), remoteInput()->getRoundTripJitter()));
+      gameInstance->GetEngine()->AddOnScreenDebugMessage(-1, 5.f, FColor::Red, FString::Printf(TEXT("Pacing: (late p99 %.1f ms) (interval p99 %.1f ms) (compute p99 %.1f ms) (render p99 %.1f ms) (resimulated %i stalled %i)"), framePacing.lateMsPercentile(0.99), framePacing.intervalMsPercentile(0.99), framePacing.computeMsPercentile(0.99), framePacing.renderDeltaMsPercentile(0.99), framePacing.resimulatedFrames(), framePacing.stalledFrames()));
       startFrame_ = frame;
       frame_ = frame;
       acc2 = 0.0;
@@ -876,21 +674,25 @@ void ALogic::Tick(float DeltaSeconds)
   }
 }
 
-const Player& ALogic::getPlayer1() {
-  return frames.last().p1;
+Player ALogic::getPlayer1() {
+  return published.read().latest.p1;
+}
+
+Player ALogic::getPlayer2() {
+  return published.read().latest.p2;
 }
 
-const Player& ALogic::getPlayer2() {
-  return frames.last().p2;
+Player ALogic::getPlayer(int playerNumber) {
+  return publishedPlayer(published.read(), playerNumber);
 }
 
-const Player& ALogic::getPlayer(int playerNumber) {
+const Player& ALogic::publishedPlayer(const PublishedFrame& p, int playerNumber) {
   switch (playerNumber) {
-  case 0: return getPlayer1();
-  case 1: return getPlayer2();
+  case 0: return p.latest.p1;
+  case 1: return p.latest.p2;
   default:
     MYLOG(Error, "getPlayer: playerNumber is not 0 or 1! (player number: %i)", playerNumber);
-    return getPlayer1();
+    return p.latest.p1;
   }
 }
 
@@ -898,6 +700,62 @@ FVector ALogic::playerPos(int playerNumber) {
   return getPlayer(playerNumber).pos;
 }
 
+float ALogic::getInterpolationAlpha() {
+  return interpolationAlpha(published.read());
+}
+
+float ALogic::interpolationAlpha(const PublishedFrame& p) {
+  if (!simulationThread)
+    return clock.getAlpha();
+  if (p.stepTime <= 0.0)
+    return 0.0;
+  return FMath::Clamp((float) ((FPlatformTime::Seconds() - p.time) / p.stepTime), 0.0f, 1.0f);
+}
+
+FVector ALogic::playerInterpolatedPos(int playerNumber) {
+  const PublishedFrame& p = published.read();
+  return interpolatedPos(p, playerNumber, interpolationAlpha(p));
+}
+
+FVector ALogic::interpolatedPos(const PublishedFrame& p, int playerNumber, float alpha) {
+  const Player& to = (playerNumber == 1) ? p.latest.p2 : p.latest.p1;
+  // nothing to blend from across a rollback to an earlier round, a
+  // reset() or several frames in one render frame
+  if (p.previous.frameNumber != p.latest.frameNumber - 1)
+    return to.pos;
+  const Player& from = (playerNumber == 1) ? p.previous.p2 : p.previous.p1;
+  return FMath::Lerp(from.pos, to.pos, alpha);
+}
+
+FFightVisualState ALogic::getVisualState() {
+  const PublishedFrame& p = published.read();
+  FFightVisualState s;
+  s.frame = p.frame;
+  s.roundNumber = p.roundNumber;
+  s.roundTime = p.roundTime;
+  s.roundWinner = p.roundWinner;
+  s.interpolationAlpha = interpolationAlpha(p);
+  s.p1 = playerVisualState(p, 0, s.interpolationAlpha);
+  s.p2 = playerVisualState(p, 1, s.interpolationAlpha);
+  return s;
+}
+
+FFightPlayerVisualState ALogic::playerVisualState(const PublishedFrame& p, int playerNumber, float alpha) {
+  const Player& player = (playerNumber == 1) ? p.latest.p2 : p.latest.p1;
+  const Player& other = (playerNumber == 1) ? p.latest.p1 : p.latest.p2;
+  FFightPlayerVisualState s;
+  s.pos = player.pos;
+  s.interpolatedPos = interpolatedPos(p, playerNumber, alpha);
+  s.isFacingRight = player.isFacingRight;
+  s.health = player.health;
+  s.animation = player.action.animation();
+  s.animationFrame = p.frame - player.actionStart;
+  s.side = (playerNumber+p.roundNumber) % 2;
+  s.currentSide = (player.pos.Y < other.pos.Y) ? 0 : 1;
+  s.wins = (playerNumber == 1) ? p.p2Wins : p.p1Wins;
+  return s;
+}
+
 bool ALogic::playerIsFacingRight(int playerNumber) {
   return getPlayer(playerNumber).isFacingRight;
 }
@@ -911,56 +769,70 @@ int ALogic::playerAnimation(int playerNumber) {
 }
 
 int ALogic::playerFrame(int playerNumber) {
-  return (frame - getPlayer(playerNumber).actionStart);
+  const PublishedFrame& p = published.read();
+  return (p.frame - publishedPlayer(p, playerNumber).actionStart);
 }
 
 int ALogic::getPlayerSide(int playerNumber) {
-  return (playerNumber+roundNumber) % 2;
+  return (playerNumber+published.read().roundNumber) % 2;
 }
 
 int ALogic::getPlayerCurrentSide(int playerNumber) {
-  return (getPlayer(playerNumber).pos.Y < getPlayer((playerNumber+1)%2).pos.Y) ? 0 : 1;
+  const PublishedFrame& p = published.read();
+  return (publishedPlayer(p, playerNumber).pos.Y < publishedPlayer(p, (playerNumber+1)%2).pos.Y) ? 0 : 1;
 }
 
 FString ALogic::getPlayerCharacterName(int playerNumber) {
+  const PublishedFrame& p = published.read();
   if (playerNumber == 0)
-    return FString(p1Char.name());
+    return FString(p.p1CharName);
   else
-    return FString(p2Char.name());
+    return FString(p.p2CharName);
 }
 
 int ALogic::getPlayerWins(int playerNumber) {
+  const PublishedFrame& p = published.read();
   if (playerNumber == 0)
-    return p1Wins;
+    return p.p1Wins;
   else
-    return p2Wins;
+    return p.p2Wins;
 }
 
 int ALogic::getRoundTime() {
-  if (inPreRound)
-    return 0;
-  if (inEndRound)
-    return roundTimeTotal / 30;
-  return (frame - roundStartFrame) / 30;
+  return published.read().roundTime;
 }
 
 int ALogic::getRoundNumber() {
-  return roundNumber;
+  return published.read().roundNumber;
 }
 
 int ALogic::getRoundWinner() {
-  if (getPlayer(1).health < getPlayer(0).health)
-    return 0;
-  else if (getPlayer(0).health < getPlayer(1).health)
-    return 1;
-  else // if (getPlayer(0).health == getPlayer(1).health)
-    return 2;
+  return published.read().roundWinner;
+}
+
+int ALogic::getInputDelay() {
+  return published.read().inputDelay;
 }
 
 int ALogic::getCurrentFrame() {
+  FScopeLock l(&simulationLock);
   return frame;
 }
 
+float ALogic::getLocalFrameAdvantage() {
+  const AFightInput* r = remoteInput();
+  if (!isOnline() || (r->getFrameOffsetEstimator().sampleCount() == 0))
+    return 0.0;
+  // The newest input in a packet is for the sender's frame+1, and the
+  // sender has moved on by the one way latency since it sent it.
+  float oneWayFrames = r->getRoundTripTime() / 2000.0 * framerate;
+  return r->getFrameOffset() + 1.0 - oneWayFrames;
+}
+
+float ALogic::getFrameAdvantage() {
+  return published.read().frameAdvantage;
+}
+
 void ALogic::ClientPlayersReady_Implementation() {
   MYLOG(Warning, "ClientPlayersReady");
   preRound();
@@ -7,85 +7,87 @@
 #include "EngineUtils.h"
 #include "Action.h"
 #include "FightInput.h"
+#include "FightSimulation.h"
+#include "FightVisualState.h"
 #include "FightGameState.h"
 #include "LogicMode.h"
 #include "LogicPlayerController.h"
+#include "TimeSync.h"
+#include "FixedStepClock.h"
+#include "TripleBuffer.h"
+#include "FramePacing.h"
+#include "FightSimulationThread.h"
+#include "FightBot.h"
+#include "HAL/CriticalSection.h"
+#include "SpectatorFeed.h"
 #include "Logic.generated.h"
 
+class UStreetBrallersGameInstance;
+class FRunnableThread;
+
 // Important fight sequence events. It should be possible to bind to
 // these events from blueprints.
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnPreRoundDelegate);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnBeginRoundDelegate);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnEndRoundDelegate);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnEndFightDelegate);
-
-class Player {
-public:
-  FVector pos;
-  HAction action;
-  bool isFacingRight;
-  int actionStart;
-  int health;
-  int hitstun = 0;
-  float knockdownVelocity;
-  int actionNumber = 0; // used to prevent a lingering hitbox from hitting every frame
-
-  Player(FVector pos, HAction action): pos(pos), action(action), actionStart(0), health(100) {};
-  Player() {};
-
-  void startNewAction(int frame, HAction newAction, bool isOnLeft);
-  void TryStartingNewAction(int frame, AFightInput& input, bool isOnLeft);
-  float collidesWithBoundary(float boundary, bool isRightBound, int targetFrame);
-  void doDamagedAction(int frame);
-  void doBlockAction(int frame);
-  void doKdAction(int frame, bool isOnLeft, float knockdownDistance);
-  void doThrownAction(int frame, bool isOnLeft, float knockdownDistance, HAction newAction, Player& q);
-  void doMotion(int frame);
-};
-
-class Frame {
+// A frame that no rollback can change anymore, for anything that must
+// not act on predicted frames
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnFrameConfirmedDelegate, int32, frame);
+// Hits, blocks, throws, knockdowns and round ends for effects and
+// sounds. Every event is sent once, even if rollbacks resimulate its
+// frame, and cancelled if a rollback takes it away.
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnFightEventDelegate, const FFightEvent&, event);
+
+// A spectator connected to the host and the newest frame of the
+// spectator feed that was sent to it
+class SpectatorConnection {
 public:
-  Player p1;
-  Player p2;
-  int hitstop = 0; // number of frames of hitstop left
-  float pushbackPerFrame;
-  int hitPlayer; // when hitstop>0, 0=both, 1=p1, 2=p2
-  int frameNumber;
-
-  Frame(Player p1, Player p2): p1(p1), p2(p2) {};
-  Frame() {};
+  ALogicPlayerController* pc;
+  int sentFrame;
 };
 
-class RingBuffer {
-private:
-  std::vector<Frame> v;
-  int n;
-  int end;
-
+// What the getters for other actors show, as of the newest logic
+// frame. With ALogic::simulateOnThread the simulation thread publishes
+// one of these after every frame.
+class PublishedFrame {
 public:
-  RingBuffer() = default;
-
-  void reserve(int size);
-
-  void clear();
-
-  void push(const Frame& x);
-
-  const Frame& last();
-
-  // pop the m last elements
-  void popn(int m);
+  Frame latest;
+  // the frame before it, for interpolation
+  Frame previous;
+  int frame = 0;
+  int roundNumber = 0;
+  int p1Wins = 0;
+  int p2Wins = 0;
+  int roundTime = 0;
+  int roundWinner = 0;
+  int inputDelay = 0;
+  float frameAdvantage = 0.0;
+  bool waitingForOpponent = false;
+  // see HCharacter::name()
+  const char* p1CharName = "";
+  const char* p2CharName = "";
+  // FPlatformTime::Seconds() when `latest' was simulated and the
+  // length of the logic frame after it
+  double time = 0.0;
+  float stepTime = 0.0;
 };
 
+// The fight of a game: a FightSimulation over two AFightInputs, driven
+// by the actor's tick, plus everything that needs the world, i.e. the
+// network, spectators and blueprint events.
 // TODO: make this a subclass of AInfo instead
 UCLASS()
-class MENU_API ALogic : public AActor
+class MENU_API ALogic : public AActor, public FightSimulation
 {
         GENERATED_BODY()
 
 public:
-#define PREROUND_TIME 60
-#define ENDROUND_TIME 60
+// a spectator that is more than SPECTATOR_CATCHUP_FRAMES behind the
+// frames it has recieved simulates SPECTATOR_CATCHUP_STEPS frames per
+// logic frame until it catches up
+#define SPECTATOR_CATCHUP_FRAMES 15
+#define SPECTATOR_CATCHUP_STEPS 4
         // set to true to skip the preround
         UPROPERTY(EditAnywhere)
         bool skipPreRound;
@@ -93,10 +95,59 @@ public:
         // testing purposes
         UPROPERTY(EditAnywhere)
         bool alwaysRollback;
-        UPROPERTY(EditAnywhere)
-        float rollbackAdjust;
+        // Logic frames per second, up to MAX_FRAMERATE. The frame data
+        // is scaled to it, so e.g. 60 halves the input latency of a
+        // frame without changing how long anything takes.
         UPROPERTY(EditAnywhere)
         int framerate = 30;
+        // Logic frames that may run in one render frame to catch up
+        // after a hitch. Any more time lost than that is dropped.
+        UPROPERTY(EditAnywhere)
+        int maxCatchUpSteps = 3;
+        // Step the simulation on a thread of its own instead of in
+        // Tick(). The game thread then only does the networking and
+        // the blueprint events, and the getters below show the newest
+        // frame that the thread has published.
+        UPROPERTY(EditAnywhere)
+        bool simulateOnThread;
+        // In offline play, player 2 is a FightBot that may think for
+        // cpuThinkTimeMs per decision, spread over the cores
+        UPROPERTY(EditAnywhere)
+        bool cpuOpponent = false;
+        UPROPERTY(EditAnywhere)
+        float cpuThinkTimeMs = BOT_BUDGET_MS;
+
+        // Artificial input delay in frames. With adaptiveInputDelay
+        // this is only the delay of the first round; afterwards the
+        // host picks a delay between rounds from the measured latency
+        // so that rollbacks stay within rollbackBudget frames.
+        UPROPERTY(EditAnywhere)
+        int inputDelay = 1;
+        UPROPERTY(EditAnywhere)
+        bool adaptiveInputDelay;
+        UPROPERTY(EditAnywhere)
+        int rollbackBudget = 2;
+        UPROPERTY(EditAnywhere)
+        int maxInputDelay = 4;
+
+        // When the remote inputs fall so far behind that a late one
+        // could need more than the rollback buffer, the simulation
+        // holds its last frame until they catch up. The match ends
+        // when that lasts longer than this many seconds.
+        UPROPERTY(EditAnywhere)
+        float disconnectTimeout = 5.0;
+        // How long the host keeps a match open for player 2 to rejoin
+        // after their connection closed
+        UPROPERTY(EditAnywhere)
+        float reconnectTimeout = 30.0;
+
+        // Spectators get the inputs of a frame spectatorDelay frames
+        // after the host has both of them, in batches of
+        // spectatorSendInterval frames.
+        UPROPERTY(EditAnywhere)
+        int spectatorDelay = 90;
+        UPROPERTY(EditAnywhere)
+        int spectatorSendInterval = 6;
 
         // Invisible objects at the ends of the stages. We will use
         // these just to grab their coordinates and not let players
@@ -127,61 +178,164 @@ public:
         FOnEndRoundDelegate OnEndRound;
         UPROPERTY (BlueprintAssignable, Category="Fight Sequence")
         FOnEndFightDelegate OnEndFight;
+        // Called once for every frame, in order
+        UPROPERTY (BlueprintAssignable, Category="Network")
+        FOnFrameConfirmedDelegate OnFrameConfirmed;
+        UPROPERTY (BlueprintAssignable, Category="Effects")
+        FOnFightEventDelegate OnFightEvent;
+        // e.g. stop the effect or sound that OnFightEvent started
+        UPROPERTY (BlueprintAssignable, Category="Effects")
+        FOnFightEventDelegate OnFightEventCancelled;
 
         // Sets default values for this actor's properties
         ALogic();
 
 private:
-        int maxRollback;
-        RingBuffer frames;
-        int frame;
-        int rollbackStopFrame; // When starting a new round, we don't
-                               // want to rollback past the first
-                               // frame.
-
-        enum LogicMode mode;
-        bool inPreRound; // setting this to true will cause Tick() to
-                         // count forward 30 frames rounded to the
-                         // nearest 15 frames, and then call
-                         // beginRound().
-        bool inEndRound;
-        int roundStartFrame;
-        int roundEndFrame;
-        int roundTimeTotal; // used just for displaying the timer
-
-        int roundNumber;
-        int p1Wins;
-        int p2Wins;
-        HCharacter p1Char;
-        HCharacter p2Char;
-
+        // true on the machine of a spectator. Spectators have no input
+        // of their own and never roll back; they only simulate frames
+        // that the host has confirmed inputs for.
+        bool spectating;
+        int spectatedP1Char;
+        int spectatedP2Char;
+        // On the host every confirmed input of the match, so that late
+        // spectators can start from the first frame. On a spectator
+        // the inputs recieved so far.
+        SpectatorFeed spectatorFeed;
+        // only on the host
+        std::vector<SpectatorConnection> spectators;
+
+        UStreetBrallersGameInstance* gameInstance;
         std::vector<ALogicPlayerController*> pcs;
+        // frame and tick counts at the last FPS message
         int startFrame_;
-        float acc, acc2;
-
-        void setMode(enum LogicMode);
-
-        // Reset the fight; put players back at start with full
-        // health, clear inputs and rollback buffer.
-        void reset(bool flipSpawns);
-
-        // a bunch of convenience functions for computeFrame()
-        float playerCollisionExtent(const Player &p, const Player &q, int targetFrame);
-        void HandlePlayerBoundaryCollision(Frame &f, int targetFrame, bool doRightBoundary);
-        bool IsPlayerOnLeft(const Player& p1, const Player& p2);
-        bool IsP1OnLeft(const Frame& f);
-
-        void computeFrame(int targetFrame);
+        int frame_;
+        float acc2;
+        FixedStepClock clock;
+        // the last frame before the latest logic frame, to interpolate
+        // from when rendering
+        Frame previousFrame;
+
+        // Held by the simulation thread while it steps and by the game
+        // thread while it touches the simulation, with
+        // simulateOnThread. Uncontended otherwise.
+        FCriticalSection simulationLock;
+        FightSimulationThread* simulationRunnable;
+        FRunnableThread* simulationThread;
+        TripleBuffer<PublishedFrame> published;
+        // Blueprint events and RPCs that the simulation thread raised,
+        // for the game thread to run on its next tick
+        std::vector<TFunction<void()>> gameThreadEvents;
+        // frames were sampled since the game thread last sent inputs
+        bool sendsDue;
+        // timing of the recent logic frames, see fight.DumpFramePacing
+        FramePacing framePacing;
+        // keeps our frame within a frame of the peer's in online play
+        TimeSync timeSync;
+        // fraction of a frame to wait before the next logic frame
+        float frameStretch;
+        // real time when the current stall started, or < 0
+        float stallStart;
+        // host only. Player 2 left and may come back, see
+        // playerDisconnected().
+        bool waitingForRejoin;
+        // player 2 with cpuOpponent, null otherwise
+        std::unique_ptr<FightBot> bot;
+
+        // Pick the input delay for the next round from the measured
+        // latency of the remote player. Only meaningful on the host.
+        int chooseInputDelay();
+        // input of the player on the other end of the connection. In
+        // offline play this is just p2Input.
+        AFightInput* remoteInput();
+        bool isOnline();
+
+        // Pick the characters of the next reset() from the game state,
+        // or from the host when spectating
+        void updateCharacters();
+        // simulation settings from our properties
+        FightConfig makeConfig();
 
         // Called every frame
         void FightTick();
+        // simulate() or give up on the match. Returns false if it
+        // gave up.
+        bool simulateFrame();
+        // End the match when we have been stalled for too long
+        void updateStall();
+        // let the bot give player 2's input for the next frame
+        void sampleBot();
+        // Run `event' now on the game thread, or on the game thread's
+        // next tick when called from the simulation thread
+        void runOnGameThread(TFunction<void()> event);
+        // Tick() with simulateOnThread: networking and events
+        void ThreadedTick();
+        // one logic frame on the simulation thread, which was due at
+        // `due'. Returns the length of the next one in seconds.
+        float simulationStep(double due);
+        // add the logic frame that just ran to framePacing
+        void recordFrame(double due, double started, int resimulatedBefore, float renderDeltaSeconds);
+        // put the current frame into `published'. `stepTime' is the
+        // length of the next logic frame.
+        void publishFrame(float stepTime);
+        // the getters below for a frame that was already read(), since
+        // another read() may swap it out
+        const Player& publishedPlayer(const PublishedFrame& p, int playerNumber);
+        float interpolationAlpha(const PublishedFrame& p);
+        FVector interpolatedPos(const PublishedFrame& p, int playerNumber, float alpha);
+        FFightPlayerVisualState playerVisualState(const PublishedFrame& p, int playerNumber, float alpha);
+        void startSimulationThread();
+        void stopSimulationThread();
+        // FightTick() for spectators; steps through the recieved
+        // inputs without rollback
+        void SpectatorTick();
+        // Record the newly confirmed inputs and send the ones that are
+        // old enough to the spectators. Only on the host.
+        void feedSpectators();
+        void sendSpectate(ALogicPlayerController* pc);
+        // export the rollback stats under a name unique to this match
+        void saveRollbackStats();
 
 protected:
         // Called when the game starts or when spawned
         virtual void BeginPlay() override;
+        virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+        // FightSimulation's round sequence hooks
+        virtual void onPreRound() override;
+        virtual void onBeginRound() override;
+        virtual void onEndRound() override;
+        virtual void onEndFight() override;
+        virtual void onFrameConfirmed(int frame) override;
+        virtual void onFightEvent(const FFightEvent& e) override;
+        virtual void onFightEventCancelled(const FFightEvent& e) override;
 
 public:
         void addPlayerController(ALogicPlayerController* pc);
+        // host only
+        void addSpectator(ALogicPlayerController* pc);
+        void removeSpectator(ALogicPlayerController* pc);
+        // spectator only. Start following the match from its first
+        // frame.
+        void startSpectating(int p1Char, int p2Char, const TArray<int32>& _roundDelays);
+        // spectator only. Store an encoded SpectatorPacket.
+        void spectatorInputs(const TArray<uint8>& packet);
+        UFUNCTION (BlueprintCallable, Category="Logic")
+        bool isSpectating();
+        // a round has started and the fight isn't over yet
+        bool isMatchInProgress();
+
+        // host only. Player 2's connection closed during the match;
+        // keep simulating up to the stall and wait reconnectTimeout
+        // seconds for them to come back.
+        void playerDisconnected();
+        // host only. Send a snapshot of the match to the player that
+        // took player 2's slot again.
+        void rejoinPlayer(ALogicPlayerController* pc);
+        // client only. Load the snapshot from rejoinPlayer(), give
+        // `pc' the inputs that the host predicted for the frames it
+        // missed and simulate ahead to where the host should be by
+        // now.
+        void resumeFromSnapshot(ALogicPlayerController* pc, const TArray<uint8>& snapshot);
 
         // reset() and Enter FightMode::Idle mode. Trigger OnPreRound
         // event.
@@ -199,17 +353,33 @@ public:
 
         virtual void Tick(float DeltaTime) override;
 
-        // Getters to get values for updating other actors
-        const Player& getPlayer1();
-        const Player& getPlayer2();
+        // Getters to get values for updating other actors. They show
+        // the newest published frame, so the game thread can call them
+        // while the simulation thread is stepping. Each one reads it
+        // once and returns copies, since the next read() may hand the
+        // buffer back to the simulation thread.
+        Player getPlayer1();
+        Player getPlayer2();
         // player number is 0-indexed for this function
-        const Player& getPlayer(int playerNumber);
+        Player getPlayer(int playerNumber);
 
         // These getters are not methods on Player because I don't
         // want to turn Player into a UObject and increase the size of
         // the data we need to save every frame.
+        // All of the getters below for both players at once
+        UFUNCTION (BlueprintCallable, Category="Logic")
+        FFightVisualState getVisualState();
         UFUNCTION (BlueprintCallable, Category="Logic")
         FVector playerPos(int playerNumber);
+        // How far the display is between the previous and the latest
+        // logic frame, in [0, 1]
+        UFUNCTION (BlueprintCallable, Category="Logic")
+        float getInterpolationAlpha();
+        // playerPos() blended between the last two logic frames by
+        // getInterpolationAlpha(), for displays that refresh faster
+        // than the simulation
+        UFUNCTION (BlueprintCallable, Category="Logic")
+        FVector playerInterpolatedPos(int playerNumber);
         UFUNCTION (BlueprintCallable, Category="Logic")
         bool playerIsFacingRight(int playerNumber);
         UFUNCTION (BlueprintCallable, Category="Logic")
@@ -236,11 +406,48 @@ public:
         // - 2 means draw
         UFUNCTION (BlueprintCallable, Category="Logic")
         int getRoundWinner();
+        // input delay in frames used for the current round
+        UFUNCTION (BlueprintCallable, Category="Logic")
+        int getInputDelay();
 
+        // the simulation's frame, unlike the published one that the
+        // getters above return
         int getCurrentFrame();
+        // How many frames we are ahead of the remote player right now,
+        // from how late their inputs arrive minus the one way latency.
+        // Sent to the peer with our inputs. 0 in offline play.
+        UFUNCTION (BlueprintCallable, Category="Network")
+        float getLocalFrameAdvantage();
+        // Advantage averaged with the one the peer reported
+        UFUNCTION (BlueprintCallable, Category="Network")
+        float getFrameAdvantage();
+
+        // newest frame that OnFrameConfirmed was called for
+        UFUNCTION (BlueprintCallable, Category="Network")
+        int getLastConfirmedFrame();
+        // true while the simulation holds its last frame because the
+        // opponent's inputs are late, e.g. to show a message
+        UFUNCTION (BlueprintCallable, Category="Network")
+        bool isWaitingForOpponent();
+        // Rollback counters of the match so far
+        UFUNCTION (BlueprintCallable, Category="Network")
+        FRollbackStats getMatchRollbackStats();
+        // Write them as CSV into Saved/RollbackStats. ALogic does this
+        // on its own at the end of every match it plays.
+        UFUNCTION (BlueprintCallable, Category="Network")
+        bool exportRollbackStats(const FString& fileName);
+        // Write the timing of the recent logic frames as CSV into
+        // Saved/FramePacing, like the fight.DumpFramePacing command
+        UFUNCTION (BlueprintCallable, Category="Network")
+        bool exportFramePacing(const FString& fileName);
 
         UFUNCTION (Client, Reliable)
         void ClientPlayersReady();
+        // Sent by the host between rounds. Everyone switches to
+        // `delay` when round `round` starts, and no one starts it
+        // before this arrived (see FightConfig::roundDelayFromHost).
+        UFUNCTION (NetMulticast, Reliable)
+        void MulticastInputDelay(int delay, int round);
 };
 
 static inline ALogic* FindLogic(UWorld *world) {
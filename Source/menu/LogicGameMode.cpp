@@ -5,8 +5,9 @@
 #include "Action.h"
 #include "Kismet/GameplayStatics.h"
 #include "Misc/DefaultValueHelper.h"
+#include "FightLog.h"
 
-#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("ALogicGameMode (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFightNet, category, TEXT("ALogicGameMode (%s) " message), (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
 
 ALogicGameMode::ALogicGameMode() {
   // use our custom PlayerController class
@@ -21,16 +22,25 @@ ALogicGameMode::ALogicGameMode() {
 void ALogicGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) {
   Super::InitGame(MapName, Options, ErrorMessage);
   playerCount = 0;
+  spectatorCount = 0;
+  rejoinSlotOpen = false;
+  rejoiningPlayer = nullptr;
 }
 
 void ALogicGameMode::PreLogin(const FString& Options,
                               const FString& Address,
                               const FUniqueNetIdRepl& UniqueId,
                               FString& ErrorMessage) {
-  if (playerCount > 1) {
+  if (rejoinSlotOpen && UGameplayStatics::HasOption(Options, FString("rejoin"))) {
+    MYLOG(Display, "PRELOGIN SUCEEDED! (rejoining player)");
+  }
+  else if ((playerCount > 1) && (spectatorCount >= maxSpectators)) {
     ErrorMessage = "Server is full";
     MYLOG(Warning, "SERVER IS FULL");
   }
+  else if (playerCount > 1) {
+    MYLOG(Display, "PRELOGIN SUCEEDED! (spectator)");
+  }
   else {
     MYLOG(Display, "PRELOGIN SUCEEDED!");
     FString character = UGameplayStatics::ParseOption(Options, FString("char"));
@@ -43,9 +53,30 @@ void ALogicGameMode::PreLogin(const FString& Options,
   }
 }
 
+FString ALogicGameMode::InitNewPlayer(APlayerController* NewPlayerController,
+                                     const FUniqueNetIdRepl& UniqueId,
+                                     const FString& Options,
+                                     const FString& Portal) {
+  if (rejoinSlotOpen && UGameplayStatics::HasOption(Options, FString("rejoin"))) {
+    rejoinSlotOpen = false;
+    rejoiningPlayer = NewPlayerController;
+  }
+  return Super::InitNewPlayer(NewPlayerController, UniqueId, Options, Portal);
+}
+
 void ALogicGameMode::PostLogin(APlayerController* NewPlayer) {
-  int playerNumber = playerCount++;
-  MYLOG(Display, "PostLogin: player %i", playerNumber);
+  const bool rejoining = (NewPlayer == rejoiningPlayer);
+  int playerNumber;
+  if (rejoining) {
+    playerNumber = 1;
+    rejoiningPlayer = nullptr;
+  }
+  else {
+    playerNumber = playerCount++;
+    if (playerNumber > 1)
+      ++spectatorCount;
+  }
+  MYLOG(Display, "PostLogin: player %i%s", playerNumber, rejoining ? TEXT(" (rejoining)") : TEXT(""));
   if (GetWorld()->IsNetMode(NM_ListenServer)) {
     MYLOG(Display, "PostLogin: is on server");
   }
@@ -55,4 +86,21 @@ void ALogicGameMode::PostLogin(APlayerController* NewPlayer) {
   ALogicPlayerController* c = Cast<ALogicPlayerController>(NewPlayer);
   c->ServerPostLogin(playerNumber);
   c->ClientPostLogin(playerNumber);
+  if (rejoining)
+    FindLogic(GetWorld())->rejoinPlayer(c);
+}
+
+void ALogicGameMode::Logout(AController* Exiting) {
+  Super::Logout(Exiting);
+  ALogicPlayerController* c = Cast<ALogicPlayerController>(Exiting);
+  if (c && c->isSpectator()) {
+    MYLOG(Display, "Logout: spectator %i", c->getPlayerNumber());
+    --spectatorCount;
+    FindLogic(GetWorld())->removeSpectator(c);
+  }
+  else if (c && (c->getPlayerNumber() == 1) && FindLogic(GetWorld())->isMatchInProgress()) {
+    MYLOG(Display, "Logout: player 1 left the match, keeping the slot open");
+    rejoinSlotOpen = true;
+    FindLogic(GetWorld())->playerDisconnected();
+  }
 }
@@ -18,8 +18,19 @@ class MENU_API ALogicGameMode : public AGameMode
 private:
 
   int playerCount;
+  int spectatorCount;
+  // player 2 left a match in progress and may rejoin it
+  bool rejoinSlotOpen;
+  // controller of the player that is taking the slot, between
+  // InitNewPlayer() and PostLogin()
+  APlayerController* rejoiningPlayer;
 
 public:
+  // Everyone that joins after the two players is a spectator, up to
+  // this many at a time.
+  UPROPERTY(EditAnywhere)
+  int maxSpectators = 8;
+
   ALogicGameMode();
 
   void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage);
@@ -29,5 +40,14 @@ public:
                 const FUniqueNetIdRepl& UniqueId,
                 FString& ErrorMessage);
 
+  // Players that connect with the `rejoin' option while player 2's
+  // slot is open take it back instead of becoming spectators
+  virtual FString InitNewPlayer(APlayerController* NewPlayerController,
+                                const FUniqueNetIdRepl& UniqueId,
+                                const FString& Options,
+                                const FString& Portal) override;
+
   void PostLogin(APlayerController* NewPlayer);
+
+  void Logout(AController* Exiting);
 };
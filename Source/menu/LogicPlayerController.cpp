@@ -2,7 +2,6 @@
 
 #include "LogicPlayerController.h"
 
-#include <limits>
 #include "Logic.h"
 #include "FightInput.h"
 #include "FightCameraActor.h"
@@ -10,8 +9,10 @@
 #include "StreetBrallersGameInstance.h"
 #include "EngineUtils.h"
 #include "GameFramework/Actor.h"
+#include "FightLog.h"
+#include <cmath>
 
-#define MYLOG(category, message, ...) UE_LOG(LogTemp, category, TEXT("ALogicPlayerController (%i %s) " message), playerNumber, (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
+#define MYLOG(category, message, ...) FIGHT_LOG(LogFightInput, category, TEXT("ALogicPlayerController (%i %s) " message), playerNumber, (GetWorld()->IsNetMode(NM_ListenServer)) ? TEXT("server") : TEXT("client"), ##__VA_ARGS__)
 
 ALogicPlayerController::ALogicPlayerController()
 {
@@ -22,10 +23,9 @@ void ALogicPlayerController::BeginPlay()
 {
   Super::BeginPlay();
   MYLOG(Warning, "BeginPlay");
-  buttonsPressed = 0;
-  buttonsReleased = 0;
+  sampler.reset();
+  sendBuffer.reset();
   addedPC = false;
-  lastTick = std::numeric_limits<int>::min();
 }
 
 void ALogicPlayerController::SetupInputComponent() {
@@ -49,71 +49,63 @@ void ALogicPlayerController::SetupInputComponent() {
 }
 
 void ALogicPlayerController::ButtonRightPressed() {
-  MYLOG(Warning, "ButtonRightPressed");
-  buttonsPressed = AFightInput::encodeButton(Button::RIGHT, buttonsPressed);
-  buttonsReleased = AFightInput::unsetButton(Button::RIGHT, buttonsReleased);
+  MYLOG(Verbose, "ButtonRightPressed");
+  sampler.press(AFightInput::encodeButton(Button::RIGHT));
 }
 
 void ALogicPlayerController::ButtonLeftPressed() {
-  MYLOG(Warning, "ButtonLeftPressed");
-  buttonsPressed = AFightInput::encodeButton(Button::LEFT, buttonsPressed);
-  buttonsReleased = AFightInput::unsetButton(Button::LEFT, buttonsReleased);
+  MYLOG(Verbose, "ButtonLeftPressed");
+  sampler.press(AFightInput::encodeButton(Button::LEFT));
 }
 
 void ALogicPlayerController::ButtonUpPressed() {
-  MYLOG(Warning, "ButtonUpPressed");
-  buttonsPressed = AFightInput::encodeButton(Button::UP, buttonsPressed);
-  buttonsReleased = AFightInput::unsetButton(Button::UP, buttonsReleased);
+  MYLOG(Verbose, "ButtonUpPressed");
+  sampler.press(AFightInput::encodeButton(Button::UP));
 }
 
 void ALogicPlayerController::ButtonDownPressed() {
-  MYLOG(Warning, "ButtonDownPressed");
-  buttonsPressed = AFightInput::encodeButton(Button::DOWN, buttonsPressed);
-  buttonsReleased = AFightInput::unsetButton(Button::DOWN, buttonsReleased);
+  MYLOG(Verbose, "ButtonDownPressed");
+  sampler.press(AFightInput::encodeButton(Button::DOWN));
 }
 
 void ALogicPlayerController::ButtonRightReleased() {
-  MYLOG(Warning, "ButtonRightReleased");
-  buttonsReleased = AFightInput::encodeButton(Button::RIGHT, buttonsReleased);
-  buttonsPressed = AFightInput::unsetButton(Button::RIGHT, buttonsPressed);
+  MYLOG(Verbose, "ButtonRightReleased");
+  sampler.release(AFightInput::encodeButton(Button::RIGHT));
 }
 
 void ALogicPlayerController::ButtonLeftReleased() {
-  MYLOG(Warning, "ButtonLeftReleased");
-  buttonsReleased = AFightInput::encodeButton(Button::LEFT, buttonsReleased);
-  buttonsPressed = AFightInput::unsetButton(Button::LEFT, buttonsPressed);
+  MYLOG(Verbose, "ButtonLeftReleased");
+  sampler.release(AFightInput::encodeButton(Button::LEFT));
 }
 
 void ALogicPlayerController::ButtonUpReleased() {
-  MYLOG(Warning, "ButtonUpReleased");
-  buttonsReleased = AFightInput::encodeButton(Button::UP, buttonsReleased);
-  buttonsPressed = AFightInput::unsetButton(Button::UP, buttonsPressed);
+  MYLOG(Verbose, "ButtonUpReleased");
+  sampler.release(AFightInput::encodeButton(Button::UP));
 }
 
 void ALogicPlayerController::ButtonDownReleased() {
-  MYLOG(Warning, "ButtonDownReleased");
-  buttonsReleased = AFightInput::encodeButton(Button::DOWN, buttonsReleased);
-  buttonsPressed = AFightInput::unsetButton(Button::DOWN, buttonsPressed);
+  MYLOG(Verbose, "ButtonDownReleased");
+  sampler.release(AFightInput::encodeButton(Button::DOWN));
 }
 
 void ALogicPlayerController::ButtonLP() {
-  MYLOG(Warning, "ButtonLP");
-  buttonsPressed = AFightInput::encodeButton(Button::LP, buttonsPressed);
+  MYLOG(Verbose, "ButtonLP");
+  sampler.press(AFightInput::encodeButton(Button::LP));
 }
 
 void ALogicPlayerController::ButtonLK() {
-  MYLOG(Warning, "ButtonLK");
-  buttonsPressed = AFightInput::encodeButton(Button::LK, buttonsPressed);
+  MYLOG(Verbose, "ButtonLK");
+  sampler.press(AFightInput::encodeButton(Button::LK));
 }
 
 void ALogicPlayerController::ButtonHP() {
-  MYLOG(Warning, "ButtonHP");
-  buttonsPressed = AFightInput::encodeButton(Button::HP, buttonsPressed);
+  MYLOG(Verbose, "ButtonHP");
+  sampler.press(AFightInput::encodeButton(Button::HP));
 }
 
 void ALogicPlayerController::ButtonHK() {
-  MYLOG(Warning, "ButtonHK");
-  buttonsPressed = AFightInput::encodeButton(Button::HK, buttonsPressed);
+  MYLOG(Verbose, "ButtonHK");
+  sampler.press(AFightInput::encodeButton(Button::HK));
 } 
 
 void ALogicPlayerController::ServerPostLogin_Implementation(int playerNumber_) {
@@ -126,6 +118,7 @@ void ALogicPlayerController::ServerPostLogin_Implementation(int playerNumber_) {
   // ULocalPlayer* localPlayer = GetLocalPlayer();
   // playerNumber = localPlayer ? localPlayer->GetLocalPlayerIndex() : playerNumber_;
   playerNumber = playerNumber_;
+  spectator = (playerNumber > 1);
   MYLOG(Warning, "ServerPostLogin");
   //UE_LOG(LogTemp, Warning, "ALogicPlayerController ServerPostLogin: Logging in Player %i (%s)", playerNumber, GetLocalPlayer() ? "local player" : "networked player");
 
@@ -143,8 +136,9 @@ void ALogicPlayerController::ServerPostLogin_Implementation(int playerNumber_) {
     break;
 
   default:
-      MYLOG(Warning, "Something went wrong");
-      opponentInput = l_->p1Input;
+    input = nullptr;
+    l_->addSpectator(this);
+    return;
   }
 
   opponentInput->SetOwner(this);
@@ -156,15 +150,21 @@ void ALogicPlayerController::ClientPostLogin_Implementation(int playerNumber_) {
   // ULocalPlayer* localPlayer = GetLocalPlayer();
   // playerNumber = localPlayer ? localPlayer->GetLocalPlayerIndex() : playerNumber_;
   playerNumber = playerNumber_;
+  spectator = (playerNumber > 1);
   MYLOG(Display, "ClientPostLogin");
 
   l = FindLogic(GetWorld());
   switch (playerNumber) {
   case 0:
     input = l->p1Input;
+    opponentInput = l->p2Input;
     break;
   case 1:
     input = l->p2Input;
+    opponentInput = l->p1Input;
+    break;
+  default:
+    input = opponentInput = nullptr;
     break;
   }
 
@@ -191,6 +191,16 @@ void ALogicPlayerController::Tick(float deltaSeconds) {
   if (GetWorld()->IsPaused())
     return;
 
+  // spectators neither ready up nor send inputs; ALogic starts when
+  // the host sends ClientSpectate()
+  if (spectator)
+    return;
+
+  if ((rejoinSnapshot.Num() > 0) && GetWorld()->HasBegunPlay()) {
+    l->resumeFromSnapshot(this, rejoinSnapshot);
+    rejoinSnapshot.Empty();
+  }
+
   if (!readiedUp) {
     if (GetWorld()->HasBegunPlay()) {
       MYLOG(Display, "ReadyUp");
@@ -211,24 +221,56 @@ void ALogicPlayerController::Tick(float deltaSeconds) {
 
 void ALogicPlayerController::sendButtons() {
   // MYLOG(Display, "sendButtons");
+  sampleButtons();
+  resendButtons();
+}
+
+void ALogicPlayerController::sampleButtons() {
   int targetFrame = l->getCurrentFrame() + 1;
-  if ((buttonsPressed != 0) || (buttonsReleased != 0) || (targetFrame >= lastTick+5)) {
-    lastTick = targetFrame;
-    input->buttons(buttonsPressed, buttonsReleased, targetFrame);
-    ServerButtons(buttonsPressed, buttonsReleased, targetFrame, input->getAvgLatency());
-    buttonsPressed = 0;
-    buttonsReleased = 0;
+  uint8 state = sampler.sample();
+
+  // apply the input locally exactly like the peer will when it
+  // recieves the packed frame
+  input->packedButtons(state, targetFrame);
+
+  sendBuffer.push(targetFrame, state);
+}
+
+void ALogicPlayerController::holdButtons(int toFrame) {
+  // what the peer predicted for the frames it didn't get from us: the
+  // directions of our last input, no presses
+  const uint8 held = input->getPackedInput(input->getLastInputFrame()) & InputPacket::directionBits;
+  for (int f = input->getLastInputFrame()+1; f <= toFrame; ++f) {
+    input->packedButtons(held, f);
+    sendBuffer.push(f, held);
   }
 }
 
-void ALogicPlayerController::ServerButtons_Implementation(int8 _buttonsPressed, int8 _buttonsReleased, int targetFrame, int avgLatency) {
+void ALogicPlayerController::resendButtons() {
+  // (re)send every frame the peer has not acknowledged yet
+  InputPacket p;
+  sendBuffer.makePacket(opponentInput->getPeerAck(), p);
+  // the ack, frame advantage and echoed timestamp are all about what we
+  // recieved from the opponent
+  p.ackFrame = opponentInput->getLastInputFrame();
+  opponentInput->fillTimestamps(p);
+  p.frameAdvantage = std::lround(l->getLocalFrameAdvantage() * 4);
+  TArray<uint8> packet;
+  p.encode(packet);
+  sentBytes.add(packet.Num());
+  ServerButtons(packet);
+}
+
+void ALogicPlayerController::ServerButtons_Implementation(const TArray<uint8>& packet) {
   if (GetWorld()->IsNetMode(NM_ListenServer)) {
     //MYLOG(Display, "ServerButtons");
     if (!input) {
       MYLOG(Warning, "ServerButtons: input is NULL");
     }
     else {
-      input->ClientButtons(_buttonsPressed, _buttonsReleased, targetFrame, avgLatency);
+      if (!IsLocalController())
+        recievedBytes.add(packet.Num());
+      input->ClientButtons(packet);
     }
   }
 }
@@ -236,3 +278,37 @@ void ALogicPlayerController::ServerButtons_Implementation(int8 _buttonsPressed,
 int ALogicPlayerController::getPlayerNumber() {
   return playerNumber;
 }
+
+float ALogicPlayerController::getSentBytesPerSecond() {
+  return sentBytes.bytesPerSecond();
+}
+
+float ALogicPlayerController::getRecievedBytesPerSecond() {
+  return recievedBytes.bytesPerSecond();
+}
+
+void ALogicPlayerController::ClientSpectate_Implementation(int p1Char, int p2Char, const TArray<int32>& roundDelays) {
+  MYLOG(Display, "ClientSpectate");
+  l = FindLogic(GetWorld());
+  l->startSpectating(p1Char, p2Char, roundDelays);
+}
+
+void ALogicPlayerController::ClientSpectatorInputs_Implementation(const TArray<uint8>& packet) {
+  recievedBytes.add(packet.Num());
+  l->spectatorInputs(packet);
+}
+
+void ALogicPlayerController::ClientRejoin_Implementation(const TArray<uint8>& snapshot) {
+  MYLOG(Display, "ClientRejoin");
+  // the match is already running; don't ready up for a new one
+  readiedUp = true;
+  rejoinSnapshot = snapshot;
+}
+
+bool ALogicPlayerController::isSpectator() {
+  return spectator;
+}
+
+float ALogicPlayerController::getInputLatency() {
+  return sampler.getLatency().mean();
+}
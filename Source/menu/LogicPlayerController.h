@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "GameFramework/PlayerController.h"
 #include "FightInput.h"
+#include "InputSampler.h"
 #include "LogicPlayerController.generated.h"
 
 class ALogic;
@@ -16,13 +17,24 @@ class MENU_API ALogicPlayerController : public APlayerController
 
 private:
   int playerNumber;
+  // player numbers after the first two are spectators. They have no
+  // input of their own and only watch the confirmed inputs that the
+  // host forwards to them.
+  bool spectator;
   bool readiedUp;
   bool addedPC;
   AFightInput* input;
+  AFightInput* opponentInput;
   ALogic *l;
-  int8 buttonsPressed;
-  int8 buttonsReleased;
-  int lastTick;
+  // button events since the last call to sampleButtons()
+  InputSampler sampler;
+  InputSendBuffer sendBuffer;
+  // input packets sent by this player, and on the server also the
+  // ones recieved from this player
+  ByteRateCounter sentBytes;
+  ByteRateCounter recievedBytes;
+  // snapshot from ClientRejoin() to load once the world has begun play
+  TArray<uint8> rejoinSnapshot;
 
 protected:
 	virtual void SetupInputComponent() override;
@@ -40,13 +52,53 @@ public:
   void ServerReadyUp(int p2Char);
 
   void Tick(float deltaSeconds);
+  // sampleButtons() and resendButtons()
   void sendButtons();
+  // Sample the input of the next frame and apply it locally without
+  // sending it. With ALogic::simulateOnThread the simulation thread
+  // does this and the game thread sends later.
+  void sampleButtons();
+  // Send the frames that the opponent has not acknowledged yet again,
+  // without sampling a new one. ALogic calls this instead of
+  // sendButtons() while it is stalled.
+  void resendButtons();
+  // Apply and send the held directions of our last input for every
+  // frame up to `toFrame' that we have no input for, like after a
+  // rejoin
+  void holdButtons(int toFrame);
 
-  UFUNCTION (Server, Reliable)
-    void ServerButtons(int8 _buttonsPressed, int8 _buttonsReleased, int targetFrame, int avgLatency);
+  // Sends an encoded InputPacket with our recent inputs to the
+  // server, which forwards it to the other player with
+  // AFightInput::ClientButtons().
+  UFUNCTION (Server, Unreliable)
+    void ServerButtons(const TArray<uint8>& packet);
+
+  // Sent by the host to a spectator when the match starts, or right
+  // away if it has started already. roundDelays are the input delays
+  // of the rounds played so far, indexed by round number.
+  UFUNCTION (Client, Reliable)
+  void ClientSpectate(int p1Char, int p2Char, const TArray<int32>& roundDelays);
+  // Confirmed inputs of both players as an encoded SpectatorPacket
+  UFUNCTION (Client, Reliable)
+  void ClientSpectatorInputs(const TArray<uint8>& packet);
+  // Sent by the host to a player that rejoins a match in progress,
+  // right after ClientPostLogin(). See ALogic::rejoinPlayer().
+  UFUNCTION (Client, Reliable)
+  void ClientRejoin(const TArray<uint8>& snapshot);
 
   UFUNCTION (BlueprintCallable, Category="Player")
   int getPlayerNumber();
+  UFUNCTION (BlueprintCallable, Category="Player")
+  bool isSpectator();
+
+  UFUNCTION (BlueprintCallable, Category="Player")
+  float getSentBytesPerSecond();
+  UFUNCTION (BlueprintCallable, Category="Player")
+  float getRecievedBytesPerSecond();
+  // average ms between a button event and the logic frame that
+  // first sees it
+  UFUNCTION (BlueprintCallable, Category="Player")
+  float getInputLatency();
 
   void ButtonRightPressed();
   void ButtonLeftPressed();
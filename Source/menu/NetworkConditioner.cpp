@@ -0,0 +1,132 @@
+#include "NetworkConditioner.h"
+#include "HAL/IConsoleManager.h"
+#include <algorithm>
+
+static float cvarLatencyMs = 0.0;
+static float cvarJitterMs = 0.0;
+static float cvarLoss = 0.0;
+static float cvarDuplicate = 0.0;
+static float cvarReorder = 0.0;
+static float cvarReorderMs = 50.0;
+static int cvarSeed = 1;
+
+static FAutoConsoleVariableRef CVarNetLatencyMs(
+  TEXT("fight.Net.LatencyMs"), cvarLatencyMs,
+  TEXT("Simulated one way latency of the input packets, in ms."));
+static FAutoConsoleVariableRef CVarNetJitterMs(
+  TEXT("fight.Net.JitterMs"), cvarJitterMs,
+  TEXT("Standard deviation of the simulated latency, in ms."));
+static FAutoConsoleVariableRef CVarNetLoss(
+  TEXT("fight.Net.Loss"), cvarLoss,
+  TEXT("Chance in [0,1] that an input packet is lost."));
+static FAutoConsoleVariableRef CVarNetDuplicate(
+  TEXT("fight.Net.Duplicate"), cvarDuplicate,
+  TEXT("Chance in [0,1] that an input packet arrives twice."));
+static FAutoConsoleVariableRef CVarNetReorder(
+  TEXT("fight.Net.Reorder"), cvarReorder,
+  TEXT("Chance in [0,1] that an input packet is held back by fight.Net.ReorderMs."));
+static FAutoConsoleVariableRef CVarNetReorderMs(
+  TEXT("fight.Net.ReorderMs"), cvarReorderMs,
+  TEXT("Extra delay of reordered input packets, in ms."));
+static FAutoConsoleVariableRef CVarNetSeed(
+  TEXT("fight.Net.Seed"), cvarSeed,
+  TEXT("Seed of the simulated network conditions."));
+
+bool NetworkConditions::isPerfect() const {
+  return (latencyMs <= 0.0) && (jitterMs <= 0.0) && (lossRate <= 0.0) &&
+    (duplicateRate <= 0.0) && (reorderRate <= 0.0);
+}
+
+NetworkConditions NetworkConditions::fromConsoleVariables() {
+  NetworkConditions c;
+  c.latencyMs = cvarLatencyMs;
+  c.jitterMs = cvarJitterMs;
+  c.lossRate = cvarLoss;
+  c.duplicateRate = cvarDuplicate;
+  c.reorderRate = cvarReorder;
+  c.reorderMs = cvarReorderMs;
+  c.seed = cvarSeed;
+  return c;
+}
+
+bool NetworkConditioner::DelayedPacket::operator>(const DelayedPacket& b) const {
+  if (deliverAt != b.deliverAt)
+    return deliverAt > b.deliverAt;
+  return sequence > b.sequence;
+}
+
+NetworkConditioner::NetworkConditioner() {
+  configure(NetworkConditions(), 0);
+}
+
+void NetworkConditioner::configure(const NetworkConditions& _conditions, int salt) {
+  conditions = _conditions;
+  rng.seed(((uint32) conditions.seed) * 7919u + (uint32) salt);
+  inFlight = {};
+  nextSequence = 0;
+  sent = dropped = duplicated = reordered = 0;
+}
+
+bool NetworkConditioner::isEnabled() const {
+  return !conditions.isPerfect();
+}
+
+float NetworkConditioner::uniform() {
+  // not std::uniform_real_distribution, whose results differ between
+  // standard libraries
+  return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+void NetworkConditioner::schedule(const TArray<uint8>& packet, double now) {
+  float delayMs = conditions.latencyMs;
+  if (conditions.jitterMs > 0.0) {
+    // Irwin-Hall approximation of a normal distribution, again for
+    // the same results everywhere
+    float sum = 0.0;
+    for (int i = 0; i < 12; ++i)
+      sum += uniform();
+    delayMs += (sum - 6.0f) * conditions.jitterMs;
+  }
+  if ((conditions.reorderRate > 0.0) && (uniform() < conditions.reorderRate)) {
+    delayMs += conditions.reorderMs;
+    ++reordered;
+  }
+  inFlight.push({now + std::max(0.0f, delayMs) / 1000.0, nextSequence++, packet});
+}
+
+void NetworkConditioner::send(const TArray<uint8>& packet, double now) {
+  ++sent;
+  if ((conditions.lossRate > 0.0) && (uniform() < conditions.lossRate)) {
+    ++dropped;
+    return;
+  }
+  schedule(packet, now);
+  if ((conditions.duplicateRate > 0.0) && (uniform() < conditions.duplicateRate)) {
+    ++duplicated;
+    schedule(packet, now);
+  }
+}
+
+bool NetworkConditioner::recieve(double now, TArray<uint8>& packet) {
+  if (inFlight.empty() || (inFlight.top().deliverAt > now))
+    return false;
+  packet = inFlight.top().packet;
+  inFlight.pop();
+  return true;
+}
+
+int NetworkConditioner::getSent() const {
+  return sent;
+}
+
+int NetworkConditioner::getDropped() const {
+  return dropped;
+}
+
+int NetworkConditioner::getDuplicated() const {
+  return duplicated;
+}
+
+int NetworkConditioner::getReordered() const {
+  return reordered;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <queue>
+#include <random>
+#include <vector>
+
+// How bad a simulated link is. All zero means a perfect link.
+class NetworkConditions {
+public:
+  float latencyMs = 0.0; // one way
+  float jitterMs = 0.0; // standard deviation of the added latency
+  float lossRate = 0.0; // in [0,1]
+  float duplicateRate = 0.0; // in [0,1]
+  // chance in [0,1] that a packet is held back by reorderMs more,
+  // so that the next packets overtake it
+  float reorderRate = 0.0;
+  float reorderMs = 0.0;
+  int seed = 0;
+
+  bool isPerfect() const;
+
+  // The conditions set with the fight.Net.* console variables, e.g.
+  // `fight.Net.LatencyMs 60' or -ExecCmds="fight.Net.Loss 0.05" on
+  // the command line. They apply to inputs initialized afterwards.
+  static NetworkConditions fromConsoleVariables();
+};
+
+// Delays, drops, duplicates and reorders packets in process, so that a
+// bad link can be reproduced on one machine. All randomness comes from
+// a seeded RNG, so the same seed and the same packets at the same times
+// give the same deliveries.
+//
+// The sender calls send() instead of delivering a packet and the
+// reciever polls recieve() for the packets that have arrived by now.
+class NetworkConditioner {
+private:
+  class DelayedPacket {
+  public:
+    double deliverAt;
+    uint64 sequence; // keeps equal times in sending order
+    TArray<uint8> packet;
+
+    bool operator>(const DelayedPacket& b) const;
+  };
+
+  NetworkConditions conditions;
+  std::mt19937 rng;
+  std::priority_queue<DelayedPacket, std::vector<DelayedPacket>, std::greater<DelayedPacket>> inFlight;
+  uint64 nextSequence;
+
+  int sent;
+  int dropped;
+  int duplicated;
+  int reordered;
+
+  float uniform();
+  void schedule(const TArray<uint8>& packet, double now);
+
+public:
+  NetworkConditioner();
+
+  // Start over with these conditions. `salt' is mixed into the seed so
+  // that the two directions of a link don't drop the same packets.
+  void configure(const NetworkConditions& _conditions, int salt);
+  // whether packets have to go through send() at all
+  bool isEnabled() const;
+
+  // now is in seconds, e.g. FPlatformTime::Seconds()
+  void send(const TArray<uint8>& packet, double now);
+  // Returns false once there is no packet due at `now'
+  bool recieve(double now, TArray<uint8>& packet);
+
+  int getSent() const;
+  int getDropped() const;
+  int getDuplicated() const;
+  int getReordered() const;
+};
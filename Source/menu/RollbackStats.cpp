@@ -0,0 +1,64 @@
+#include "RollbackStats.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <algorithm>
+
+void FRollbackStats::reset(int maxRollback) {
+  *this = FRollbackStats();
+  depthHistogram.Init(0, maxRollback+1);
+}
+
+void FRollbackStats::addRollback(int depth, int maxRollback, int p1Mispredicted, int p2Mispredicted) {
+  ++rollbacks;
+  if (depthHistogram.Num() > 0)
+    ++depthHistogram[std::clamp(depth, 0, depthHistogram.Num()-1)];
+  p1MispredictedFrames += p1Mispredicted;
+  p2MispredictedFrames += p2Mispredicted;
+  if (depth >= (maxRollback - ROLLBACK_NEAR_MISS_FRAMES))
+    ++nearMisses;
+}
+
+void FRollbackStats::addTick(int newFrames, int _resimulatedFrames, double seconds) {
+  ++ticks;
+  frames += newFrames;
+  resimulatedFrames += _resimulatedFrames;
+  lastTickResimulationMs = seconds * 1000.0;
+  resimulationMs += lastTickResimulationMs;
+  maxTickResimulationMs = std::max(maxTickResimulationMs, lastTickResimulationMs);
+}
+
+void FRollbackStats::addMaxRollbackExceeded() {
+  ++maxRollbackExceeded;
+}
+
+void FRollbackStats::addStalledTick() {
+  ++stalledTicks;
+}
+
+void FRollbackStats::computeRates(int framerate) {
+  rollbacksPerSecond = (frames == 0) ? 0.0 : ((float) rollbacks) * framerate / frames;
+}
+
+FString FRollbackStats::toCsv() const {
+  FString s;
+  s.Append(FString::Printf(TEXT("frames,%i\n"), frames));
+  s.Append(FString::Printf(TEXT("ticks,%i\n"), ticks));
+  s.Append(FString::Printf(TEXT("rollbacks,%i\n"), rollbacks));
+  s.Append(FString::Printf(TEXT("rollbacksPerSecond,%f\n"), rollbacksPerSecond));
+  s.Append(FString::Printf(TEXT("resimulatedFrames,%i\n"), resimulatedFrames));
+  s.Append(FString::Printf(TEXT("p1MispredictedFrames,%i\n"), p1MispredictedFrames));
+  s.Append(FString::Printf(TEXT("p2MispredictedFrames,%i\n"), p2MispredictedFrames));
+  s.Append(FString::Printf(TEXT("nearMisses,%i\n"), nearMisses));
+  s.Append(FString::Printf(TEXT("maxRollbackExceeded,%i\n"), maxRollbackExceeded));
+  s.Append(FString::Printf(TEXT("stalledTicks,%i\n"), stalledTicks));
+  s.Append(FString::Printf(TEXT("resimulationMs,%f\n"), resimulationMs));
+  s.Append(FString::Printf(TEXT("maxTickResimulationMs,%f\n"), maxTickResimulationMs));
+  s.Append(TEXT("# rollback depth (frames),count\n"));
+  for (int i = 0; i < depthHistogram.Num(); ++i)
+    s.Append(FString::Printf(TEXT("%i,%i\n"), i, depthHistogram[i]));
+  return s;
+}
+
+bool FRollbackStats::save(const FString& fileName) const {
+  return FFileHelper::SaveStringToFile(toCsv(), *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("RollbackStats"), fileName));
+}
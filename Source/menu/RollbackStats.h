@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RollbackStats.generated.h"
+
+// a rollback this many frames or less short of the maximum counts as a
+// near miss
+#define ROLLBACK_NEAR_MISS_FRAMES 3
+
+// Rollback counters of one match, kept by FightSimulation::simulate().
+// The times are wall clock and differ between machines; everything
+// else only depends on when the inputs arrived.
+USTRUCT(BlueprintType)
+struct FRollbackStats {
+  GENERATED_BODY()
+
+  // logic frames simulated for the first time
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 frames = 0;
+  // calls to simulate()
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 ticks = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 rollbacks = 0;
+  // rollbacks per second of logic frames, see computeRates()
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  float rollbacksPerSecond = 0.0;
+  // number of rollbacks by how many frames they went back
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  TArray<int32> depthHistogram;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 resimulatedFrames = 0;
+  // frames that were simulated with a wrong guess of the player's input
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 p1MispredictedFrames = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 p2MispredictedFrames = 0;
+  // rollbacks within ROLLBACK_NEAR_MISS_FRAMES of the maximum, and the
+  // ones that went past it and ended the match
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 nearMisses = 0;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 maxRollbackExceeded = 0;
+  // simulate() calls that could not advance because an input was
+  // missing for too long, see FightSimulation::isStalled()
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  int32 stalledTicks = 0;
+  // wall time spent resimulating, in ms
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  float resimulationMs = 0.0;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  float lastTickResimulationMs = 0.0;
+  UPROPERTY(BlueprintReadOnly, Category="Rollback")
+  float maxTickResimulationMs = 0.0;
+
+  // clear the counters for a match with this maximum rollback
+  void reset(int maxRollback);
+  void addRollback(int depth, int maxRollback, int p1Mispredicted, int p2Mispredicted);
+  // end of a simulate() call that spent `seconds' on resimulating
+  void addTick(int newFrames, int _resimulatedFrames, double seconds);
+  void addMaxRollbackExceeded();
+  void addStalledTick();
+  // fill in rollbacksPerSecond
+  void computeRates(int framerate);
+
+  // "name,value" lines followed by "depth,count" lines of the histogram
+  FString toCsv() const;
+  // Write toCsv() into the RollbackStats directory of the project's
+  // Saved directory. Returns false if writing failed.
+  bool save(const FString& fileName) const;
+};
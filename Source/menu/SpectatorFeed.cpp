@@ -0,0 +1,109 @@
+#include "SpectatorFeed.h"
+#include "InputPacket.h"
+#include <algorithm>
+
+int SpectatorPacket::lastFrame() const {
+  return firstFrame + p1States.Num() - 1;
+}
+
+static void encodeRuns(TArray<uint8>& out, const TArray<uint8>& states) {
+  for (int i = 0; i < states.Num();) {
+    int run = 1;
+    while ((i+run < states.Num()) && (states[i+run] == states[i]))
+      ++run;
+    InputPacket::writeVarint(out, run);
+    out.Add(states[i]);
+    i += run;
+  }
+}
+
+static bool decodeRuns(const TArray<uint8>& in, int& i, int count, TArray<uint8>& states) {
+  states.Reset();
+  while (states.Num() < count) {
+    uint32 run;
+    if (!InputPacket::readVarint(in, i, run) || (i >= in.Num()) || (run == 0) || (run > (uint32) (count - states.Num())))
+      return false;
+    uint8 state = in[i++];
+    for (uint32 j = 0; j < run; ++j)
+      states.Add(state);
+  }
+  return true;
+}
+
+void SpectatorPacket::encode(TArray<uint8>& out) const {
+  out.Reset();
+  InputPacket::writeVarint(out, firstFrame);
+  InputPacket::writeVarint(out, p1States.Num());
+  encodeRuns(out, p1States);
+  encodeRuns(out, p2States);
+}
+
+bool SpectatorPacket::decode(const TArray<uint8>& in) {
+  int i = 0;
+  uint32 first, count;
+  if (!InputPacket::readVarint(in, i, first) || !InputPacket::readVarint(in, i, count))
+    return false;
+  if (count > SPECTATOR_MAX_FRAMES_PER_PACKET)
+    return false;
+  firstFrame = first;
+  return decodeRuns(in, i, count, p1States) && decodeRuns(in, i, count, p2States) && (i == in.Num());
+}
+
+SpectatorFeed::SpectatorFeed() {
+  reset(0);
+}
+
+void SpectatorFeed::reset(int _firstFrame) {
+  firstFrame = _firstFrame;
+  p1.clear();
+  p2.clear();
+}
+
+int SpectatorFeed::lastFrame() const {
+  return firstFrame + (int) p1.size() - 1;
+}
+
+void SpectatorFeed::add(uint8 p1State, uint8 p2State) {
+  p1.push_back(p1State);
+  p2.push_back(p2State);
+}
+
+void SpectatorFeed::prune(int frame) {
+  int n = std::min(frame - firstFrame, (int) p1.size());
+  if (n <= 0)
+    return;
+  p1.erase(p1.begin(), p1.begin() + n);
+  p2.erase(p2.begin(), p2.begin() + n);
+  firstFrame += n;
+}
+
+uint8 SpectatorFeed::p1State(int frame) const {
+  return p1.at(frame - firstFrame);
+}
+
+uint8 SpectatorFeed::p2State(int frame) const {
+  return p2.at(frame - firstFrame);
+}
+
+bool SpectatorFeed::makePacket(int after, int upTo, SpectatorPacket& p) const {
+  int first = std::max(after+1, firstFrame);
+  int last = std::min({upTo, lastFrame(), first + SPECTATOR_MAX_FRAMES_PER_PACKET - 1});
+  p.p1States.Reset();
+  p.p2States.Reset();
+  if (last < first)
+    return false;
+  p.firstFrame = first;
+  for (int f = first; f <= last; ++f) {
+    p.p1States.Add(p1State(f));
+    p.p2States.Add(p2State(f));
+  }
+  return true;
+}
+
+bool SpectatorFeed::addPacket(const SpectatorPacket& p) {
+  if (p.firstFrame > lastFrame()+1)
+    return false;
+  for (int f = lastFrame()+1; f <= p.lastFrame(); ++f)
+    add(p.p1States[f - p.firstFrame], p.p2States[f - p.firstFrame]);
+  return true;
+}
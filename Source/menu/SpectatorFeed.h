@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+
+// largest number of frames the host puts in one SpectatorPacket, so
+// that a spectator that joins late is caught up in several packets
+// instead of one huge one
+#define SPECTATOR_MAX_FRAMES_PER_PACKET 256
+
+// Confirmed inputs of both players for a run of consecutive frames, as
+// sent from the host to spectators. Frames are packed like in
+// InputPacket.
+//
+// On the wire (see encode()) a packet is:
+// - firstFrame and the number of frames as varints
+// - for player 1 and then player 2, runs of identical packed frames,
+//   each a varint run length followed by the packed frame, adding up
+//   to the number of frames
+// Spectators get these over a reliable channel, so unlike InputPacket
+// nothing is repeated and runs can be as long as the packet.
+class SpectatorPacket {
+public:
+  int firstFrame = 0;
+  TArray<uint8> p1States;
+  TArray<uint8> p2States; // same length as p1States
+
+  int lastFrame() const;
+
+  void encode(TArray<uint8>& out) const;
+  // Returns false if the packet is malformed.
+  bool decode(const TArray<uint8>& in);
+};
+
+// Every confirmed frame of input in the match, starting from
+// firstFrame. The host records frames as soon as it has the inputs of
+// both players for them; a spectator records the frames it recieves
+// and simulates them in order.
+class SpectatorFeed {
+private:
+  int firstFrame;
+  std::vector<uint8> p1;
+  std::vector<uint8> p2;
+
+public:
+  SpectatorFeed();
+
+  void reset(int _firstFrame);
+
+  // newest frame in the feed, firstFrame-1 if it is empty
+  int lastFrame() const;
+  // append the inputs of lastFrame()+1
+  void add(uint8 p1State, uint8 p2State);
+  // Forget the frames before `frame'. Spectators do this with the
+  // frames they have simulated; the host keeps them for late
+  // spectators.
+  void prune(int frame);
+  // frame must be in [firstFrame, lastFrame()]
+  uint8 p1State(int frame) const;
+  uint8 p2State(int frame) const;
+
+  // Fill `p' with the frames after `after' up to and including
+  // `upTo', at most SPECTATOR_MAX_FRAMES_PER_PACKET of them. Returns
+  // false if there are none.
+  bool makePacket(int after, int upTo, SpectatorPacket& p) const;
+  // Append the frames of `p' that we don't have yet. Returns false if
+  // `p' starts after lastFrame()+1.
+  bool addPacket(const SpectatorPacket& p);
+};
@@ -2,6 +2,8 @@
 
 
 #include "StreetBrallersGameInstance.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Parse.h"
 
 void UStreetBrallersGameInstance::OnStart() {
   p1Char = 0;
@@ -13,3 +15,21 @@ void UStreetBrallersGameInstance::LoadComplete(const float LoadTime, const FStri
   Super::LoadComplete(LoadTime, MapName);
   CreateMessagesWidget();
 }
+
+void UStreetBrallersGameInstance::Init() {
+  Super::Init();
+  if (IsRunningDedicatedServer() && FParse::Param(FCommandLine::Get(), TEXT("matchpool"))) {
+    int threads = 0;
+    FParse::Value(FCommandLine::Get(), TEXT("matchthreads="), threads);
+    matchPool = MakeUnique<FightMatchPool>(threads);
+  }
+}
+
+void UStreetBrallersGameInstance::Shutdown() {
+  matchPool.Reset();
+  Super::Shutdown();
+}
+
+FightMatchPool* UStreetBrallersGameInstance::getMatchPool() {
+  return matchPool.Get();
+}
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "Engine/GameInstance.h"
 #include "Kismet/GameplayStatics.h"
+#include "FightMatchPool.h"
 #include "StreetBrallersGameInstance.generated.h"
 
 /**
@@ -38,6 +39,16 @@ public:
     void CreateMessagesWidget();
 
   virtual void LoadComplete(const float LoadTime, const FString& MapName) override;
+
+  // A dedicated server started with -matchpool runs its matches
+  // headless in a FightMatchPool, with -matchthreads=N workers.
+  virtual void Init() override;
+  virtual void Shutdown() override;
+  // null unless we are such a server
+  FightMatchPool* getMatchPool();
+
+private:
+  TUniquePtr<FightMatchPool> matchPool;
 };
 
 inline UStreetBrallersGameInstance* getSBGameInstance(UWorld* w) {
@@ -0,0 +1,39 @@
+#include "TimeSync.h"
+#include <algorithm>
+
+TimeSync::TimeSync(float threshold, float maxStretch, int settleFrames): threshold(threshold), maxStretch(maxStretch), settleFrames(settleFrames) {
+  reset();
+}
+
+void TimeSync::reset() {
+  advantage = 0.0;
+  pendingWait = 0.0;
+  settle = 0;
+}
+
+void TimeSync::update(float localAdvantage, float remoteAdvantage) {
+  // if both estimates were perfect, remoteAdvantage == -localAdvantage
+  advantage = (localAdvantage - remoteAdvantage) / 2.0;
+  if (settle > 0) {
+    --settle;
+    return;
+  }
+  if ((pendingWait <= 0.0) && (advantage >= threshold)) {
+    pendingWait = advantage;
+    settle = settleFrames;
+  }
+}
+
+float TimeSync::nextFrameStretch() {
+  float stretch = std::min(pendingWait, maxStretch);
+  pendingWait = std::max(0.0f, pendingWait - stretch);
+  return stretch;
+}
+
+float TimeSync::getAdvantage() const {
+  return advantage;
+}
+
+float TimeSync::getPendingWait() const {
+  return pendingWait;
+}
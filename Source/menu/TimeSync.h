@@ -0,0 +1,43 @@
+#pragma once
+
+// Keeps the frame counters of two peers within a frame of eachother.
+//
+// Each side estimates its local frame advantage: how many frames it
+// is ahead of the other side right now. The peers exchange these
+// estimates and average them, which cancels out errors that are the
+// same on both sides (such as an underestimated latency). The side
+// that is ahead then waits out its advantage by stretching its next
+// few logic frames by a small fraction each, instead of stopping for
+// whole frames at once. The slower side never waits; it simply stops
+// having to roll back the faster side's inputs.
+class TimeSync {
+private:
+  // Advantage (in frames) below which we don't bother waiting.
+  float threshold;
+  // Largest fraction of a frame that one frame may be stretched by.
+  float maxStretch;
+  // Frames to wait after a correction before trusting the advantage
+  // again, since the peer only sees its effect a round trip later.
+  int settleFrames;
+
+  float advantage;
+  float pendingWait; // frames of waiting still to spread out
+  int settle;
+
+public:
+  TimeSync(float threshold = 0.75, float maxStretch = 0.25, int settleFrames = 30);
+
+  void reset();
+
+  // Call once per logic frame with our own advantage estimate and the
+  // one the peer reported, both in frames.
+  void update(float localAdvantage, float remoteAdvantage);
+
+  // Fraction of a frame to wait in addition to the normal frame time
+  // before the next logic frame. Consumes the pending wait.
+  float nextFrameStretch();
+
+  // symmetric advantage in frames; positive means we are ahead
+  float getAdvantage() const;
+  float getPendingWait() const;
+};
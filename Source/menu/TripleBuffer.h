@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+// Hands the newest value from one writer thread to one reader thread
+// without either of them ever waiting.
+//
+// The writer fills in write() and publish()es it; the reader gets the
+// newest published value from read(). Of the three buffers one belongs
+// to the writer, one to the reader and one sits in the middle holding
+// the newest published value. publish() and read() swap their own
+// buffer with the middle one, so a value is never written while it is
+// being read. Values that the reader never got to are skipped.
+template <class T>
+class TripleBuffer {
+private:
+  static constexpr uint8 INDEX_MASK = 0x3;
+  // set on `middle' when it holds a value that read() hasn't seen
+  static constexpr uint8 NEW_BIT = 0x4;
+
+  T buffers[3];
+  std::atomic<uint8> middle;
+  uint8 back; // writer side only
+  uint8 front; // reader side only
+
+public:
+  TripleBuffer(): middle(1), back(0), front(2) {}
+
+  // writer side. The buffer to fill in; it still holds an old value.
+  T& write() {
+    return buffers[back];
+  }
+
+  // writer side. Make the buffer from write() the newest value.
+  void publish() {
+    back = middle.exchange(back | NEW_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  // reader side. The newest published value, which stays valid until
+  // the next read().
+  const T& read() {
+    if (middle.load(std::memory_order_acquire) & NEW_BIT)
+      front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+    return buffers[front];
+  }
+};